@@ -0,0 +1,597 @@
+#include "AssetServer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+AssetServer::AssetServer(DriveOverlay& overlay, const unsigned int threadCount):
+    driveFds(), listenFd(-1), overlay(overlay), fileSystems(), caches(), waitingConnections(0), workers(threadCount)
+{
+    throw runtime_error("Serving is only supported on POSIX systems.");
+}
+
+AssetServer::~AssetServer()
+{}
+
+void AssetServer::listenTcp(const int port)
+{}
+
+void AssetServer::listenUnix(const string socketPath)
+{}
+
+void AssetServer::setCache(const size_t byteBudget)
+{}
+
+void AssetServer::serve()
+{}
+
+#else
+
+/**
+ * Parts of a request the server cares about.
+ */
+struct AssetRequest {
+    string method;
+    string path;
+    bool acceptsDeflate;
+    bool keepAlive;
+};
+
+/**
+ * Decodes %XX escapes of a request target and drops the query string.
+ */
+static string decodeTarget(const string& target)
+{
+    string path;
+
+    for (size_t pos = 0; pos < target.size() && target[pos] != '?'; pos++)
+    {
+        if (target[pos] == '%' && pos + 2 < target.size() && isxdigit(static_cast<unsigned char>(target[pos + 1])) && isxdigit(static_cast<unsigned char>(target[pos + 2])))
+        {
+            path += static_cast<char>(stoi(target.substr(pos + 1, 2), nullptr, 16));
+            pos += 2;
+        } else
+        {
+            path += target[pos];
+        }
+    }
+
+    return path;
+}
+
+/**
+ * Checks whether an Accept-Encoding value lists deflate, without ruling it out through q=0.
+ */
+static bool acceptsDeflate(const string& acceptEncoding)
+{
+    size_t pos = 0;
+
+    while (pos < acceptEncoding.size())
+    {
+        size_t end = acceptEncoding.find(',', pos);
+        end = end == string::npos ? acceptEncoding.size() : end;
+
+        string coding;
+        for (size_t i = pos; i < end; i++)
+        {
+            if (acceptEncoding[i] != ' ' && acceptEncoding[i] != '\t')
+            {
+                coding += static_cast<char>(tolower(static_cast<unsigned char>(acceptEncoding[i])));
+            }
+        }
+
+        const string name = coding.substr(0, coding.find(';'));
+        const bool isRejected = coding.find(";q=0") != string::npos && coding.find_first_of("123456789", coding.find(";q=0")) == string::npos;
+
+        if ((name == "deflate" || name == "*") && !isRejected)
+        {
+            return true;
+        }
+
+        pos = end + 1;
+    }
+
+    return false;
+}
+
+/**
+ * Splits a request header into the request line and the header fields needed.
+ * Returns false if the request line is malformed.
+ */
+static bool parseRequest(const string& header, AssetRequest& request)
+{
+    const size_t requestLineEnd = header.find("\r\n");
+    const string requestLine = header.substr(0, requestLineEnd);
+    const size_t methodEnd = requestLine.find(' ');
+    const size_t targetEnd = requestLine.find(' ', methodEnd + 1);
+
+    if (methodEnd == string::npos || targetEnd == string::npos)
+    {
+        return false;
+    }
+
+    const string version = requestLine.substr(targetEnd + 1);
+    request.method = requestLine.substr(0, methodEnd);
+    request.path = decodeTarget(requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1));
+    request.acceptsDeflate = false;
+    request.keepAlive = version == "HTTP/1.1";
+
+    size_t lineStart = requestLineEnd + 2;
+
+    while (lineStart < header.size())
+    {
+        size_t lineEnd = header.find("\r\n", lineStart);
+        lineEnd = lineEnd == string::npos ? header.size() : lineEnd;
+
+        const string line = header.substr(lineStart, lineEnd - lineStart);
+        const size_t colon = line.find(':');
+
+        if (colon != string::npos)
+        {
+            string name = line.substr(0, colon);
+            for (char& character : name)
+            {
+                character = static_cast<char>(tolower(static_cast<unsigned char>(character)));
+            }
+
+            string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+
+            string lowerValue = value;
+            for (char& character : lowerValue)
+            {
+                character = static_cast<char>(tolower(static_cast<unsigned char>(character)));
+            }
+
+            if (name == "accept-encoding")
+            {
+                request.acceptsDeflate = acceptsDeflate(value);
+            } else if (name == "connection")
+            {
+                request.keepAlive = lowerValue.find("close") == string::npos && (request.keepAlive || lowerValue.find("keep-alive") != string::npos);
+            }
+        }
+
+        lineStart = lineEnd + 2;
+    }
+
+    return true;
+}
+
+/**
+ * Puts a file system over every drive for the inflated sends, and opens every drive a second time for the passthrough sends.
+ */
+AssetServer::AssetServer(DriveOverlay& overlay, const unsigned int threadCount):
+    driveFds(), listenFd(-1), overlay(overlay), fileSystems(), caches(), waitingConnections(0), workers(threadCount)
+{
+    for (int driveIndex = 0; driveIndex < overlay.getDriveCount(); driveIndex++)
+    {
+        this->fileSystems.push_back(make_unique<DriveFileSystem>(overlay.getDrive(driveIndex), overlay.getMetadata(driveIndex)));
+    }
+
+    for (int driveIndex = 0; driveIndex < overlay.getDriveCount(); driveIndex++)
+    {
+        const int driveFd = open(overlay.getDrivePath(driveIndex).c_str(), O_RDONLY);
+
+        if (driveFd < 0)
+        {
+            for (const int openedFd : this->driveFds)
+            {
+                close(openedFd);
+            }
+
+            throw runtime_error("Could not open drive file.");
+        }
+
+        this->driveFds.push_back(driveFd);
+    }
+}
+
+AssetServer::~AssetServer()
+{
+    if (this->listenFd >= 0)
+    {
+        close(this->listenFd);
+    }
+
+    for (const int driveFd : this->driveFds)
+    {
+        close(driveFd);
+    }
+}
+
+/**
+ * Listens on the loopback interface only, the server is meant for tools on the same machine.
+ */
+void AssetServer::listenTcp(const int port)
+{
+    this->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+    const int reuseAddress = 1;
+    setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (this->listenFd < 0 || ::bind(this->listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(this->listenFd, SOMAXCONN) != 0)
+    {
+        throw runtime_error("Could not listen on port " + to_string(port) + ".");
+    }
+}
+
+/**
+ * Listens on a Unix domain socket. A stale socket left behind at the path is replaced, any other file is not.
+ */
+void AssetServer::listenUnix(const string socketPath)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        throw runtime_error("Socket path is too long.");
+    }
+
+    socketPath.copy(address.sun_path, socketPath.size());
+
+    struct stat existingFile;
+    if (stat(socketPath.c_str(), &existingFile) == 0 && S_ISSOCK(existingFile.st_mode))
+    {
+        unlink(socketPath.c_str());
+    }
+
+    this->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (this->listenFd < 0 || ::bind(this->listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(this->listenFd, SOMAXCONN) != 0)
+    {
+        throw runtime_error("Could not listen on socket " + socketPath + ".");
+    }
+}
+
+/**
+ * Keeps inflated files in memory, within a budget split evenly between the drives. Every drive needs a cache of its own,
+ * as cache keys are only unique within a drive. Meant to be called before serving.
+ */
+void AssetServer::setCache(const size_t byteBudget)
+{
+    for (size_t driveIndex = 0; driveIndex < this->fileSystems.size(); driveIndex++)
+    {
+        this->caches.push_back(make_unique<EntryCache>(byteBudget / this->fileSystems.size()));
+        this->fileSystems[driveIndex]->setCache(this->caches.back().get());
+    }
+}
+
+/**
+ * Accepts connections until the process is stopped, handing each one to a worker.
+ */
+void AssetServer::serve()
+{
+    // Clients hanging up mid-response must not take the server down with them.
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true)
+    {
+        const int clientFd = accept(this->listenFd, nullptr, nullptr);
+
+        if (clientFd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE)
+            {
+                continue;
+            }
+
+            throw runtime_error("Could not accept connection.");
+        }
+
+        timeval idleTimeout = { ASSET_SERVER_IDLE_TIMEOUT, 0 };
+        setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &idleTimeout, sizeof(idleTimeout));
+
+        this->waitingConnections++;
+        this->workers.submit([this, clientFd]() {
+            this->waitingConnections--;
+
+            // Workers must not throw. Whatever fails before a response is under way still gets an answer.
+            try
+            {
+                this->handleConnection(clientFd);
+            } catch (std::exception&)
+            {
+                this->sendResponse(clientFd, "500 Internal Server Error", "The file could not be read from the drive.\n");
+            }
+
+            close(clientFd);
+        });
+    }
+}
+
+/**
+ * Reads and answers requests on a connection until either side closes it.
+ */
+void AssetServer::handleConnection(const int clientFd)
+{
+    string received;
+    char receiveBuf[0x1000];
+    bool isFirstRequest = true;
+
+    while (true)
+    {
+        const size_t headerEnd = received.find("\r\n\r\n");
+
+        if (headerEnd == string::npos)
+        {
+            if (received.size() > ASSET_SERVER_MAXIMUM_HEADER_SIZE)
+            {
+                this->sendResponse(clientFd, "431 Request Header Fields Too Large", "");
+                return;
+            }
+
+            // Between two requests the connection is idle, the first one is always waited for.
+            if (received.empty() && !isFirstRequest && !this->waitForRequest(clientFd))
+            {
+                return;
+            }
+
+            const ssize_t bytesReceived = recv(clientFd, receiveBuf, sizeof(receiveBuf), 0);
+
+            if (bytesReceived <= 0)
+            {
+                return;
+            }
+
+            received.append(receiveBuf, bytesReceived);
+            continue;
+        }
+
+        // Requests for files have no body, so whatever follows the header already belongs to the next request.
+        const string header = received.substr(0, headerEnd);
+        received.erase(0, headerEnd + 4);
+        isFirstRequest = false;
+
+        if (!this->handleRequest(clientFd, header))
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Waits for the next request on an idle keep-alive connection. Returns false once the idle timeout is up,
+ * or as soon as accepted connections are waiting for a worker, so an idle client can't keep them from being served.
+ */
+bool AssetServer::waitForRequest(const int clientFd)
+{
+    pollfd client = { clientFd, POLLIN, 0 };
+
+    for (int waited = 0; waited < ASSET_SERVER_IDLE_TIMEOUT * 1000; waited += ASSET_SERVER_IDLE_CHECK_INTERVAL)
+    {
+        if (this->waitingConnections > 0)
+        {
+            return false;
+        }
+
+        const int result = poll(&client, 1, ASSET_SERVER_IDLE_CHECK_INTERVAL);
+
+        if (result != 0 && !(result < 0 && errno == EINTR))
+        {
+            return result > 0;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Answers a single request. Returns whether the connection stays open for another one.
+ */
+bool AssetServer::handleRequest(const int clientFd, const string& header)
+{
+    AssetRequest request;
+
+    if (!parseRequest(header, request))
+    {
+        this->sendResponse(clientFd, "400 Bad Request", "Malformed request.\n");
+        return false;
+    }
+
+    if (request.method != "GET" && request.method != "HEAD")
+    {
+        this->sendResponse(clientFd, "405 Method Not Allowed", "Only GET and HEAD are supported.\n");
+        return false;
+    }
+
+    if (!this->overlay.contains(request.path) || this->overlay.open(request.path).entry.isDirectory())
+    {
+        this->sendResponse(clientFd, "404 Not Found", "File not found in drive: " + request.path + "\n");
+        return request.keepAlive;
+    }
+
+    OverlayEntry overlayEntry = this->overlay.open(request.path);
+    DriveMetadataEntry entry = overlayEntry.entry;
+    const string connection = request.keepAlive ? "keep-alive" : "close";
+
+    if (request.acceptsDeflate)
+    {
+        // The length is announced up front, so the payload has to be checked to lie within the drive before.
+        if (static_cast<uint64_t>(entry.getFileStart()) + entry.getFileSize() > this->overlay.getDrive(overlayEntry.driveIndex).getFileSize())
+        {
+            this->sendResponse(clientFd, "500 Internal Server Error", "The file lies beyond the end of the drive.\n");
+            return false;
+        }
+
+        const string responseHeader = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Encoding: deflate\r\n"
+            "Vary: Accept-Encoding\r\nContent-Length: " + to_string(entry.getFileSize()) + "\r\nConnection: " + connection + "\r\n\r\n";
+
+        if (!this->sendAll(clientFd, responseHeader.data(), responseHeader.size()))
+        {
+            return false;
+        }
+
+        return (request.method == "HEAD" || this->sendPayload(clientFd, overlayEntry)) && request.keepAlive;
+    }
+
+    uLong uncompressedSize;
+
+    try
+    {
+        uncompressedSize = this->fileSystems[overlayEntry.driveIndex]->stat(overlayEntry.fullPath).size;
+    } catch (std::exception&)
+    {
+        this->sendResponse(clientFd, "500 Internal Server Error", "The compressed data seems to be corrupt.\n");
+        return false;
+    }
+
+    const string responseHeader = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nVary: Accept-Encoding\r\n"
+        "Content-Length: " + to_string(uncompressedSize) + "\r\nConnection: " + connection + "\r\n\r\n";
+
+    if (!this->sendAll(clientFd, responseHeader.data(), responseHeader.size()))
+    {
+        return false;
+    }
+
+    return (request.method == "HEAD" || this->sendInflated(clientFd, overlayEntry)) && request.keepAlive;
+}
+
+/**
+ * Sends a short plain text response.
+ */
+void AssetServer::sendResponse(const int clientFd, const string& status, const string& body)
+{
+    const string response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain\r\nContent-Length: " + to_string(body.size())
+        + "\r\n\r\n" + body;
+
+    this->sendAll(clientFd, response.data(), response.size());
+}
+
+/**
+ * Sends a whole buffer. Returns false once the client is gone.
+ */
+bool AssetServer::sendAll(const int clientFd, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        const ssize_t bytesSent = send(clientFd, data, length, 0);
+
+        if (bytesSent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesSent <= 0)
+        {
+            return false;
+        }
+
+        data += bytesSent;
+        length -= bytesSent;
+    }
+
+    return true;
+}
+
+/**
+ * Sends the compressed payload of a file as it is stored in the drive.
+ * On Linux the kernel copies it straight from the page cache into the socket, elsewhere it goes through a buffer.
+ */
+bool AssetServer::sendPayload(const int clientFd, OverlayEntry overlayEntry)
+{
+    const int driveFd = this->driveFds[overlayEntry.driveIndex];
+    off_t offset = overlayEntry.entry.getFileStart();
+    size_t remainingLength = overlayEntry.entry.getFileSize();
+
+#ifdef __linux__
+    while (remainingLength > 0)
+    {
+        const ssize_t bytesSent = sendfile(clientFd, driveFd, &offset, remainingLength);
+
+        if (bytesSent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesSent <= 0)
+        {
+            return false;
+        }
+
+        remainingLength -= bytesSent;
+    }
+#else
+    char sendBuf[0x10000];
+
+    while (remainingLength > 0)
+    {
+        const ssize_t bytesRead = pread(driveFd, sendBuf, min(remainingLength, sizeof(sendBuf)), offset);
+
+        if (bytesRead <= 0 || !this->sendAll(clientFd, sendBuf, bytesRead))
+        {
+            return false;
+        }
+
+        offset += bytesRead;
+        remainingLength -= bytesRead;
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * Sends the inflated data of a file, read chunk by chunk through the file system of its drive.
+ * Returns false once the client is gone or the data turns out to be corrupt. The header is out already by then,
+ * so the only way left to report an error is to cut the response short.
+ */
+bool AssetServer::sendInflated(const int clientFd, OverlayEntry overlayEntry)
+{
+    DriveFileSystem& fileSystem = *this->fileSystems[overlayEntry.driveIndex];
+    int handle = -1;
+    char sendBuf[0x10000];
+    bool isConnected = true;
+    bool isComplete = false;
+
+    try
+    {
+        handle = fileSystem.open(overlayEntry.fullPath);
+
+        while (isConnected && !isComplete)
+        {
+            const uLong bytesRead = fileSystem.read(handle, sendBuf, sizeof(sendBuf));
+
+            isComplete = bytesRead == 0;
+            isConnected = isComplete || this->sendAll(clientFd, sendBuf, bytesRead);
+        }
+    } catch (std::exception&)
+    {
+        isConnected = false;
+    }
+
+    if (handle >= 0)
+    {
+        fileSystem.close(handle);
+    }
+
+    return isConnected;
+}
+
+#endif
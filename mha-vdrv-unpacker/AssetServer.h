@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DriveFileSystem.h"
+#include "DriveOverlay.h"
+#include "EntryCache.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+/**
+ * Largest request header accepted, anything beyond that is answered with 431.
+ */
+constexpr size_t ASSET_SERVER_MAXIMUM_HEADER_SIZE = 0x4000;
+
+/**
+ * Seconds an idle keep-alive connection is held open.
+ */
+constexpr int ASSET_SERVER_IDLE_TIMEOUT = 30;
+
+/**
+ * Milliseconds between the checks of an idle keep-alive connection whether it should make room for a waiting one.
+ */
+constexpr int ASSET_SERVER_IDLE_CHECK_INTERVAL = 200;
+
+/**
+ * Minimal HTTP/1.1 server for the files of a drive (or of several stacked drives), listening on localhost or on a
+ * Unix domain socket. GET and HEAD requests for a drive path ("/snd/theme.snd") return the file. The metadata is read once up front.
+ *
+ * The payloads already are zlib streams, which is exactly what HTTP calls "deflate". Clients that accept it get
+ * the payload unchanged, sent with sendfile straight from the drive. Everyone else gets it inflated on the fly,
+ * read through a DriveFileSystem per drive. With a cache set, small files are inflated once and then served from memory.
+ * Every connection takes up a worker. Idle keep-alive connections give theirs up as soon as other connections are waiting.
+ * Only available on POSIX systems.
+ */
+class AssetServer {
+public:
+    AssetServer(DriveOverlay& overlay, const unsigned int threadCount);
+    AssetServer(const AssetServer&) = delete;
+    AssetServer& operator=(const AssetServer&) = delete;
+    ~AssetServer();
+    void listenTcp(const int port);
+    void listenUnix(const string socketPath);
+    void setCache(const size_t byteBudget);
+    void serve();
+private:
+    void handleConnection(const int clientFd);
+    bool waitForRequest(const int clientFd);
+    bool handleRequest(const int clientFd, const string& header);
+    void sendResponse(const int clientFd, const string& status, const string& body);
+    bool sendAll(const int clientFd, const char* data, size_t length);
+    bool sendPayload(const int clientFd, OverlayEntry overlayEntry);
+    bool sendInflated(const int clientFd, OverlayEntry overlayEntry);
+
+    vector<int> driveFds;
+    int listenFd;
+    DriveOverlay& overlay;
+    vector<unique_ptr<DriveFileSystem>> fileSystems;
+    vector<unique_ptr<EntryCache>> caches;
+    atomic<unsigned int> waitingConnections;
+    WorkerPool workers;
+};
@@ -0,0 +1,246 @@
+#include "BatchUnpacker.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+#include "CompressedPayload.h"
+
+using namespace std;
+
+/**
+ * ioSlots: Maximum amount of reads from the drives in flight at the same time, across all drives.
+ * The remaining arguments are handed to the directory sink of every drive.
+ */
+BatchUnpacker::BatchUnpacker(WorkerPool& workers, const unsigned int ioSlots, PathFilter& filter, const bool mappedOutput, const bool sparseOutput):
+    workers(workers), filter(filter), mappedOutput(mappedOutput), sparseOutput(sparseOutput), drives(),
+    freeIoSlots(max(ioSlots, 1u)), ioMutex(), ioSlotFreed(), progressMutex()
+{}
+
+/**
+ * Queues a drive to be unpacked into the given directory. Nothing is read before unpack is called.
+ */
+void BatchUnpacker::addDrive(const string drivePath, const filesystem::path outputRoot)
+{
+    unique_ptr<BatchDrive> drive = make_unique<BatchDrive>();
+    drive->drivePath = drivePath;
+    drive->outputRoot = outputRoot;
+
+    this->drives.push_back(move(drive));
+}
+
+/**
+ * Reads the metadata of all drives and creates their directory trees, then unpacks the files of all drives at once.
+ * Returns the amount of drives that could not be unpacked completely.
+ */
+int BatchUnpacker::unpack()
+{
+    const size_t driveCount = this->drives.size();
+    size_t maximumFileCount = 0;
+    int failedDrives = 0;
+
+    for (size_t driveIndex = 0; driveIndex < driveCount; driveIndex++)
+    {
+        BatchDrive& drive = *this->drives[driveIndex];
+        cout << "[" << driveIndex + 1 << "/" << driveCount << "] " << drive.drivePath << " -> " << drive.outputRoot.string() << ": ";
+
+        try
+        {
+            unique_ptr<VDRV> vdrv = make_unique<VDRV>(drive.drivePath.c_str());
+            DriveMetadata meta = vdrv->readMetadata();
+            drive.overlay.addDrive(drive.drivePath, move(vdrv), move(meta));
+
+            filesystem::create_directories(drive.outputRoot);
+            drive.sink = make_unique<DirectorySink>(drive.outputRoot, this->mappedOutput, this->sparseOutput);
+
+            // Same as a single unpack: all directories without a filter, otherwise only those leading to unpacked files.
+            set<string> directoryPaths;
+            for (OverlayEntry rootEntry : drive.overlay.list(""))
+            {
+                if (rootEntry.entry.isDirectory() && this->filter.mayMatchBelow(rootEntry.entry.getFileName()))
+                {
+                    if (!this->filter.isActive())
+                    {
+                        drive.sink->addDirectory(rootEntry.entry.getFileName());
+                    }
+
+                    this->collectFiles(drive, rootEntry.entry.getFileName());
+                }
+            }
+
+            for (const BatchFile& file : drive.files)
+            {
+                size_t separator = this->filter.isActive() ? file.filePath.find('/') : string::npos;
+
+                for (; separator != string::npos; separator = file.filePath.find('/', separator + 1))
+                {
+                    directoryPaths.insert(file.filePath.substr(0, separator));
+                }
+            }
+
+            // Parents sort before their children.
+            for (const string& directoryPath : directoryPaths)
+            {
+                drive.sink->addDirectory(directoryPath);
+            }
+        } catch (std::exception& e)
+        {
+            cout << "Error: " << e.what() << endl;
+            drive.files.clear();
+            drive.sink.reset();
+            failedDrives++;
+            continue;
+        }
+
+        cout << drive.files.size() << " files, " << drive.totalBytes << " B compressed." << endl;
+        maximumFileCount = max(maximumFileCount, drive.files.size());
+    }
+
+    // Interleave the drives, so all of them are worked on from the start instead of one after another.
+    for (size_t fileIndex = 0; fileIndex < maximumFileCount; fileIndex++)
+    {
+        for (auto& drive : this->drives)
+        {
+            if (fileIndex < drive->files.size())
+            {
+                BatchDrive* drivePointer = drive.get();
+                BatchFile* filePointer = &drive->files[fileIndex];
+
+                this->workers.submit([this, drivePointer, filePointer]() {
+                    this->unpackFile(*drivePointer, *filePointer);
+                });
+            }
+        }
+    }
+
+    this->workers.wait();
+
+    for (auto& drive : this->drives)
+    {
+        if (drive->sink && drive->failedFiles > 0)
+        {
+            cout << drive->drivePath << ": " << drive->failedFiles << " of " << drive->files.size() << " files failed." << endl;
+            failedDrives++;
+        }
+    }
+
+    return failedDrives;
+}
+
+/**
+ * Checks whether a file starts with the magic string of a drive.
+ */
+bool BatchUnpacker::isDriveFile(const filesystem::path filePath)
+{
+    char magic[4] = {};
+    ifstream in(filePath, ios::in | ios::binary);
+
+    return in.read(magic, sizeof(magic)) && string(magic, sizeof(magic)) == "VDRV";
+}
+
+/**
+ * Walks a directory of a drive and collects the files to unpack, skipping whatever the filter rules out.
+ */
+void BatchUnpacker::collectFiles(BatchDrive& drive, const string directoryPath)
+{
+    for (OverlayEntry childEntry : drive.overlay.list(directoryPath))
+    {
+        const string childPath = directoryPath + "/" + childEntry.entry.getFileName();
+
+        if (!childEntry.entry.isDirectory())
+        {
+            if (this->filter.matchesFile(childPath))
+            {
+                drive.files.push_back({ childEntry, childPath });
+                drive.totalBytes += childEntry.entry.getFileSize();
+            }
+        } else if (this->filter.mayMatchBelow(childPath))
+        {
+            if (!this->filter.isActive())
+            {
+                drive.sink->addDirectory(childPath);
+            }
+
+            this->collectFiles(drive, childPath);
+        }
+    }
+}
+
+/**
+ * Reads a file within the I/O budget, then inflates and writes it outside of it.
+ */
+void BatchUnpacker::unpackFile(BatchDrive& drive, BatchFile& file)
+{
+    bool isUnpacked = false;
+
+    try
+    {
+        unique_ptr<char[]> compressedData;
+
+        this->acquireIoSlot();
+
+        try
+        {
+            lock_guard<mutex> driveLock(drive.driveMutex);
+            compressedData = drive.overlay.readCompressedFile(file.entry);
+        } catch (std::exception&)
+        {
+            this->releaseIoSlot();
+            throw;
+        }
+
+        this->releaseIoSlot();
+
+        CompressedPayload payload(move(compressedData), file.entry.entry.getFileSize());
+        isUnpacked = drive.sink->addFile(file.filePath, payload, payload.getUncompressedSize()) == Z_OK;
+    } catch (std::exception&)
+    {
+        isUnpacked = false;
+    }
+
+    if (!isUnpacked)
+    {
+        drive.failedFiles++;
+    }
+
+    drive.filesDone++;
+    this->reportProgress(drive);
+}
+
+/**
+ * Prints the progress of a drive in steps of 10 percent.
+ */
+void BatchUnpacker::reportProgress(BatchDrive& drive)
+{
+    lock_guard<mutex> progressLock(this->progressMutex);
+
+    const size_t filesDone = drive.filesDone;
+    const int percent = static_cast<int>(filesDone * 100 / drive.files.size());
+
+    if (percent / 10 <= drive.reportedPercent / 10)
+    {
+        return;
+    }
+
+    drive.reportedPercent = percent;
+    cout << drive.drivePath << ": " << percent << "% (" << filesDone << "/" << drive.files.size() << " files)";
+    cout << (filesDone == drive.files.size() ? " DONE." : "") << endl;
+}
+
+void BatchUnpacker::acquireIoSlot()
+{
+    unique_lock<mutex> ioLock(this->ioMutex);
+    this->ioSlotFreed.wait(ioLock, [this]() { return this->freeIoSlots > 0; });
+    this->freeIoSlots--;
+}
+
+void BatchUnpacker::releaseIoSlot()
+{
+    {
+        lock_guard<mutex> ioLock(this->ioMutex);
+        this->freeIoSlots++;
+    }
+
+    this->ioSlotFreed.notify_one();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DirectorySink.h"
+#include "DriveOverlay.h"
+#include "PathFilter.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+/**
+ * Unpacks many drives at once, each into its own directory tree, sharing one pool of workers.
+ *
+ * The file entries of all drives are interleaved into a single queue, so every drive makes progress and no drive
+ * hogs the disk. Reads from the drives are additionally capped at a fixed amount of concurrent reads (the I/O budget),
+ * while inflating and writing run on all workers. Progress is reported per drive.
+ */
+class BatchUnpacker {
+public:
+    BatchUnpacker(WorkerPool& workers, const unsigned int ioSlots, PathFilter& filter, const bool mappedOutput, const bool sparseOutput);
+    BatchUnpacker(const BatchUnpacker&) = delete;
+    BatchUnpacker& operator=(const BatchUnpacker&) = delete;
+    void addDrive(const string drivePath, const filesystem::path outputRoot);
+    int unpack();
+    static bool isDriveFile(const filesystem::path filePath);
+private:
+    struct BatchFile {
+        OverlayEntry entry;
+        string filePath;
+    };
+
+    struct BatchDrive {
+        string drivePath;
+        filesystem::path outputRoot;
+        DriveOverlay overlay;
+        unique_ptr<DirectorySink> sink;
+        mutex driveMutex;
+        vector<BatchFile> files;
+        uint64_t totalBytes = 0;
+        atomic<size_t> filesDone{0};
+        atomic<size_t> failedFiles{0};
+        int reportedPercent = -1;
+    };
+
+    void collectFiles(BatchDrive& drive, const string directoryPath);
+    void unpackFile(BatchDrive& drive, BatchFile& file);
+    void reportProgress(BatchDrive& drive);
+    void acquireIoSlot();
+    void releaseIoSlot();
+
+    WorkerPool& workers;
+    PathFilter& filter;
+    const bool mappedOutput;
+    const bool sparseOutput;
+    vector<unique_ptr<BatchDrive>> drives;
+
+    unsigned int freeIoSlots;
+    mutex ioMutex;
+    condition_variable ioSlotFreed;
+    mutex progressMutex;
+};
@@ -0,0 +1,99 @@
+#include "BufferedWriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+using namespace std;
+
+/**
+ * Opens the output for writing. An output path of "-" writes to stdout.
+ */
+BufferedWriter::BufferedWriter(const string outputPath, const size_t bufferSize):
+    out(nullptr), ownsOutput(outputPath != "-"), buffer(max<size_t>(bufferSize, 1)), bufferFill(0), bytesWritten(0)
+{
+    if (this->ownsOutput)
+    {
+        this->out = fopen(outputPath.c_str(), "wb");
+    } else
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        this->out = stdout;
+    }
+
+    if (this->out == nullptr)
+    {
+        throw runtime_error("Could not open output for writing.");
+    }
+
+    // We do our own buffering, stdio would only add another copy.
+    setvbuf(this->out, nullptr, _IONBF, 0);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    if (this->ownsOutput)
+    {
+        fclose(this->out);
+    }
+}
+
+/**
+ * Appends data to the buffer, writing it out whenever it runs full.
+ */
+void BufferedWriter::write(const void* data, size_t length)
+{
+    const char* source = static_cast<const char*>(data);
+    this->bytesWritten += length;
+
+    while (length > 0)
+    {
+        const size_t chunkLength = min(length, this->buffer.size() - this->bufferFill);
+        memcpy(this->buffer.data() + this->bufferFill, source, chunkLength);
+        this->bufferFill += chunkLength;
+        source += chunkLength;
+        length -= chunkLength;
+
+        if (this->bufferFill == this->buffer.size())
+        {
+            this->writeBuffer();
+        }
+    }
+}
+
+/**
+ * Writes out everything that is still buffered.
+ */
+void BufferedWriter::flush()
+{
+    this->writeBuffer();
+    fflush(this->out);
+}
+
+/**
+ * Gets the total amount of bytes written so far, which is also the current offset within the output.
+ */
+unsigned long long BufferedWriter::getBytesWritten()
+{
+    return this->bytesWritten;
+}
+
+/**
+ * Hands the buffered data to the OS.
+ */
+void BufferedWriter::writeBuffer()
+{
+    if (this->bufferFill > 0 && fwrite(this->buffer.data(), 1, this->bufferFill, this->out) != this->bufferFill)
+    {
+        throw runtime_error("Could not write output.");
+    }
+
+    this->bufferFill = 0;
+}
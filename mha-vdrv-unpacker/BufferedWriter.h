@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Sequential writer for archive outputs, either into a file or to stdout.
+ * Collects data in one large buffer and hands it to the OS in big writes, bypassing the stdio buffering.
+ */
+class BufferedWriter {
+public:
+    BufferedWriter(const string outputPath, const size_t bufferSize);
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+    ~BufferedWriter();
+    void write(const void* data, size_t length);
+    void flush();
+    unsigned long long getBytesWritten();
+private:
+    void writeBuffer();
+
+    FILE* out;
+    bool ownsOutput;
+    vector<char> buffer;
+    size_t bufferFill;
+    unsigned long long bytesWritten;
+};
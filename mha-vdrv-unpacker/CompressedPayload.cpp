@@ -0,0 +1,308 @@
+#include "CompressedPayload.h"
+
+#include <stdexcept>
+
+#include "Crc32.h"
+
+using namespace std;
+
+CompressedPayload::CompressedPayload(unique_ptr<char[]> data, const uint size):
+    data(move(data)), size(size), tee()
+{}
+
+/**
+ * Gets the raw zlib stream, including its header and trailer.
+ */
+const unsigned char* CompressedPayload::getData()
+{
+    return reinterpret_cast<const unsigned char*>(this->data.get());
+}
+
+/**
+ * Gets the size of the raw zlib stream.
+ */
+uint CompressedPayload::getSize()
+{
+    return this->size;
+}
+
+/**
+ * Determines the exact size of the data once inflated.
+ * The game files were only ever converted to zlib format and not actually compressed, so in practice we can just
+ * sum up the lengths from the headers of the stored blocks. Anything else falls back to a counting inflate pass.
+ */
+uLong CompressedPayload::getUncompressedSize()
+{
+    uLong totalLength = 0;
+
+    if (this->sumStoredBlocks(totalLength))
+    {
+        return totalLength;
+    }
+
+    return this->countInflatedBytes();
+}
+
+/**
+ * Inflates the whole stream into the given buffer, which has to be at least as large as the uncompressed size.
+ * Returns the zlib status code, Z_OK if the data was inflated completely.
+ */
+int CompressedPayload::inflateTo(unsigned char* destBuf, uLong destSize)
+{
+    uLongf destLength = destSize;
+    const int result = uncompress(destBuf, &destLength, this->getData(), this->size);
+
+    if (result == Z_OK && destLength != destSize)
+    {
+        return Z_DATA_ERROR;
+    }
+
+    if (result == Z_OK && this->tee)
+    {
+        this->tee(destBuf, destSize);
+    }
+
+    return result;
+}
+
+/**
+ * Inflates the stream piece by piece, handing every chunk of at most INFLATE_CHUNK_SIZE bytes to the consumer.
+ * Returns the zlib status code, Z_OK if the whole stream was inflated.
+ */
+int CompressedPayload::inflateChunks(const function<void(const unsigned char*, size_t)>& consumer)
+{
+    unique_ptr<unsigned char[]> chunkBuf(new unsigned char[INFLATE_CHUNK_SIZE]);
+
+    z_stream stream = {};
+    stream.next_in = const_cast<unsigned char*>(this->getData());
+    stream.avail_in = this->size;
+
+    if (inflateInit(&stream) != Z_OK)
+    {
+        throw runtime_error("Could not initialize zlib.");
+    }
+
+    int result;
+
+    do
+    {
+        stream.next_out = &chunkBuf[0];
+        stream.avail_out = INFLATE_CHUNK_SIZE;
+        result = inflate(&stream, Z_NO_FLUSH);
+
+        const size_t chunkLength = INFLATE_CHUNK_SIZE - stream.avail_out;
+        if ((result == Z_OK || result == Z_STREAM_END) && chunkLength > 0)
+        {
+            consumer(&chunkBuf[0], chunkLength);
+
+            if (this->tee)
+            {
+                this->tee(&chunkBuf[0], chunkLength);
+            }
+        }
+    } while (result == Z_OK);
+
+    inflateEnd(&stream);
+
+    // Running out of input before the end of the stream means the data is truncated.
+    return result == Z_STREAM_END ? Z_OK : (result == Z_BUF_ERROR ? Z_DATA_ERROR : result);
+}
+
+/**
+ * Hands everything inflateTo and inflateChunks produce to the tee as well, in order, e.g. to hash a file while a sink
+ * writes it. Passes that fail midway may have handed out part of the data already. Set nullptr to stop.
+ */
+void CompressedPayload::setTee(function<void(const unsigned char*, size_t)> tee)
+{
+    this->tee = tee;
+}
+
+/**
+ * Gets the raw deflate stream inside of the zlib wrapper, i.e. without the 2 byte header and the 4 byte adler32 trailer.
+ * Returns false if the data is not a plain zlib wrapped deflate stream.
+ */
+bool CompressedPayload::getRawDeflate(const unsigned char*& deflateData, uint& deflateLength)
+{
+    const unsigned char* stream = this->getData();
+
+    // Compression method 8 is deflate. A preset dictionary would not be available to anyone reading the raw stream.
+    if (this->size < 2 + 4 || (stream[0] & 0x0F) != 8 || (stream[1] & 0x20) != 0)
+    {
+        return false;
+    }
+
+    deflateData = stream + 2;
+    deflateLength = this->size - 2 - 4;
+
+    return true;
+}
+
+/**
+ * Computes the CRC-32 of the uncompressed data.
+ * Stored blocks are checksummed right where they are, only other block types have to be inflated for it.
+ */
+uint32_t CompressedPayload::computeCrc32()
+{
+    uint32_t crc = 0;
+
+    const bool isStoredOnly = this->walkStoredBlocks([&crc](const unsigned char* block, uint blockLength) {
+        crc = updateCrc32(crc, block, blockLength);
+    });
+
+    if (isStoredOnly)
+    {
+        return crc;
+    }
+
+    const int result = this->inflateChunks([&crc](const unsigned char* chunk, size_t chunkLength) {
+        crc = updateCrc32(crc, chunk, chunkLength);
+    });
+
+    if (result != Z_OK)
+    {
+        throw runtime_error("Compressed file is corrupt.");
+    }
+
+    return crc;
+}
+
+/**
+ * Hands the data of every stored block to the consumer, in stream order.
+ * Returns false without consuming anything if the stream contains anything other than stored blocks.
+ * Throws once all blocks are consumed if their Adler-32 checksum doesn't match the one at the end of the stream,
+ * as nothing gets inflated here that would check it otherwise.
+ */
+bool CompressedPayload::walkStoredBlocks(const function<void(const unsigned char*, uint)>& blockConsumer)
+{
+    uLong totalLength = 0;
+
+    if (!this->sumStoredBlocks(totalLength))
+    {
+        return false;
+    }
+
+    uLong checksum = adler32(0, Z_NULL, 0);
+    const function<void(const unsigned char*, uint)> checkingConsumer = [&checksum, &blockConsumer](const unsigned char* block, uint blockLength) {
+        checksum = adler32(checksum, block, blockLength);
+        blockConsumer(block, blockLength);
+    };
+
+    this->sumStoredBlocks(totalLength, &checkingConsumer);
+
+    // Unlike everything else in the drive, the checksum is stored big endian.
+    const unsigned char* trailer = this->getData() + this->size - 4;
+    const uLong expectedChecksum = (static_cast<uLong>(trailer[0]) << 24) | (trailer[1] << 16) | (trailer[2] << 8) | trailer[3];
+
+    if (checksum != expectedChecksum)
+    {
+        throw runtime_error("Compressed file is corrupt.");
+    }
+
+    return true;
+}
+
+/**
+ * Walks the block headers of a deflate stream that only consists of stored blocks and sums up their lengths.
+ * Optionally hands the data of every block to a consumer on the way.
+ * Returns false as soon as anything else is encountered, so the stream should have been checked before consuming it.
+ */
+bool CompressedPayload::sumStoredBlocks(uLong& totalLength, const function<void(const unsigned char*, uint)>* blockConsumer)
+{
+    const unsigned char* stream = this->getData();
+
+    // 2 bytes zlib header, at least one block header and the adler32 trailer.
+    if (this->size < 2 + 5 + 4)
+    {
+        return false;
+    }
+
+    // A preset dictionary would put 4 more bytes in front of the first block, which no drive seems to use.
+    if ((stream[1] & 0x20) != 0)
+    {
+        return false;
+    }
+
+    const uint streamEnd = this->size - 4;
+    uint pos = 2;
+    totalLength = 0;
+
+    while (true)
+    {
+        // Stored blocks always end on a byte boundary, so every header starts at bit 0 of a fresh byte.
+        // The remaining 5 bits of that byte are padding.
+        if (pos + 5 > streamEnd)
+        {
+            return false;
+        }
+
+        const bool isFinalBlock = (stream[pos] & 1) != 0;
+        const int blockType = (stream[pos] >> 1) & 3;
+
+        if (blockType != 0)
+        {
+            return false;
+        }
+
+        const uint blockLength = stream[pos + 1] | (stream[pos + 2] << 8);
+        const uint blockLengthComplement = stream[pos + 3] | (stream[pos + 4] << 8);
+
+        if ((blockLength ^ 0xFFFF) != blockLengthComplement)
+        {
+            return false;
+        }
+
+        if (pos + 5 + blockLength > streamEnd)
+        {
+            return false;
+        }
+
+        if (blockConsumer != nullptr)
+        {
+            (*blockConsumer)(stream + pos + 5, blockLength);
+        }
+
+        pos += 5 + blockLength;
+        totalLength += blockLength;
+
+        if (isFinalBlock)
+        {
+            return pos == streamEnd;
+        }
+    }
+}
+
+/**
+ * Inflates the stream into a small scratch buffer just to count the resulting bytes.
+ */
+uLong CompressedPayload::countInflatedBytes()
+{
+    unsigned char scratchBuf[0x4000];
+
+    z_stream stream = {};
+    stream.next_in = const_cast<unsigned char*>(this->getData());
+    stream.avail_in = this->size;
+
+    if (inflateInit(&stream) != Z_OK)
+    {
+        throw runtime_error("Could not initialize zlib.");
+    }
+
+    int result;
+
+    do
+    {
+        stream.next_out = scratchBuf;
+        stream.avail_out = sizeof(scratchBuf);
+        result = inflate(&stream, Z_NO_FLUSH);
+    } while (result == Z_OK);
+
+    const uLong totalLength = stream.total_out;
+    inflateEnd(&stream);
+
+    if (result != Z_STREAM_END)
+    {
+        throw runtime_error("Compressed file is corrupt.");
+    }
+
+    return totalLength;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "zlib.h"
+
+using uint = uint32_t;
+using namespace std;
+
+/**
+ * Size of the chunks handed out when inflating piece by piece.
+ */
+constexpr size_t INFLATE_CHUNK_SIZE = 0x40000;
+
+/**
+ * A zlib stream as it was read from the drive, along with the helpers needed to unpack it.
+ */
+class CompressedPayload {
+public:
+    CompressedPayload(unique_ptr<char[]> data, const uint size);
+    const unsigned char* getData();
+    uint getSize();
+    uLong getUncompressedSize();
+    int inflateTo(unsigned char* destBuf, uLong destSize);
+    int inflateChunks(const function<void(const unsigned char*, size_t)>& consumer);
+    bool getRawDeflate(const unsigned char*& deflateData, uint& deflateLength);
+    uint32_t computeCrc32();
+    bool walkStoredBlocks(const function<void(const unsigned char*, uint)>& blockConsumer);
+    void setTee(function<void(const unsigned char*, size_t)> tee);
+private:
+    bool sumStoredBlocks(uLong& totalLength, const function<void(const unsigned char*, uint)>* blockConsumer = nullptr);
+    uLong countInflatedBytes();
+
+    unique_ptr<char[]> data;
+    const uint size;
+    function<void(const unsigned char*, size_t)> tee;
+};
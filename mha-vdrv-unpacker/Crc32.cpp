@@ -0,0 +1,170 @@
+#include "Crc32.h"
+
+#include "zlib.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32_USE_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32_TARGET
+#else
+#define CRC32_TARGET __attribute__((target("pclmul,sse4.1")))
+#endif
+#endif
+
+/**
+ * Inputs shorter than this are not worth setting up the folding kernel for.
+ */
+constexpr size_t CRC32_FOLD_MINIMUM_LENGTH = 64;
+
+#ifdef CRC32_USE_PCLMUL
+
+/**
+ * Checks once whether the CPU supports carry-less multiplication and SSE4.1.
+ */
+static bool canUseFoldingKernel()
+{
+#ifdef _MSC_VER
+    static const bool supported = []() {
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 1);
+        return (cpuInfo[2] & (1 << 1)) != 0 && (cpuInfo[2] & (1 << 19)) != 0;
+    }();
+#else
+    static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+
+    return supported;
+}
+
+/**
+ * Folding CRC-32 kernel after Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ * Folds four 128 bit lanes in parallel, reduces them to one and finally Barrett reduces the remainder to 32 bits.
+ * Works on the inverted crc. The length must be at least 64 and a multiple of 16.
+ */
+CRC32_TARGET static uint32_t foldCrc32(uint32_t crc, const unsigned char* data, size_t length)
+{
+    // Constants for the bit reflected polynomial 0xEDB88320, taken from the paper.
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+
+    data += 64;
+    length -= 64;
+
+    // Fold 64 bytes per round into the four lanes.
+    while (length >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        length -= 64;
+    }
+
+    // Fold the four lanes into a single one.
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Fold the remaining 16 byte blocks.
+    while (length >= 16)
+    {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        length -= 16;
+    }
+
+    // Fold 128 bits down to 64.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduce to 32 bits.
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+#endif
+
+uint32_t updateCrc32(uint32_t crc, const unsigned char* data, size_t length)
+{
+#ifdef CRC32_USE_PCLMUL
+    if (length >= CRC32_FOLD_MINIMUM_LENGTH && canUseFoldingKernel())
+    {
+        // The kernel handles multiples of 16 bytes, the tail goes through zlib.
+        const size_t foldLength = length & ~static_cast<size_t>(15);
+        crc = ~foldCrc32(~crc, data, foldLength);
+        data += foldLength;
+        length -= foldLength;
+    }
+#endif
+
+    if (length == 0)
+    {
+        return crc;
+    }
+
+    return static_cast<uint32_t>(crc32(crc, data, static_cast<uInt>(length)));
+}
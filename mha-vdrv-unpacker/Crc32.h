@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Continues a CRC-32 (as used by zip and gzip) over another chunk of data. Start with a crc of 0.
+ * Uses a carry-less multiplication folding kernel where the CPU supports it, and zlib's table driven version otherwise.
+ */
+uint32_t updateCrc32(uint32_t crc, const unsigned char* data, size_t length);
@@ -0,0 +1,137 @@
+#include "DirectorySink.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#include "MappedOutputFile.h"
+#include "SparseFile.h"
+
+using namespace std;
+
+/**
+ * mappedOutput: Preallocate and map every output file, then inflate straight into the mapping.
+ * sparseOutput: Leave large runs of zeros out of the output files as holes.
+ * atomicWrites: Write every file under a temporary name first and only rename it once it is complete,
+ *               so a file with its real name is never a partial one.
+ */
+DirectorySink::DirectorySink(const filesystem::path rootPath, const bool mappedOutput, const bool sparseOutput, const bool atomicWrites):
+    rootPath(rootPath), mappedOutput(mappedOutput), sparseOutput(sparseOutput), atomicWrites(atomicWrites)
+{}
+
+/**
+ * Creates the directory if it does not exist already on the file system.
+ */
+void DirectorySink::addDirectory(const string directoryPath)
+{
+    const filesystem::path absoluteDirPath = this->resolve(directoryPath);
+
+    if (!filesystem::exists(absoluteDirPath))
+    {
+        filesystem::create_directories(absoluteDirPath);
+    }
+}
+
+/**
+ * Inflates a file and writes it below the root directory.
+ * Returns the zlib status code of the decompression.
+ */
+int DirectorySink::addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize)
+{
+    const filesystem::path absoluteFilePath = this->resolve(filePath);
+
+    if (!this->atomicWrites)
+    {
+        // The file may be a hard link (see addLink), whose other names must not be overwritten along with it.
+        error_code removeError;
+        filesystem::remove(absoluteFilePath, removeError);
+
+        return this->writeFile(absoluteFilePath, payload, uncompressedSize);
+    }
+
+    filesystem::path partialFilePath = absoluteFilePath;
+    partialFilePath += DIRECTORY_SINK_PARTIAL_SUFFIX;
+
+    // The file has to be closed before it can be renamed, which writeFile takes care of.
+    const int decompressionResult = this->writeFile(partialFilePath, payload, uncompressedSize);
+
+    if (decompressionResult == Z_OK)
+    {
+        filesystem::rename(partialFilePath, absoluteFilePath);
+    }
+
+    return decompressionResult;
+}
+
+/**
+ * Adds another name for a file written before, as a hard link. Fails on file systems without hard links.
+ */
+bool DirectorySink::addLink(const string filePath, const string targetPath)
+{
+    const filesystem::path absoluteFilePath = this->resolve(filePath);
+    filesystem::path partialFilePath = absoluteFilePath;
+    partialFilePath += DIRECTORY_SINK_PARTIAL_SUFFIX;
+
+    // Links can't replace existing files, so the link is made under the temporary name and then renamed over the file.
+    error_code linkError;
+    filesystem::remove(partialFilePath, linkError);
+    filesystem::create_hard_link(this->resolve(targetPath), partialFilePath, linkError);
+
+    if (linkError)
+    {
+        return false;
+    }
+
+    filesystem::rename(partialFilePath, absoluteFilePath);
+    return true;
+}
+
+/**
+ * Inflates a file and writes it to the given location on the file system.
+ */
+int DirectorySink::writeFile(const filesystem::path absoluteFilePath, CompressedPayload& payload, const uLong uncompressedSize)
+{
+    int decompressionResult;
+
+    if (this->mappedOutput)
+    {
+        // Inflate directly into the preallocated output file, skipping the intermediate buffer.
+        MappedOutputFile binFile(absoluteFilePath.string(), uncompressedSize);
+        decompressionResult = payload.inflateTo(binFile.getData(), uncompressedSize);
+
+        if (this->sparseOutput && decompressionResult == Z_OK)
+        {
+            binFile.punchHoles(findZeroSpans(binFile.getData(), uncompressedSize));
+        }
+
+        return decompressionResult;
+    }
+
+    unique_ptr<unsigned char[]> uncompressedBuf(new unsigned char[uncompressedSize]);
+    decompressionResult = payload.inflateTo(&uncompressedBuf[0], uncompressedSize);
+
+    // Write out the uncompressed data.
+    if (this->sparseOutput)
+    {
+        writeSparseFile(absoluteFilePath.string(), &uncompressedBuf[0], uncompressedSize);
+    } else
+    {
+        ofstream binFile(absoluteFilePath, ios::out | ios::binary);
+        binFile.write(reinterpret_cast<char*>(&uncompressedBuf[0]), uncompressedSize);
+        binFile.close();
+
+        if (binFile.fail())
+        {
+            throw runtime_error("Could not write " + absoluteFilePath.string());
+        }
+    }
+
+    return decompressionResult;
+}
+
+/**
+ * Turns a path within the drive into a path on the file system.
+ */
+filesystem::path DirectorySink::resolve(const string drivePath)
+{
+    return this->rootPath / filesystem::path(drivePath).make_preferred();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <filesystem>
+
+#include "OutputSink.h"
+
+using namespace std;
+
+/**
+ * Suffix of the temporary name a file is written under before it gets its real name, when writing atomically.
+ */
+const string DIRECTORY_SINK_PARTIAL_SUFFIX = ".vdrv-part";
+
+/**
+ * Recreates the drive tree as plain files and directories below a root directory.
+ */
+class DirectorySink : public OutputSink {
+public:
+    DirectorySink(const filesystem::path rootPath, const bool mappedOutput, const bool sparseOutput, const bool atomicWrites = false);
+    void addDirectory(const string directoryPath) override;
+    int addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize) override;
+    bool addLink(const string filePath, const string targetPath) override;
+private:
+    int writeFile(const filesystem::path absoluteFilePath, CompressedPayload& payload, const uLong uncompressedSize);
+    filesystem::path resolve(const string drivePath);
+
+    const filesystem::path rootPath;
+    const bool mappedOutput;
+    const bool sparseOutput;
+    const bool atomicWrites;
+};
@@ -0,0 +1,353 @@
+#include "DriveAnalyzer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+using namespace std;
+
+/**
+ * Formats an offset within the drive the way hex editors show it.
+ */
+static string toHexOffset(const uint64_t offset)
+{
+    ostringstream hex;
+    hex << "0x" << std::hex << setw(8) << setfill('0') << offset;
+    return hex.str();
+}
+
+/**
+ * Formats a share of a total in percent.
+ */
+static string toPercent(const uint64_t part, const uint64_t total)
+{
+    ostringstream percent;
+    percent << fixed << setprecision(1) << (total > 0 ? 100.0 * part / total : 0.0) << "%";
+    return percent.str();
+}
+
+DriveAnalyzer::DriveAnalyzer():
+    extents(), fileEntries(), directoryCount(0)
+{}
+
+/**
+ * Analyzes a single drive and prints a report. Returns whether the metadata of the drive could be read.
+ */
+bool DriveAnalyzer::analyze(const string drivePath)
+{
+    this->extents.clear();
+    this->fileEntries.clear();
+    this->directoryCount = 0;
+
+    cout << "Analyzing " << drivePath << "..." << endl;
+
+    try
+    {
+        VDRV vdrv(drivePath.c_str());
+        DriveMetadata metadata = vdrv.readMetadata();
+        PathIndex pathIndex(metadata);
+
+        this->extents.push_back({ 0, DRIVE_HEADER_SIZE, ExtentKind::HEADER, "drive header" });
+
+        for (int pos = 0; pos < metadata.getSize(); pos++)
+        {
+            DriveMetadataEntry entry = metadata.getEntryAt(pos);
+            const string path = pathIndex.getFullPath(entry);
+            const uint64_t entryOffset = entry.getEntryOffset();
+
+            this->extents.push_back({ entryOffset, entryOffset + vdrv.readEntrySize(entry), ExtentKind::METADATA, "metadata entry of " + path });
+
+            if (entry.isDirectory())
+            {
+                this->directoryCount++;
+                continue;
+            }
+
+            this->fileEntries.push_back(entry);
+
+            // Empty entries don't take up any bytes, wherever they point to.
+            if (entry.getFileSize() > 0)
+            {
+                const uint64_t fileStart = entry.getFileStart();
+                this->extents.push_back({ fileStart, fileStart + entry.getFileSize(), ExtentKind::DATA, path });
+            }
+        }
+
+        sort(this->extents.begin(), this->extents.end(), [](const Extent& left, const Extent& right) {
+            return left.start != right.start ? left.start < right.start : left.end < right.end;
+        });
+
+        cout << "=> " << vdrv.getFileSize() << " B, " << metadata.getSize() << " metadata entries (";
+        cout << this->fileEntries.size() << " files, " << this->directoryCount << " directories)." << endl;
+
+        this->reportRegions(vdrv.getFileSize());
+        this->reportLayout(vdrv.getFileSize());
+        this->reportHistogram();
+        this->reportSeeks(pathIndex);
+    } catch (std::exception& e)
+    {
+        cout << "=> Metadata can't be read: " << e.what() << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Prints the boundaries of the header, data and metadata regions, each from its first to its last byte.
+ */
+void DriveAnalyzer::reportRegions(const uint64_t driveSize)
+{
+    cout << "=> Regions:" << endl;
+
+    for (const ExtentKind kind : { ExtentKind::HEADER, ExtentKind::DATA, ExtentKind::METADATA })
+    {
+        uint64_t start = UINT64_MAX;
+        uint64_t end = 0;
+        uint64_t bytes = 0;
+        size_t count = 0;
+
+        for (const Extent& extent : this->extents)
+        {
+            if (extent.kind == kind)
+            {
+                start = min(start, extent.start);
+                end = max(end, extent.end);
+                bytes += extent.end - extent.start;
+                count++;
+            }
+        }
+
+        const string name = kind == ExtentKind::HEADER ? "header  " : kind == ExtentKind::DATA ? "data    " : "metadata";
+
+        if (count == 0)
+        {
+            cout << "   " << name << "  (none)" << endl;
+            continue;
+        }
+
+        cout << "   " << name << "  " << toHexOffset(start) << " - " << toHexOffset(end) << "  " << end - start << " B";
+
+        if (kind != ExtentKind::HEADER)
+        {
+            cout << ", " << bytes << " B in " << count << (kind == ExtentKind::DATA ? " payloads" : " entries");
+        }
+
+        cout << (end > driveSize ? " (extends beyond the end of the drive)" : "") << endl;
+    }
+}
+
+/**
+ * Walks the drive in offset order and prints the bytes that belong to nothing, to several entries, or are shared exactly.
+ */
+void DriveAnalyzer::reportLayout(const uint64_t driveSize)
+{
+    struct Range {
+        uint64_t start;
+        uint64_t end;
+        string description;
+    };
+
+    vector<Range> gaps;
+    vector<Range> overlaps;
+    uint64_t gapBytes = 0;
+    uint64_t overlapBytes = 0;
+    size_t aliasCount = 0;
+    uint64_t aliasBytes = 0;
+    uint64_t coveredEnd = 0;
+    const Extent* coveringExtent = nullptr;
+    const Extent* previousExtent = nullptr;
+
+    for (const Extent& extent : this->extents)
+    {
+        if (previousExtent != nullptr && extent.kind == ExtentKind::DATA && previousExtent->kind == ExtentKind::DATA
+            && extent.start == previousExtent->start && extent.end == previousExtent->end)
+        {
+            aliasCount++;
+            aliasBytes += extent.end - extent.start;
+        } else if (extent.start > coveredEnd)
+        {
+            const string after = coveringExtent == nullptr ? "the start of the drive" : coveringExtent->label;
+            gaps.push_back({ coveredEnd, extent.start, "between " + after + " and " + extent.label });
+            gapBytes += extent.start - coveredEnd;
+        } else if (extent.start < coveredEnd && coveringExtent != nullptr)
+        {
+            const uint64_t end = min(extent.end, coveredEnd);
+            overlaps.push_back({ extent.start, end, extent.label + " overlaps " + coveringExtent->label });
+            overlapBytes += end - extent.start;
+        }
+
+        if (extent.end > coveredEnd)
+        {
+            coveredEnd = extent.end;
+            coveringExtent = &extent;
+        }
+
+        previousExtent = &extent;
+    }
+
+    if (coveredEnd < driveSize)
+    {
+        gaps.push_back({ coveredEnd, driveSize, "after " + (coveringExtent == nullptr ? string("the start of the drive") : coveringExtent->label) + ", up to the end of the drive" });
+        gapBytes += driveSize - coveredEnd;
+    }
+
+    cout << "=> Layout: " << gaps.size() << " gap(s) with " << gapBytes << " B unused (" << toPercent(gapBytes, driveSize) << " of the drive), ";
+    cout << overlaps.size() << " overlap(s) with " << overlapBytes << " B, ";
+    cout << aliasCount << " file(s) sharing the data of another (" << aliasBytes << " B stored once)." << endl;
+
+    stable_sort(gaps.begin(), gaps.end(), [](const Range& left, const Range& right) {
+        return left.end - left.start > right.end - right.start;
+    });
+
+    for (size_t pos = 0; pos < gaps.size() && pos < DRIVE_ANALYZER_LISTED_RANGES; pos++)
+    {
+        cout << "   gap      " << toHexOffset(gaps[pos].start) << " - " << toHexOffset(gaps[pos].end) << "  " << gaps[pos].end - gaps[pos].start;
+        cout << " B, " << gaps[pos].description << endl;
+    }
+
+    for (size_t pos = 0; pos < overlaps.size() && pos < DRIVE_ANALYZER_LISTED_RANGES; pos++)
+    {
+        cout << "   overlap  " << toHexOffset(overlaps[pos].start) << " - " << toHexOffset(overlaps[pos].end) << "  " << overlaps[pos].end - overlaps[pos].start;
+        cout << " B, " << overlaps[pos].description << endl;
+    }
+
+    if (gaps.size() > DRIVE_ANALYZER_LISTED_RANGES || overlaps.size() > DRIVE_ANALYZER_LISTED_RANGES)
+    {
+        cout << "   (only the " << DRIVE_ANALYZER_LISTED_RANGES << " largest gaps and first overlaps are listed)" << endl;
+    }
+}
+
+/**
+ * Prints how many files fall into each range of compressed sizes, in steps of factor 4.
+ */
+void DriveAnalyzer::reportHistogram()
+{
+    const vector<string> bucketNames = {
+        "< 1 KiB", "1-4 KiB", "4-16 KiB", "16-64 KiB", "64-256 KiB", "256 KiB-1 MiB", "1-4 MiB", "4-16 MiB", "16-64 MiB", ">= 64 MiB"
+    };
+    vector<size_t> counts(bucketNames.size());
+    vector<uint64_t> bytes(bucketNames.size());
+    uint64_t totalBytes = 0;
+
+    for (DriveMetadataEntry& entry : this->fileEntries)
+    {
+        size_t bucket = 0;
+
+        for (uint64_t limit = 0x400; bucket + 1 < bucketNames.size() && entry.getFileSize() >= limit; limit <<= 2)
+        {
+            bucket++;
+        }
+
+        counts[bucket]++;
+        bytes[bucket] += entry.getFileSize();
+        totalBytes += entry.getFileSize();
+    }
+
+    const size_t largestCount = max<size_t>(*max_element(counts.begin(), counts.end()), 1);
+    cout << "=> Compressed file sizes:" << endl;
+
+    for (size_t bucket = 0; bucket < bucketNames.size(); bucket++)
+    {
+        const string bar(counts[bucket] > 0 ? max<size_t>(counts[bucket] * 40 / largestCount, 1) : 0, '#');
+        cout << "   " << left << setw(14) << bucketNames[bucket] << right << setw(8) << counts[bucket] << " files " << setw(7) << toPercent(bytes[bucket], totalBytes);
+        cout << " of bytes" << (bar.empty() ? "" : "  " + bar) << endl;
+    }
+}
+
+/**
+ * Prints the seeks needed to read every payload in tree order and in offset order.
+ */
+void DriveAnalyzer::reportSeeks(PathIndex& pathIndex)
+{
+    vector<pair<uint, uint>> treeOrder;
+    vector<pair<uint, uint>> offsetOrder;
+
+    // Same walk as the unpacker: root directories in metadata order, and in each directory its files before its sub-directories.
+    for (DriveMetadataEntry& rootEntry : pathIndex.list(""))
+    {
+        if (rootEntry.isDirectory())
+        {
+            this->collectTreeOrder(pathIndex, rootEntry, treeOrder);
+        }
+    }
+
+    for (DriveMetadataEntry& entry : this->fileEntries)
+    {
+        offsetOrder.emplace_back(entry.getFileStart(), entry.getFileSize());
+    }
+
+    sort(offsetOrder.begin(), offsetOrder.end());
+
+    const SeekEstimate treeSeeks = estimateSeeks(treeOrder);
+    const SeekEstimate offsetSeeks = estimateSeeks(offsetOrder);
+
+    cout << "=> Seeks to read all data (backwards, or forwards by more than " << DRIVE_ANALYZER_SEEK_THRESHOLD << " B):" << endl;
+    cout << "   tree order    " << setw(8) << treeSeeks.seeks << " seeks (" << treeSeeks.backwardSeeks << " backwards), " << treeSeeks.distance << " B skipped over";
+    cout << (treeOrder.size() < this->fileEntries.size() ? ", " + to_string(this->fileEntries.size() - treeOrder.size()) + " file(s) not reachable from a root directory" : "") << endl;
+    cout << "   offset order  " << setw(8) << offsetSeeks.seeks << " seeks (" << offsetSeeks.backwardSeeks << " backwards), " << offsetSeeks.distance << " B skipped over" << endl;
+
+    if (treeSeeks.seeks > offsetSeeks.seeks)
+    {
+        cout << "=> Reading in offset order saves " << toPercent(treeSeeks.seeks - offsetSeeks.seeks, treeSeeks.seeks) << " of the seeks." << endl;
+    } else
+    {
+        cout << "=> Tree order needs no more seeks than offset order." << endl;
+    }
+}
+
+void DriveAnalyzer::collectTreeOrder(PathIndex& pathIndex, DriveMetadataEntry directoryEntry, vector<pair<uint, uint>>& payloads)
+{
+    vector<DriveMetadataEntry> childEntries = pathIndex.getChildEntries(directoryEntry);
+
+    for (DriveMetadataEntry& childEntry : childEntries)
+    {
+        if (!childEntry.isDirectory())
+        {
+            payloads.emplace_back(childEntry.getFileStart(), childEntry.getFileSize());
+        }
+    }
+
+    for (DriveMetadataEntry& childEntry : childEntries)
+    {
+        if (childEntry.isDirectory())
+        {
+            this->collectTreeOrder(pathIndex, childEntry, payloads);
+        }
+    }
+}
+
+/**
+ * Counts the reads that don't start at or shortly after the end of the previous one, skipping data that was read before.
+ */
+DriveAnalyzer::SeekEstimate DriveAnalyzer::estimateSeeks(const vector<pair<uint, uint>>& payloads)
+{
+    SeekEstimate estimate = { 0, 0, 0 };
+    set<pair<uint, uint>> readPayloads;
+    uint64_t position = 0;
+    bool isFirstRead = true;
+
+    for (const pair<uint, uint>& payload : payloads)
+    {
+        const uint64_t fileStart = payload.first;
+
+        if (payload.second == 0 || !readPayloads.insert(payload).second)
+        {
+            continue;
+        }
+
+        if (!isFirstRead && (fileStart < position || fileStart > position + DRIVE_ANALYZER_SEEK_THRESHOLD))
+        {
+            estimate.seeks++;
+            estimate.backwardSeeks += fileStart < position ? 1 : 0;
+            estimate.distance += fileStart < position ? position - fileStart : fileStart - position;
+        }
+
+        position = fileStart + payload.second;
+        isFirstRead = false;
+    }
+
+    return estimate;
+}
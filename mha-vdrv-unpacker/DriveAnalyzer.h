@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "DriveMetadata.h"
+#include "PathIndex.h"
+#include "VDRV.h"
+
+using namespace std;
+
+/**
+ * Size of the known part of the drive header: the magic, up to the pointer to the first metadata entry at 0x48.
+ */
+constexpr uint DRIVE_HEADER_SIZE = 0x4C;
+
+/**
+ * Forward jumps between reads of up to this many bytes are counted as read through rather than as seeks, like readahead would.
+ */
+constexpr uint DRIVE_ANALYZER_SEEK_THRESHOLD = 0x10000;
+
+/**
+ * Gaps and overlaps beyond this many are only counted, not listed.
+ */
+constexpr size_t DRIVE_ANALYZER_LISTED_RANGES = 10;
+
+/**
+ * Reports how a drive is laid out, as input for choosing how to read it: where the header, the file data and the metadata are,
+ * which bytes belong to nothing (gaps) or to more than one entry (overlaps, and aliases sharing the exact same data),
+ * how the compressed sizes are distributed, and how many seeks an unpack needs in tree order (the order the unpacker
+ * visits the files in) compared with offset order. Data shared by several files is counted as read once, as the unpacker links the rest.
+ */
+class DriveAnalyzer {
+public:
+    DriveAnalyzer();
+    bool analyze(const string drivePath);
+private:
+    enum class ExtentKind { HEADER, DATA, METADATA };
+
+    struct Extent {
+        uint64_t start;
+        uint64_t end;
+        ExtentKind kind;
+        string label;
+    };
+
+    struct SeekEstimate {
+        uint64_t seeks;
+        uint64_t backwardSeeks;
+        uint64_t distance;
+    };
+
+    void reportRegions(const uint64_t driveSize);
+    void reportLayout(const uint64_t driveSize);
+    void reportHistogram();
+    void reportSeeks(PathIndex& pathIndex);
+    void collectTreeOrder(PathIndex& pathIndex, DriveMetadataEntry directoryEntry, vector<pair<uint, uint>>& payloads);
+    static SeekEstimate estimateSeeks(const vector<pair<uint, uint>>& payloads);
+
+    vector<Extent> extents;
+    vector<DriveMetadataEntry> fileEntries;
+    int directoryCount;
+};
@@ -0,0 +1,394 @@
+#include "DriveFileSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "CompressedPayload.h"
+
+using namespace std;
+
+DriveFileSystem::OpenFile::OpenFile(DriveMetadataEntry entry):
+    entry(entry), size(), position(0), readAhead(DRIVE_FS_MINIMUM_READ_AHEAD), window(), windowStart(0),
+    prefetched(), prefetchedStart(0), prefetchPending(false), fileMutex(), prefetchDone()
+{}
+
+/**
+ * Indexes the metadata, the drive is only accessed once files are read.
+ */
+DriveFileSystem::DriveFileSystem(VDRV& vdrv, DriveMetadata& metadata):
+    vdrv(vdrv), index(metadata), driveMutex(), fileSizes(), seekIndexes(), handlesMutex(), openFiles(), nextHandle(0), prefetchHook(), cache(nullptr)
+{}
+
+/**
+ * Waits for the prefetches still running on open files, as they refer back to the file system.
+ */
+DriveFileSystem::~DriveFileSystem()
+{
+    for (auto& openFile : this->openFiles)
+    {
+        unique_lock<mutex> fileLock(openFile.second->fileMutex);
+        openFile.second->prefetchDone.wait(fileLock, [&openFile]() { return !openFile.second->prefetchPending; });
+    }
+}
+
+/**
+ * Gets whether a file or directory with the given path exists.
+ */
+bool DriveFileSystem::exists(const string path)
+{
+    return this->index.contains(path);
+}
+
+/**
+ * Gets the type and size of an entry. Throws out_of_range if there is no such entry.
+ */
+DriveFileStat DriveFileSystem::stat(const string path)
+{
+    DriveMetadataEntry entry = this->index.open(path);
+    const uLong size = entry.isDirectory() ? 0 : this->getFileSize(entry);
+
+    return { entry.getFileName(), entry.isDirectory(), size, entry.getEntryOffset() };
+}
+
+/**
+ * Gets the names of all entries in a directory, the root being "".
+ */
+vector<string> DriveFileSystem::readdir(const string directoryPath)
+{
+    vector<string> names;
+
+    for (DriveMetadataEntry entry : this->index.list(directoryPath))
+    {
+        names.push_back(entry.getFileName());
+    }
+
+    return names;
+}
+
+/**
+ * Opens a file for reading and returns its handle. Throws out_of_range if there is no such file.
+ */
+int DriveFileSystem::open(const string path)
+{
+    DriveMetadataEntry entry = this->index.open(path);
+
+    if (entry.isDirectory())
+    {
+        throw invalid_argument("Path is a directory: " + path);
+    }
+
+    shared_ptr<OpenFile> file = make_shared<OpenFile>(entry);
+
+    lock_guard<mutex> handlesLock(this->handlesMutex);
+    const int handle = this->nextHandle++;
+    this->openFiles[handle] = file;
+
+    return handle;
+}
+
+/**
+ * Reads from the current position of a file and moves the position past the read bytes.
+ * Returns the amount of bytes read, which is only less than requested at the end of the file.
+ */
+uLong DriveFileSystem::read(const int handle, char* destBuf, const uLong length)
+{
+    shared_ptr<OpenFile> file = this->getOpenFile(handle);
+    unique_lock<mutex> fileLock(file->fileMutex);
+
+    // Small files are loaded as a whole anyway, which yields their size without another pass over the payload.
+    if (!file->size && file->entry.getFileSize() < SEEK_INDEX_CACHE_MINIMUM_SIZE)
+    {
+        this->loadWindow(*file, file->window, file->windowStart, 0, 0);
+        file->size = file->window.size();
+    } else if (!file->size)
+    {
+        file->size = this->getFileSize(file->entry);
+    }
+
+    uLong bytesRead = 0;
+
+    while (bytesRead < length && file->position < *file->size)
+    {
+        const uLong windowEnd = file->windowStart + file->window.size();
+
+        if (file->position >= file->windowStart && file->position < windowEnd)
+        {
+            const uLong chunkLength = min(length - bytesRead, windowEnd - file->position);
+            memcpy(destBuf + bytesRead, &file->window[file->position - file->windowStart], chunkLength);
+
+            bytesRead += chunkLength;
+            file->position += chunkLength;
+            continue;
+        }
+
+        file->prefetchDone.wait(fileLock, [&file]() { return !file->prefetchPending; });
+
+        const uLong prefetchedEnd = file->prefetchedStart + file->prefetched.size();
+        if (file->position >= file->prefetchedStart && file->position < prefetchedEnd)
+        {
+            swap(file->window, file->prefetched);
+            file->windowStart = file->prefetchedStart;
+            file->prefetched.clear();
+            continue;
+        }
+
+        // Continuing where the last window ended counts as sequential and doubles the window, anything else starts over.
+        const bool isSequential = !file->window.empty() && file->position == windowEnd;
+        file->readAhead = isSequential ? min(file->readAhead * 2, DRIVE_FS_MAXIMUM_READ_AHEAD) : DRIVE_FS_MINIMUM_READ_AHEAD;
+
+        this->loadWindow(*file, file->window, file->windowStart, file->position, max(length - bytesRead, file->readAhead));
+
+        if (file->window.empty())
+        {
+            break;
+        }
+    }
+
+    this->schedulePrefetch(file, fileLock);
+
+    return bytesRead;
+}
+
+/**
+ * Moves the position of a file. Positions beyond the end are allowed, reading there just returns nothing.
+ */
+void DriveFileSystem::seek(const int handle, const uLong position)
+{
+    shared_ptr<OpenFile> file = this->getOpenFile(handle);
+    lock_guard<mutex> fileLock(file->fileMutex);
+
+    file->position = position;
+}
+
+/**
+ * Closes a file. A prefetch still running for it is waited for, its result is dropped.
+ */
+void DriveFileSystem::close(const int handle)
+{
+    shared_ptr<OpenFile> file = this->getOpenFile(handle);
+
+    {
+        lock_guard<mutex> handlesLock(this->handlesMutex);
+        this->openFiles.erase(handle);
+    }
+
+    unique_lock<mutex> fileLock(file->fileMutex);
+    file->prefetchDone.wait(fileLock, [&file]() { return !file->prefetchPending; });
+}
+
+/**
+ * Sets where the read-ahead of sequentially read files runs. Without a hook, read-ahead only happens within read.
+ */
+void DriveFileSystem::setPrefetchHook(PrefetchHook hook)
+{
+    lock_guard<mutex> handlesLock(this->handlesMutex);
+    this->prefetchHook = hook;
+}
+
+/**
+ * Sets the cache for inflated files, which has to outlive the file system. Meant to be set up before any file is read.
+ */
+void DriveFileSystem::setCache(EntryCache* cache)
+{
+    lock_guard<mutex> driveLock(this->driveMutex);
+    this->cache = cache;
+}
+
+/**
+ * Gets the state behind a handle. Throws out_of_range for handles that are not open.
+ */
+shared_ptr<DriveFileSystem::OpenFile> DriveFileSystem::getOpenFile(const int handle)
+{
+    lock_guard<mutex> handlesLock(this->handlesMutex);
+    auto file = this->openFiles.find(handle);
+
+    if (file == this->openFiles.end())
+    {
+        throw out_of_range("Invalid file handle.");
+    }
+
+    return file->second;
+}
+
+/**
+ * Gets the uncompressed size of a file, determining it on first use.
+ */
+uLong DriveFileSystem::getFileSize(DriveMetadataEntry entry)
+{
+    {
+        lock_guard<mutex> driveLock(this->driveMutex);
+        auto cachedSize = this->fileSizes.find(entry.getPayloadKey());
+
+        if (cachedSize != this->fileSizes.end())
+        {
+            return cachedSize->second;
+        }
+    }
+
+    const uLong size = this->getSeekIndex(entry)->getUncompressedSize();
+
+    lock_guard<mutex> driveLock(this->driveMutex);
+    this->fileSizes[entry.getPayloadKey()] = size;
+
+    return size;
+}
+
+/**
+ * Gets the seek index of a file. The drive is only held while reading the compressed data, the index is built after that,
+ * so other files keep being read meanwhile. Like VDRV::readRange, only the indexes of large files are kept.
+ */
+shared_ptr<SeekIndex> DriveFileSystem::getSeekIndex(DriveMetadataEntry entry)
+{
+    unique_ptr<char[]> compressedData;
+    {
+        lock_guard<mutex> driveLock(this->driveMutex);
+        auto cachedIndex = this->seekIndexes.find(entry.getPayloadKey());
+
+        if (cachedIndex != this->seekIndexes.end())
+        {
+            return cachedIndex->second;
+        }
+
+        compressedData = this->vdrv.readCompressedFile(entry);
+    }
+
+    CompressedPayload payload(move(compressedData), entry.getFileSize());
+    shared_ptr<SeekIndex> seekIndex = make_shared<SeekIndex>(payload);
+
+    if (entry.getFileSize() >= SEEK_INDEX_CACHE_MINIMUM_SIZE)
+    {
+        // Two reads racing for the same file both build the index, the first one to finish is kept.
+        lock_guard<mutex> driveLock(this->driveMutex);
+        seekIndex = this->seekIndexes.emplace(entry.getPayloadKey(), seekIndex).first->second;
+    }
+
+    return seekIndex;
+}
+
+/**
+ * Inflates a whole file, going through both tiers of the cache if there is one.
+ */
+CachedData DriveFileSystem::inflateWholeFile(DriveMetadataEntry entry)
+{
+    EntryCache* cache;
+    {
+        lock_guard<mutex> driveLock(this->driveMutex);
+        cache = this->cache;
+    }
+
+    CachedData fileData = cache != nullptr ? cache->get(entry.getPayloadKey()) : nullptr;
+    if (fileData)
+    {
+        return fileData;
+    }
+
+    CachedData cachedCompressedData = cache != nullptr ? cache->getCompressed(entry.getPayloadKey()) : nullptr;
+    unique_ptr<char[]> compressedData;
+
+    if (cachedCompressedData)
+    {
+        compressedData.reset(new char[entry.getFileSize()]);
+        memcpy(&compressedData[0], cachedCompressedData->data(), entry.getFileSize());
+    } else
+    {
+        lock_guard<mutex> driveLock(this->driveMutex);
+        compressedData = this->vdrv.readCompressedFile(entry);
+    }
+
+    if (cache != nullptr && !cachedCompressedData)
+    {
+        cache->putCompressed(entry.getPayloadKey(), make_shared<const vector<char>>(&compressedData[0], &compressedData[0] + entry.getFileSize()));
+    }
+
+    CompressedPayload payload(move(compressedData), entry.getFileSize());
+    shared_ptr<vector<char>> inflatedData = make_shared<vector<char>>(payload.getUncompressedSize());
+
+    if (payload.inflateTo(reinterpret_cast<unsigned char*>(inflatedData->data()), inflatedData->size()) != Z_OK)
+    {
+        throw runtime_error("Compressed file is corrupt.");
+    }
+
+    if (cache != nullptr)
+    {
+        cache->put(entry.getPayloadKey(), inflatedData);
+    }
+
+    return inflatedData;
+}
+
+/**
+ * Fills a window with the data of a file from the given position on.
+ * Files below the seek index threshold are inflated as a whole instead, which is cheaper than indexing them for every window.
+ */
+void DriveFileSystem::loadWindow(OpenFile& file, vector<char>& window, uLong& windowStart, const uLong start, const uLong length)
+{
+    if (file.entry.getFileSize() < SEEK_INDEX_CACHE_MINIMUM_SIZE)
+    {
+        CachedData fileData = this->inflateWholeFile(file.entry);
+        window.assign(fileData->begin(), fileData->end());
+        windowStart = 0;
+        return;
+    }
+
+    shared_ptr<SeekIndex> seekIndex = this->getSeekIndex(file.entry);
+    DriveMetadataEntry entry = file.entry;
+
+    window.resize(length);
+    windowStart = start;
+
+    // Only the compressed chunks are read under the lock, they are inflated outside of it.
+    const uLong windowLength = seekIndex->read(start, reinterpret_cast<unsigned char*>(window.data()), length, [this, &entry](const uint from, unsigned char* chunkBuf, const size_t chunkLength) {
+        lock_guard<mutex> driveLock(this->driveMutex);
+        this->vdrv.readCompressedRange(entry, from, reinterpret_cast<char*>(chunkBuf), chunkLength);
+    });
+
+    window.resize(windowLength);
+}
+
+/**
+ * Hands the read-ahead of the next window to the prefetch hook, once a file has been read sequentially for a while.
+ * Releases the lock on the file either way, as the hook may run the task right away.
+ */
+void DriveFileSystem::schedulePrefetch(const shared_ptr<OpenFile>& file, unique_lock<mutex>& fileLock)
+{
+    PrefetchHook hook;
+    {
+        lock_guard<mutex> handlesLock(this->handlesMutex);
+        hook = this->prefetchHook;
+    }
+
+    const uLong windowEnd = file->windowStart + file->window.size();
+    const bool isWorthPrefetching = hook && file->readAhead > DRIVE_FS_MINIMUM_READ_AHEAD
+        && !file->prefetchPending && file->prefetched.empty() && windowEnd < *file->size;
+
+    if (!isWorthPrefetching)
+    {
+        fileLock.unlock();
+        return;
+    }
+
+    const uLong length = file->readAhead;
+    file->prefetchPending = true;
+    fileLock.unlock();
+
+    hook([this, file, windowEnd, length]() {
+        vector<char> window;
+        uLong windowStart = 0;
+
+        // A failed prefetch is not an error yet, the next read simply loads the window itself and reports it.
+        try
+        {
+            this->loadWindow(*file, window, windowStart, windowEnd, length);
+        } catch (std::exception&)
+        {
+            window.clear();
+        }
+
+        lock_guard<mutex> prefetchLock(file->fileMutex);
+        file->prefetched = move(window);
+        file->prefetchedStart = windowStart;
+        file->prefetchPending = false;
+        file->prefetchDone.notify_all();
+    });
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DriveMetadata.h"
+#include "EntryCache.h"
+#include "PathIndex.h"
+#include "SeekIndex.h"
+#include "VDRV.h"
+
+using namespace std;
+
+/**
+ * Smallest read-ahead window of an open file, used again after every non-sequential read.
+ */
+constexpr uLong DRIVE_FS_MINIMUM_READ_AHEAD = 0x10000;
+
+/**
+ * Largest read-ahead window an open file grows to while it is read sequentially.
+ */
+constexpr uLong DRIVE_FS_MAXIMUM_READ_AHEAD = 0x100000;
+
+/**
+ * What stat reports about an entry.
+ */
+struct DriveFileStat {
+    string name;
+    bool isDirectory;
+    uLong size;
+    uint entryOffset;
+};
+
+/**
+ * Runs a prefetch task. Hand it to another thread (e.g. WorkerPool::submit) to have read-ahead happen in the background.
+ */
+using PrefetchHook = function<void(function<void()> task)>;
+
+/**
+ * File system style access to the files of a drive, for tools that want to read assets without unpacking anything to disk.
+ * Paths are drive-relative and resolved like PathIndex does, handles are plain integers like file descriptors.
+ *
+ * All member functions can be called from multiple threads. Accesses to the drive itself are serialized, reads on
+ * different handles otherwise proceed independently, and inflating never happens while holding the drive.
+ * Nothing is read from the drive before a file is actually read: small files are inflated as a whole on their first read,
+ * large ones get a SeekIndex and are read through it in growing windows.
+ * With a cache set, whole files are taken from and kept in it, so reading a hot file again is just a copy.
+ */
+class DriveFileSystem {
+public:
+    DriveFileSystem(VDRV& vdrv, DriveMetadata& metadata);
+    DriveFileSystem(const DriveFileSystem&) = delete;
+    DriveFileSystem& operator=(const DriveFileSystem&) = delete;
+    ~DriveFileSystem();
+    bool exists(const string path);
+    DriveFileStat stat(const string path);
+    vector<string> readdir(const string directoryPath);
+    int open(const string path);
+    uLong read(const int handle, char* destBuf, const uLong length);
+    void seek(const int handle, const uLong position);
+    void close(const int handle);
+    void setPrefetchHook(PrefetchHook hook);
+    void setCache(EntryCache* cache);
+private:
+    struct OpenFile {
+        OpenFile(DriveMetadataEntry entry);
+
+        DriveMetadataEntry entry;
+        optional<uLong> size;
+        uLong position;
+        uLong readAhead;
+        vector<char> window;
+        uLong windowStart;
+        vector<char> prefetched;
+        uLong prefetchedStart;
+        bool prefetchPending;
+        mutex fileMutex;
+        condition_variable prefetchDone;
+    };
+
+    shared_ptr<OpenFile> getOpenFile(const int handle);
+    uLong getFileSize(DriveMetadataEntry entry);
+    shared_ptr<SeekIndex> getSeekIndex(DriveMetadataEntry entry);
+    CachedData inflateWholeFile(DriveMetadataEntry entry);
+    void loadWindow(OpenFile& file, vector<char>& window, uLong& windowStart, const uLong start, const uLong length);
+    void schedulePrefetch(const shared_ptr<OpenFile>& file, unique_lock<mutex>& fileLock);
+
+    VDRV& vdrv;
+    PathIndex index;
+    mutex driveMutex;
+    unordered_map<uint64_t, uLong> fileSizes;
+    unordered_map<uint64_t, shared_ptr<SeekIndex>> seekIndexes;
+
+    mutex handlesMutex;
+    unordered_map<int, shared_ptr<OpenFile>> openFiles;
+    int nextHandle;
+    PrefetchHook prefetchHook;
+    EntryCache* cache;
+};
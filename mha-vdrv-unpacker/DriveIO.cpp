@@ -0,0 +1,230 @@
+#include "DriveIO.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+StreamIO::StreamIO(const char* filePath):
+    in(filePath, std::ios::binary | std::ios::ate), size(0)
+{
+    if (!this->in.is_open())
+    {
+        throw runtime_error("Could not open drive file.");
+    }
+
+    this->size = static_cast<uint>(this->in.tellg());
+    this->in.seekg(0);
+}
+
+#ifdef _WIN32
+
+PReadIO::PReadIO(const char* filePath):
+    handle(INVALID_HANDLE_VALUE), size(0), pos(0)
+{
+    this->handle = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+
+    if (this->handle == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Could not open drive file.");
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(this->handle, &fileSize);
+    this->size = static_cast<uint>(fileSize.QuadPart);
+}
+
+PReadIO::~PReadIO()
+{
+    CloseHandle(this->handle);
+}
+
+/**
+ * Reads a chunk at an absolute position, using the offset fields of an OVERLAPPED structure on a synchronous handle.
+ */
+void PReadIO::readAt(uint from, char* destBuf, size_t length)
+{
+    while (length > 0)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = from;
+
+        DWORD bytesRead = 0;
+        if (!ReadFile(this->handle, destBuf, static_cast<DWORD>(length), &bytesRead, &overlapped) || bytesRead == 0)
+        {
+            throw runtime_error("Could not read from drive file.");
+        }
+
+        from += bytesRead;
+        destBuf += bytesRead;
+        length -= bytesRead;
+    }
+}
+
+MappedIO::MappedIO(const char* filePath):
+    fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr), data(nullptr), size(0), pos(0)
+{
+    this->fileHandle = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (this->fileHandle == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Could not open drive file.");
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(this->fileHandle, &fileSize);
+    this->size = static_cast<uint>(fileSize.QuadPart);
+
+    // Empty files cannot be mapped, but there is nothing to read from them anyway.
+    if (this->size == 0)
+    {
+        return;
+    }
+
+    this->mappingHandle = CreateFileMappingA(this->fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (this->mappingHandle != nullptr)
+    {
+        this->data = static_cast<const char*>(MapViewOfFile(this->mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    }
+
+    if (this->data == nullptr)
+    {
+        if (this->mappingHandle != nullptr)
+        {
+            CloseHandle(this->mappingHandle);
+        }
+
+        CloseHandle(this->fileHandle);
+        throw runtime_error("Could not map drive file.");
+    }
+}
+
+MappedIO::~MappedIO()
+{
+    if (this->data != nullptr)
+    {
+        UnmapViewOfFile(this->data);
+        CloseHandle(this->mappingHandle);
+    }
+
+    CloseHandle(this->fileHandle);
+}
+
+#else
+
+PReadIO::PReadIO(const char* filePath):
+    fd(-1), size(0), pos(0)
+{
+    this->fd = open(filePath, O_RDONLY);
+
+    if (this->fd < 0)
+    {
+        throw runtime_error("Could not open drive file.");
+    }
+
+    struct stat fileStat;
+    fstat(this->fd, &fileStat);
+    this->size = static_cast<uint>(fileStat.st_size);
+
+    // The reader jumps around between the payloads and the metadata a lot, read ahead is of no use.
+    posix_fadvise(this->fd, 0, 0, POSIX_FADV_RANDOM);
+}
+
+PReadIO::~PReadIO()
+{
+    close(this->fd);
+}
+
+/**
+ * Reads a chunk at an absolute position, retrying on short reads.
+ */
+void PReadIO::readAt(uint from, char* destBuf, size_t length)
+{
+    while (length > 0)
+    {
+        const ssize_t bytesRead = pread(this->fd, destBuf, length, from);
+
+        if (bytesRead <= 0)
+        {
+            throw runtime_error("Could not read from drive file.");
+        }
+
+        from += static_cast<uint>(bytesRead);
+        destBuf += bytesRead;
+        length -= bytesRead;
+    }
+}
+
+MappedIO::MappedIO(const char* filePath):
+    data(nullptr), size(0), pos(0)
+{
+    const int fd = open(filePath, O_RDONLY);
+
+    if (fd < 0)
+    {
+        throw runtime_error("Could not open drive file.");
+    }
+
+    struct stat fileStat;
+    fstat(fd, &fileStat);
+    this->size = static_cast<uint>(fileStat.st_size);
+
+    // Empty files cannot be mapped, but there is nothing to read from them anyway.
+    if (this->size > 0)
+    {
+        void* mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw runtime_error("Could not map drive file.");
+        }
+
+        this->data = static_cast<const char*>(mapping);
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+}
+
+MappedIO::~MappedIO()
+{
+    if (this->data != nullptr)
+    {
+        munmap(const_cast<char*>(this->data), this->size);
+    }
+}
+
+#endif
+
+MemoryIO::MemoryIO(const char* filePath):
+    buffer(), pos(0)
+{
+    std::ifstream in(filePath, std::ios::binary | std::ios::ate);
+
+    if (!in.is_open())
+    {
+        throw runtime_error("Could not open drive file.");
+    }
+
+    this->buffer.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(this->buffer.data(), this->buffer.size()))
+    {
+        throw runtime_error("Could not read from drive file.");
+    }
+}
+
+MemoryIO::MemoryIO(vector<char> buffer):
+    buffer(move(buffer)), pos(0)
+{}
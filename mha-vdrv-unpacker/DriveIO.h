@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using uint = uint32_t;
+using namespace std;
+
+/**
+ * I/O policies the VDRV reader can be instantiated with.
+ *
+ * All of them expose the same small, non-virtual interface:
+ * - getSize(): total size of the drive in bytes.
+ * - tell():    current cursor position.
+ * - seek(pos): moves the cursor to an absolute position.
+ * - read(dst, length): copies length bytes from the cursor into dst and advances the cursor.
+ *
+ * Bounds checks are done by the VDRV itself. The policies reading from memory check again, as a bad range
+ * there would read past the mapping or buffer instead of just failing.
+ * The hot functions are defined here in the header so they can be inlined into the reader for every backend.
+ */
+
+/**
+ * Reads the drive through a buffered std::ifstream. This is what the unpacker originally used.
+ */
+class StreamIO {
+public:
+    StreamIO(const char* filePath);
+    uint getSize() { return this->size; }
+    uint tell() { return static_cast<uint>(this->in.tellg()); }
+    void seek(const uint pos) { this->in.seekg(pos); }
+    void read(char* destBuf, size_t length) { this->in.read(destBuf, length); }
+private:
+    std::ifstream in;
+    uint size;
+};
+
+/**
+ * Reads the drive with positional reads (pread / ReadFile with an offset), without any user space buffering.
+ */
+class PReadIO {
+public:
+    PReadIO(const char* filePath);
+    PReadIO(const PReadIO&) = delete;
+    PReadIO& operator=(const PReadIO&) = delete;
+    ~PReadIO();
+    uint getSize() { return this->size; }
+    uint tell() { return this->pos; }
+    void seek(const uint pos) { this->pos = pos; }
+    void read(char* destBuf, size_t length) { this->readAt(this->pos, destBuf, length); this->pos += static_cast<uint>(length); }
+private:
+    void readAt(uint from, char* destBuf, size_t length);
+
+#ifdef _WIN32
+    void* handle;
+#else
+    int fd;
+#endif
+    uint size;
+    uint pos;
+};
+
+/**
+ * Maps the whole drive into memory and serves reads straight from the mapping.
+ */
+class MappedIO {
+public:
+    MappedIO(const char* filePath);
+    MappedIO(const MappedIO&) = delete;
+    MappedIO& operator=(const MappedIO&) = delete;
+    ~MappedIO();
+    uint getSize() { return this->size; }
+    uint tell() { return this->pos; }
+    void seek(const uint pos) { this->pos = pos; }
+    void read(char* destBuf, size_t length)
+    {
+        if (length > this->size || this->pos > this->size - length)
+        {
+            throw out_of_range("Tried to read beyond the mapped drive.");
+        }
+
+        memcpy(destBuf, this->data + this->pos, length);
+        this->pos += static_cast<uint>(length);
+    }
+private:
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+    const char* data;
+    uint size;
+    uint pos;
+};
+
+/**
+ * Keeps the entire drive in a heap buffer. Either loads the file in one go, or wraps a buffer the caller already has.
+ */
+class MemoryIO {
+public:
+    MemoryIO(const char* filePath);
+    MemoryIO(vector<char> buffer);
+    uint getSize() { return static_cast<uint>(this->buffer.size()); }
+    uint tell() { return this->pos; }
+    void seek(const uint pos) { this->pos = pos; }
+    void read(char* destBuf, size_t length)
+    {
+        if (length > this->buffer.size() || this->pos > this->buffer.size() - length)
+        {
+            throw out_of_range("Tried to read beyond the drive buffer.");
+        }
+
+        memcpy(destBuf, this->buffer.data() + this->pos, length);
+        this->pos += static_cast<uint>(length);
+    }
+private:
+    vector<char> buffer;
+    uint pos;
+};
@@ -58,3 +58,12 @@ bool DriveMetadataEntry::isDirectory()
 {
     return this->entryType == DriveMetadataEntryType::DIRECTORY;
 }
+
+/**
+ * Gets a key identifying the payload of a file by its location and size. Entries with the same key share the exact same data,
+ * entries that only start at the same offset don't.
+ */
+uint64_t DriveMetadataEntry::getPayloadKey()
+{
+    return (static_cast<uint64_t>(this->fileStart) << 32) | this->fileSize;
+}
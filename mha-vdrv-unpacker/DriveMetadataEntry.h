@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 using namespace std;
@@ -20,6 +21,7 @@ public:
     uint getEntryOffset();
     DriveMetadataEntryType getEntryType();
     bool isDirectory();
+    uint64_t getPayloadKey();
 private:
     const string fileName;
     const uint entryOffset;
@@ -0,0 +1,239 @@
+#include "DriveOverlay.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "PathIndex.h"
+
+using namespace std;
+
+/**
+ * Gets the parent of a normalized path, "" for entries at the root.
+ */
+static string getParentPath(const string& normalizedPath)
+{
+    const size_t separator = normalizedPath.rfind('/');
+    return separator == string::npos ? "" : normalizedPath.substr(0, separator);
+}
+
+DriveOverlay::DriveOverlay():
+    drives(), metadata(), drivePaths(), mergedEntries(), nextSequence(0), entries(), positionsByPath(), childPositionsByPath()
+{}
+
+/**
+ * Puts a drive on top of the ones added so far and merges its entries into the effective tree.
+ * The metadata is kept along with the drive.
+ */
+void DriveOverlay::addDrive(const string drivePath, unique_ptr<VDRV> vdrv, DriveMetadata metadata)
+{
+    const int driveIndex = static_cast<int>(this->drives.size());
+    PathIndex pathIndex(metadata);
+    vector<pair<string, OverlayEntry>> driveEntries;
+
+    // Whiteouts only ever hide entries of earlier drives, so they are applied before anything of this drive is merged.
+    for (int pos = 0; pos < metadata.getSize(); pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        const string fullPath = pathIndex.getFullPath(entry);
+        const string normalizedPath = PathIndex::normalize(fullPath);
+        const string parentPath = getParentPath(normalizedPath);
+        const string name = normalizedPath.substr(parentPath.empty() ? 0 : parentPath.size() + 1);
+
+        if (name == OVERLAY_OPAQUE_MARKER)
+        {
+            this->removeBelow(parentPath, false);
+        } else if (name.rfind(OVERLAY_WHITEOUT_PREFIX, 0) == 0)
+        {
+            const string hiddenName = name.substr(OVERLAY_WHITEOUT_PREFIX.size());
+            this->removeBelow(parentPath.empty() ? hiddenName : parentPath + "/" + hiddenName, true);
+        } else
+        {
+            driveEntries.emplace_back(normalizedPath, OverlayEntry { driveIndex, entry, fullPath });
+        }
+    }
+
+    for (auto& driveEntry : driveEntries)
+    {
+        uint64_t sequence = this->nextSequence++;
+        auto existingEntry = this->mergedEntries.find(driveEntry.first);
+
+        // Replaced entries keep their place in listings. Directories merge with earlier ones of the same path,
+        // but a file replacing a directory takes everything below it along.
+        if (existingEntry != this->mergedEntries.end())
+        {
+            sequence = existingEntry->second.first;
+
+            if (existingEntry->second.second.entry.isDirectory() && !driveEntry.second.entry.isDirectory())
+            {
+                this->removeBelow(driveEntry.first, false);
+            }
+
+            this->mergedEntries.erase(driveEntry.first);
+        }
+
+        this->mergedEntries.emplace(driveEntry.first, make_pair(sequence, driveEntry.second));
+    }
+
+    this->drives.push_back(move(vdrv));
+    this->metadata.push_back(make_unique<DriveMetadata>(move(metadata)));
+    this->drivePaths.push_back(drivePath);
+
+    this->rebuildLookup();
+}
+
+/**
+ * Gets the amount of stacked drives.
+ */
+int DriveOverlay::getDriveCount()
+{
+    return static_cast<int>(this->drives.size());
+}
+
+/**
+ * Gets one of the stacked drives, in the order they were added.
+ */
+VDRV& DriveOverlay::getDrive(const int driveIndex)
+{
+    return *this->drives.at(driveIndex);
+}
+
+/**
+ * Gets the metadata of one of the stacked drives, with all of its entries (including those hidden by later drives).
+ */
+DriveMetadata& DriveOverlay::getMetadata(const int driveIndex)
+{
+    return *this->metadata.at(driveIndex);
+}
+
+/**
+ * Gets the file path one of the stacked drives was opened from.
+ */
+string DriveOverlay::getDrivePath(const int driveIndex)
+{
+    return this->drivePaths.at(driveIndex);
+}
+
+/**
+ * Gets the amount of entries in the effective tree.
+ */
+int DriveOverlay::getSize()
+{
+    return static_cast<int>(this->entries.size());
+}
+
+/**
+ * Gets whether the effective tree has an entry with the given path.
+ */
+bool DriveOverlay::contains(const string path)
+{
+    return this->positionsByPath.find(PathIndex::normalize(path)) != this->positionsByPath.end();
+}
+
+/**
+ * Resolves a path to the entry of the topmost drive that has it, regardless of case and separator style.
+ */
+OverlayEntry DriveOverlay::open(const string path)
+{
+    auto pos = this->positionsByPath.find(PathIndex::normalize(path));
+
+    if (pos == this->positionsByPath.end())
+    {
+        throw out_of_range("Path not found in drive: " + path);
+    }
+
+    return this->entries[pos->second];
+}
+
+/**
+ * Lists the merged contents of a directory, the root being "".
+ */
+vector<OverlayEntry> DriveOverlay::list(const string directoryPath)
+{
+    const string normalizedPath = PathIndex::normalize(directoryPath);
+
+    if (!normalizedPath.empty() && !this->open(directoryPath).entry.isDirectory())
+    {
+        throw invalid_argument("Path is not a directory: " + directoryPath);
+    }
+
+    vector<OverlayEntry> childEntries;
+    auto childPositions = this->childPositionsByPath.find(normalizedPath);
+
+    if (childPositions != this->childPositionsByPath.end())
+    {
+        for (const size_t pos : childPositions->second)
+        {
+            childEntries.push_back(this->entries[pos]);
+        }
+    }
+
+    return childEntries;
+}
+
+/**
+ * Reads the compressed data of a file from the drive it comes from.
+ */
+unique_ptr<char[]> DriveOverlay::readCompressedFile(const OverlayEntry& overlayEntry)
+{
+    return this->drives.at(overlayEntry.driveIndex)->readCompressedFile(overlayEntry.entry);
+}
+
+/**
+ * Reads the checksum of the uncompressed data of a file from the drive it comes from.
+ */
+uint DriveOverlay::readChecksum(const OverlayEntry& overlayEntry)
+{
+    return this->drives.at(overlayEntry.driveIndex)->readChecksum(overlayEntry.entry);
+}
+
+/**
+ * Drops everything below a path from the merged tree, and optionally the entry at the path itself.
+ */
+void DriveOverlay::removeBelow(const string& normalizedPath, const bool removeSelf)
+{
+    if (removeSelf)
+    {
+        this->mergedEntries.erase(normalizedPath);
+    }
+
+    // All paths below sort right after the path itself followed by the separator.
+    const string prefix = normalizedPath.empty() ? "" : normalizedPath + "/";
+    auto entry = this->mergedEntries.lower_bound(prefix);
+
+    while (entry != this->mergedEntries.end() && entry->first.compare(0, prefix.size(), prefix) == 0)
+    {
+        entry = this->mergedEntries.erase(entry);
+    }
+}
+
+/**
+ * Flattens the merged tree into the hash lookups, with children grouped per directory in sequence order.
+ */
+void DriveOverlay::rebuildLookup()
+{
+    vector<const pair<const string, pair<uint64_t, OverlayEntry>>*> orderedEntries;
+    orderedEntries.reserve(this->mergedEntries.size());
+
+    for (auto& mergedEntry : this->mergedEntries)
+    {
+        orderedEntries.push_back(&mergedEntry);
+    }
+
+    sort(orderedEntries.begin(), orderedEntries.end(), [](auto* left, auto* right) {
+        return left->second.first < right->second.first;
+    });
+
+    this->entries.clear();
+    this->positionsByPath.clear();
+    this->childPositionsByPath.clear();
+    this->entries.reserve(orderedEntries.size());
+    this->positionsByPath.reserve(orderedEntries.size());
+
+    for (auto* mergedEntry : orderedEntries)
+    {
+        const size_t pos = this->entries.size();
+        this->entries.push_back(mergedEntry->second.second);
+        this->positionsByPath[mergedEntry->first] = pos;
+        this->childPositionsByPath[getParentPath(mergedEntry->first)].push_back(pos);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DriveMetadata.h"
+#include "VDRV.h"
+
+using namespace std;
+
+/**
+ * Name prefix of a whiteout entry: ".wh.NAME" in a later drive hides NAME (and everything below it) of earlier drives.
+ */
+const string OVERLAY_WHITEOUT_PREFIX = ".wh.";
+
+/**
+ * Name of an opaque marker: a directory containing it hides everything earlier drives have in that directory.
+ */
+const string OVERLAY_OPAQUE_MARKER = ".wh..wh..opq";
+
+/**
+ * An entry of the merged tree, along with the drive it comes from.
+ */
+struct OverlayEntry {
+    int driveIndex;
+    DriveMetadataEntry entry;
+    string fullPath;
+};
+
+/**
+ * Several drives stacked on top of each other, like a base game drive followed by its patches.
+ * Entries of later drives replace those of earlier drives with the same path, directories are merged,
+ * and whiteouts (see OVERLAY_WHITEOUT_PREFIX, OVERLAY_OPAQUE_MARKER) remove entries of earlier drives.
+ *
+ * The effective tree is merged as drives are added, so looking up a path is a single hash probe however many drives there are.
+ * A single drive works just the same, with its entries listed in metadata order.
+ */
+class DriveOverlay {
+public:
+    DriveOverlay();
+    DriveOverlay(const DriveOverlay&) = delete;
+    DriveOverlay& operator=(const DriveOverlay&) = delete;
+    void addDrive(const string drivePath, unique_ptr<VDRV> vdrv, DriveMetadata metadata);
+    int getDriveCount();
+    VDRV& getDrive(const int driveIndex);
+    DriveMetadata& getMetadata(const int driveIndex);
+    string getDrivePath(const int driveIndex);
+    int getSize();
+    bool contains(const string path);
+    OverlayEntry open(const string path);
+    vector<OverlayEntry> list(const string directoryPath);
+    unique_ptr<char[]> readCompressedFile(const OverlayEntry& overlayEntry);
+    uint readChecksum(const OverlayEntry& overlayEntry);
+private:
+    void removeBelow(const string& normalizedPath, const bool removeSelf);
+    void rebuildLookup();
+
+    vector<unique_ptr<VDRV>> drives;
+    vector<unique_ptr<DriveMetadata>> metadata;
+    vector<string> drivePaths;
+
+    // The merged tree, ordered by normalized path so whole sub-trees can be dropped in one go.
+    // The sequence number keeps listings in drive and metadata order.
+    map<string, pair<uint64_t, OverlayEntry>> mergedEntries;
+    uint64_t nextSequence;
+
+    // Flat lookup structures rebuilt from the merged tree after every drive.
+    vector<OverlayEntry> entries;
+    unordered_map<string, size_t> positionsByPath;
+    unordered_map<string, vector<size_t>> childPositionsByPath;
+};
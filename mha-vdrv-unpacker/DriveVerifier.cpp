@@ -0,0 +1,231 @@
+#include "DriveVerifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "CompressedPayload.h"
+#include "PathIndex.h"
+
+using namespace std;
+
+/**
+ * Formats an offset within the drive the way hex editors show it.
+ */
+static string toHexOffset(const uint64_t offset)
+{
+    ostringstream hex;
+    hex << "0x" << std::hex << setw(8) << setfill('0') << offset;
+    return hex.str();
+}
+
+/**
+ * Formats a throughput in MB/s.
+ */
+static string toThroughput(const uint64_t bytes, const double seconds)
+{
+    ostringstream throughput;
+    throughput << fixed << setprecision(1) << (seconds > 0 ? bytes / seconds / 1e6 : 0.0) << " MB/s";
+    return throughput.str();
+}
+
+DriveVerifier::DriveVerifier(WorkerPool& workers):
+    workers(workers), driveMutex(), resultsMutex(), issues(), compressedBytes(0), uncompressedBytes(0)
+{}
+
+/**
+ * Verifies a single drive and prints a report. Returns whether the drive is free of problems.
+ */
+bool DriveVerifier::verify(const string drivePath)
+{
+    this->issues.clear();
+    this->compressedBytes = 0;
+    this->uncompressedBytes = 0;
+
+    cout << "Verifying " << drivePath << "..." << endl;
+
+    unique_ptr<VDRV> vdrv;
+    DriveMetadata metadata;
+    const auto metadataStart = chrono::steady_clock::now();
+
+    try
+    {
+        vdrv = make_unique<VDRV>(drivePath.c_str());
+        metadata = vdrv->readMetadata();
+    } catch (std::exception& e)
+    {
+        cout << "=> Metadata can't be read: " << e.what() << endl;
+        return false;
+    }
+
+    const double metadataSeconds = chrono::duration<double>(chrono::steady_clock::now() - metadataStart).count();
+    cout << "=> Decrypted " << metadata.getSize() << " metadata entries in " << fixed << setprecision(3) << metadataSeconds << " s." << endl;
+
+    vector<string> paths;
+    vector<bool> isReadable;
+    this->checkMetadata(*vdrv, metadata, paths, isReadable);
+
+    // Everything that can be read at all is inflated, including files that aren't reachable from the root.
+    const auto inflateStart = chrono::steady_clock::now();
+    int fileCount = 0;
+
+    for (int pos = 0; pos < metadata.getSize(); pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+
+        if (entry.isDirectory() || !isReadable[pos])
+        {
+            continue;
+        }
+
+        VDRV* vdrvPointer = vdrv.get();
+        const string* pathPointer = &paths[pos];
+        this->workers.submit([this, vdrvPointer, entry, pathPointer]() {
+            this->inflateFile(*vdrvPointer, entry, *pathPointer);
+        });
+
+        fileCount++;
+    }
+
+    this->workers.wait();
+
+    const double inflateSeconds = chrono::duration<double>(chrono::steady_clock::now() - inflateStart).count();
+    cout << "=> Inflated " << fileCount << " files on " << this->workers.getThreadCount() << " threads in " << fixed << setprecision(3) << inflateSeconds << " s: ";
+    cout << this->compressedBytes << " B compressed (" << toThroughput(this->compressedBytes, inflateSeconds) << "), ";
+    cout << this->uncompressedBytes << " B uncompressed (" << toThroughput(this->uncompressedBytes, inflateSeconds) << ")." << endl;
+
+    sort(this->issues.begin(), this->issues.end(), [](VerifyIssue& left, VerifyIssue& right) {
+        return left.entryOffset < right.entryOffset;
+    });
+
+    for (VerifyIssue& issue : this->issues)
+    {
+        cout << "* " << issue.path << " (entry at " << toHexOffset(issue.entryOffset);
+
+        if (!issue.isDirectory)
+        {
+            cout << ", data at " << toHexOffset(issue.fileStart) << " + " << issue.fileSize << " B";
+        }
+
+        cout << "): " << issue.problem << endl;
+    }
+
+    cout << (this->issues.empty() ? "=> OK." : "=> " + to_string(this->issues.size()) + " problem(s) found.") << endl;
+    return this->issues.empty();
+}
+
+/**
+ * Checks every entry against the rest of the drive: parents have to exist and be directories without looping back,
+ * the data of files has to lie within the drive, and no two entries may have the same path.
+ * Fills in the path of every entry (as far as it can be resolved), and whether its data can be read at all.
+ */
+void DriveVerifier::checkMetadata(VDRV& vdrv, DriveMetadata& metadata, vector<string>& paths, vector<bool>& isReadable)
+{
+    const int entryCount = metadata.getSize();
+    const uint64_t driveSize = vdrv.getFileSize();
+    unordered_map<uint, int> positionsByOffset;
+
+    for (int pos = 0; pos < entryCount; pos++)
+    {
+        positionsByOffset[metadata.getEntryAt(pos).getEntryOffset()] = pos;
+    }
+
+    paths.assign(entryCount, "");
+    isReadable.assign(entryCount, true);
+    unordered_set<string> normalizedPaths;
+
+    for (int pos = 0; pos < entryCount; pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        string path = entry.getFileName();
+        string parentProblem;
+        uint parentOffset = entry.getParentOffset();
+
+        // Walks up to the root. A chain longer than the amount of entries can only be a loop.
+        for (int depth = 0; parentOffset != 0 && parentProblem.empty(); depth++)
+        {
+            auto parentPos = positionsByOffset.find(parentOffset);
+
+            if (parentPos == positionsByOffset.end())
+            {
+                parentProblem = "parent entry " + toHexOffset(parentOffset) + " does not exist";
+            } else if (!metadata.getEntryAt(parentPos->second).isDirectory())
+            {
+                parentProblem = "parent entry " + toHexOffset(parentOffset) + " is not a directory";
+            } else if (depth > entryCount)
+            {
+                parentProblem = "parent entries form a loop";
+            } else
+            {
+                DriveMetadataEntry parentEntry = metadata.getEntryAt(parentPos->second);
+                path = parentEntry.getFileName() + "/" + path;
+                parentOffset = parentEntry.getParentOffset();
+            }
+        }
+
+        paths[pos] = path;
+
+        if (!parentProblem.empty())
+        {
+            this->addIssue(entry, path, parentProblem);
+        } else if (!normalizedPaths.insert(PathIndex::normalize(path)).second)
+        {
+            this->addIssue(entry, path, "another entry has the same path");
+        }
+
+        if (!entry.isDirectory() && static_cast<uint64_t>(entry.getFileStart()) + entry.getFileSize() > driveSize)
+        {
+            this->addIssue(entry, path, "data ends beyond the end of the drive (" + to_string(driveSize) + " B)");
+            isReadable[pos] = false;
+        }
+    }
+}
+
+/**
+ * Reads and inflates the data of a file, throwing the result away. zlib checks the Adler-32 checksum at the end of the stream.
+ */
+void DriveVerifier::inflateFile(VDRV& vdrv, DriveMetadataEntry entry, const string& path)
+{
+    try
+    {
+        unique_ptr<char[]> compressedData;
+
+        {
+            lock_guard<mutex> driveLock(this->driveMutex);
+            compressedData = vdrv.readCompressedFile(entry);
+        }
+
+        CompressedPayload payload(move(compressedData), entry.getFileSize());
+        uint64_t inflatedLength = 0;
+
+        const int decompressionResult = payload.inflateChunks([&inflatedLength](const unsigned char*, size_t chunkLength) {
+            inflatedLength += chunkLength;
+        });
+
+        if (decompressionResult != Z_OK)
+        {
+            this->addIssue(entry, path, string("data does not inflate (") + zError(decompressionResult) + ")");
+            return;
+        }
+
+        lock_guard<mutex> resultsLock(this->resultsMutex);
+        this->compressedBytes += entry.getFileSize();
+        this->uncompressedBytes += inflatedLength;
+    } catch (std::exception& e)
+    {
+        this->addIssue(entry, path, e.what());
+    }
+}
+
+/**
+ * Records a problem with an entry, from any thread.
+ */
+void DriveVerifier::addIssue(DriveMetadataEntry entry, const string& path, const string& problem)
+{
+    lock_guard<mutex> resultsLock(this->resultsMutex);
+    this->issues.push_back({ entry.getEntryOffset(), entry.isDirectory(), entry.getFileStart(), entry.getFileSize(), path, problem });
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DriveMetadata.h"
+#include "VDRV.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+/**
+ * Something wrong with an entry of a drive.
+ */
+struct VerifyIssue {
+    uint entryOffset;
+    bool isDirectory;
+    uint fileStart;
+    uint fileSize;
+    string path;
+    string problem;
+};
+
+/**
+ * Checks that a drive is healthy without writing anything: the metadata has to decrypt and parse, every entry has to be
+ * consistent with the rest of the drive, and the data of every file has to inflate with a valid Adler-32 checksum.
+ *
+ * Files are read and inflated on a pool of workers, with the inflated data thrown away, so the time it takes
+ * is the raw decode throughput of the machine.
+ */
+class DriveVerifier {
+public:
+    DriveVerifier(WorkerPool& workers);
+    DriveVerifier(const DriveVerifier&) = delete;
+    DriveVerifier& operator=(const DriveVerifier&) = delete;
+    bool verify(const string drivePath);
+private:
+    void checkMetadata(VDRV& vdrv, DriveMetadata& metadata, vector<string>& paths, vector<bool>& isReadable);
+    void inflateFile(VDRV& vdrv, DriveMetadataEntry entry, const string& path);
+    void addIssue(DriveMetadataEntry entry, const string& path, const string& problem);
+
+    WorkerPool& workers;
+    mutex driveMutex;
+    mutex resultsMutex;
+    vector<VerifyIssue> issues;
+    uint64_t compressedBytes;
+    uint64_t uncompressedBytes;
+};
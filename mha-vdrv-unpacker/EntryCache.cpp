@@ -0,0 +1,135 @@
+#include "EntryCache.h"
+
+using namespace std;
+
+EntryCache::EntryCache(const size_t byteBudget, const size_t compressedByteBudget):
+    shards(ENTRY_CACHE_SHARD_COUNT), shardBudget(byteBudget / ENTRY_CACHE_SHARD_COUNT),
+    compressedShardBudget(compressedByteBudget / ENTRY_CACHE_SHARD_COUNT),
+    hits(0), misses(0), compressedHits(0), compressedMisses(0), evictions(0)
+{}
+
+/**
+ * Gets the inflated data of a file, or null if it is not cached.
+ */
+CachedData EntryCache::get(const uint64_t payloadKey)
+{
+    Shard& shard = this->getShard(payloadKey);
+    CachedData data = this->find(shard.inflated, shard, payloadKey);
+
+    (data ? this->hits : this->misses)++;
+
+    return data;
+}
+
+/**
+ * Caches the inflated data of a file, evicting the least recently used files of its shard as needed.
+ */
+void EntryCache::put(const uint64_t payloadKey, CachedData data)
+{
+    Shard& shard = this->getShard(payloadKey);
+    this->insert(shard.inflated, shard, this->shardBudget, payloadKey, data);
+}
+
+/**
+ * Gets the compressed payload of a file, or null if it is not cached.
+ */
+CachedData EntryCache::getCompressed(const uint64_t payloadKey)
+{
+    if (this->compressedShardBudget == 0)
+    {
+        return nullptr;
+    }
+
+    Shard& shard = this->getShard(payloadKey);
+    CachedData data = this->find(shard.compressed, shard, payloadKey);
+
+    (data ? this->compressedHits : this->compressedMisses)++;
+
+    return data;
+}
+
+/**
+ * Caches the compressed payload of a file. Does nothing if the cache was created without a compressed tier.
+ */
+void EntryCache::putCompressed(const uint64_t payloadKey, CachedData data)
+{
+    Shard& shard = this->getShard(payloadKey);
+    this->insert(shard.compressed, shard, this->compressedShardBudget, payloadKey, data);
+}
+
+/**
+ * Gets the counters and the amount of cached bytes in both tiers.
+ */
+EntryCacheStats EntryCache::getStats()
+{
+    EntryCacheStats stats = { this->hits, this->misses, this->compressedHits, this->compressedMisses, this->evictions, 0, 0 };
+
+    for (Shard& shard : this->shards)
+    {
+        lock_guard<mutex> shardLock(shard.shardMutex);
+        stats.bytes += shard.inflated.bytes;
+        stats.compressedBytes += shard.compressed.bytes;
+    }
+
+    return stats;
+}
+
+/**
+ * Payloads are laid out back to back, so the low bits of their offsets are spread evenly enough after a multiplicative hash.
+ */
+EntryCache::Shard& EntryCache::getShard(const uint64_t payloadKey)
+{
+    const uint fileStart = static_cast<uint>(payloadKey >> 32);
+    return this->shards[(fileStart * 0x9E3779B1u >> 16) % ENTRY_CACHE_SHARD_COUNT];
+}
+
+/**
+ * Looks up a file in one tier and marks it as most recently used.
+ */
+CachedData EntryCache::find(Tier& tier, Shard& shard, const uint64_t payloadKey)
+{
+    lock_guard<mutex> shardLock(shard.shardMutex);
+    auto position = tier.positions.find(payloadKey);
+
+    if (position == tier.positions.end())
+    {
+        return nullptr;
+    }
+
+    tier.recentlyUsed.splice(tier.recentlyUsed.begin(), tier.recentlyUsed, position->second);
+
+    return position->second->second;
+}
+
+/**
+ * Adds or replaces a file in one tier, then evicts from the least recently used end until the tier fits its budget again.
+ */
+void EntryCache::insert(Tier& tier, Shard& shard, const size_t shardBudget, const uint64_t payloadKey, CachedData data)
+{
+    if (!data || data->size() > shardBudget)
+    {
+        return;
+    }
+
+    lock_guard<mutex> shardLock(shard.shardMutex);
+    auto position = tier.positions.find(payloadKey);
+
+    if (position != tier.positions.end())
+    {
+        tier.bytes -= position->second->second->size();
+        tier.recentlyUsed.erase(position->second);
+    }
+
+    tier.recentlyUsed.emplace_front(payloadKey, data);
+    tier.positions[payloadKey] = tier.recentlyUsed.begin();
+    tier.bytes += data->size();
+
+    while (tier.bytes > shardBudget)
+    {
+        auto& leastRecentlyUsed = tier.recentlyUsed.back();
+        tier.bytes -= leastRecentlyUsed.second->size();
+        tier.positions.erase(leastRecentlyUsed.first);
+        tier.recentlyUsed.pop_back();
+        this->evictions++;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using uint = uint32_t;
+using namespace std;
+
+/**
+ * Amount of independently locked shards the cache is split into.
+ */
+constexpr unsigned int ENTRY_CACHE_SHARD_COUNT = 16;
+
+/**
+ * Counters of a cache, as a snapshot.
+ */
+struct EntryCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t compressedHits;
+    uint64_t compressedMisses;
+    uint64_t evictions;
+    size_t bytes;
+    size_t compressedBytes;
+};
+
+/**
+ * Data shared out of the cache. Stays valid for its holders even after it was evicted.
+ */
+using CachedData = shared_ptr<const vector<char>>;
+
+/**
+ * LRU cache for the data of drive files, keyed by the location and size of their payload (DriveMetadataEntry::getPayloadKey),
+ * so aliased entries share a slot.
+ * Holds inflated data within a byte budget and optionally the compressed payloads within a second budget, so
+ * files pushed out of the first tier can still be inflated without touching the drive.
+ *
+ * Keys are spread over ENTRY_CACHE_SHARD_COUNT shards, each with its own lock and an equal part of the budgets.
+ * Data larger than a shard's budget is never cached.
+ */
+class EntryCache {
+public:
+    EntryCache(const size_t byteBudget, const size_t compressedByteBudget = 0);
+    EntryCache(const EntryCache&) = delete;
+    EntryCache& operator=(const EntryCache&) = delete;
+    CachedData get(const uint64_t payloadKey);
+    void put(const uint64_t payloadKey, CachedData data);
+    CachedData getCompressed(const uint64_t payloadKey);
+    void putCompressed(const uint64_t payloadKey, CachedData data);
+    EntryCacheStats getStats();
+private:
+    struct Tier {
+        list<pair<uint64_t, CachedData>> recentlyUsed;
+        unordered_map<uint64_t, list<pair<uint64_t, CachedData>>::iterator> positions;
+        size_t bytes = 0;
+    };
+
+    struct Shard {
+        mutex shardMutex;
+        Tier inflated;
+        Tier compressed;
+    };
+
+    Shard& getShard(const uint64_t payloadKey);
+    CachedData find(Tier& tier, Shard& shard, const uint64_t payloadKey);
+    void insert(Tier& tier, Shard& shard, const size_t shardBudget, const uint64_t payloadKey, CachedData data);
+
+    vector<Shard> shards;
+    const size_t shardBudget;
+    const size_t compressedShardBudget;
+
+    atomic<uint64_t> hits;
+    atomic<uint64_t> misses;
+    atomic<uint64_t> compressedHits;
+    atomic<uint64_t> compressedMisses;
+    atomic<uint64_t> evictions;
+};
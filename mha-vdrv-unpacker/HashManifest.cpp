@@ -0,0 +1,195 @@
+#include "HashManifest.h"
+
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+FileHasher::FileHasher(const string algorithm):
+    useSha256(algorithm == "sha256"), sha256(), xxh64(), length(0)
+{}
+
+/**
+ * Hashes the next piece of the file.
+ */
+void FileHasher::update(const unsigned char* data, size_t length)
+{
+    if (this->useSha256)
+    {
+        this->sha256.update(data, length);
+    } else
+    {
+        this->xxh64.update(data, length);
+    }
+
+    this->length += length;
+}
+
+/**
+ * Gets the amount of bytes hashed so far.
+ */
+uint64_t FileHasher::getLength()
+{
+    return this->length;
+}
+
+/**
+ * Gets the hash of everything hashed so far, as lowercase hex digits.
+ */
+string FileHasher::digestHex()
+{
+    return this->useSha256 ? this->sha256.digestHex() : Xxh64::toHex(this->xxh64.digest());
+}
+
+/**
+ * algorithm: "sha256" or "xxh64".
+ * threadCount: Amount of workers hashing files.
+ */
+HashManifest::HashManifest(const string algorithm, const unsigned int threadCount):
+    algorithm(algorithm), workers(threadCount), hashesMutex(), pendingBytesFreed(), pendingBytes(0), hashesByPath(), aliases(), failedPaths()
+{
+    if (!isSupportedAlgorithm(algorithm))
+    {
+        throw invalid_argument("Unsupported hash algorithm: " + algorithm);
+    }
+}
+
+/**
+ * Creates a hasher for a file that is hashed by the caller, see addHash.
+ */
+FileHasher HashManifest::createHasher()
+{
+    return FileHasher(this->algorithm);
+}
+
+/**
+ * Adds a file hashed by the caller.
+ */
+void HashManifest::addHash(const string filePath, const string hash)
+{
+    lock_guard<mutex> hashesLock(this->hashesMutex);
+    this->hashesByPath[filePath] = hash;
+}
+
+/**
+ * Queues a file to be hashed. Waits first if too much data is waiting for the workers already.
+ */
+void HashManifest::addFile(const string filePath, shared_ptr<CompressedPayload> payload)
+{
+    const uint64_t payloadSize = payload->getSize();
+
+    {
+        unique_lock<mutex> hashesLock(this->hashesMutex);
+        this->pendingBytesFreed.wait(hashesLock, [this]() { return this->pendingBytes < HASH_MANIFEST_MAXIMUM_PENDING; });
+        this->pendingBytes += payloadSize;
+    }
+
+    this->workers.submit([this, filePath, payload, payloadSize]() {
+        string hash;
+
+        try
+        {
+            hash = this->hashPayload(*payload);
+        } catch (std::exception&)
+        {
+            hash.clear();
+        }
+
+        {
+            lock_guard<mutex> hashesLock(this->hashesMutex);
+
+            if (hash.empty())
+            {
+                this->failedPaths.push_back(filePath);
+            } else
+            {
+                this->hashesByPath[filePath] = hash;
+            }
+
+            this->pendingBytes -= payloadSize;
+        }
+
+        this->pendingBytesFreed.notify_one();
+    });
+}
+
+/**
+ * Notes a file that is part of the output, but whose data could not be read for hashing. It is left out of the manifest.
+ */
+void HashManifest::addFailedFile(const string filePath)
+{
+    lock_guard<mutex> hashesLock(this->hashesMutex);
+    this->failedPaths.push_back(filePath);
+}
+
+/**
+ * Adds a file with the same data as one added before, without hashing it again.
+ */
+void HashManifest::addAlias(const string filePath, const string targetPath)
+{
+    lock_guard<mutex> hashesLock(this->hashesMutex);
+    this->aliases.emplace_back(filePath, targetPath);
+}
+
+/**
+ * Waits for all files to be hashed and writes the manifest.
+ * Returns the amount of files that could not be hashed (because their data is corrupt), which are left out.
+ */
+size_t HashManifest::write(const string manifestPath)
+{
+    this->workers.wait();
+
+    for (auto& alias : this->aliases)
+    {
+        auto targetHash = this->hashesByPath.find(alias.second);
+
+        if (targetHash == this->hashesByPath.end())
+        {
+            this->failedPaths.push_back(alias.first);
+        } else
+        {
+            this->hashesByPath[alias.first] = targetHash->second;
+        }
+    }
+
+    ofstream out(manifestPath, ios::out | ios::trunc);
+
+    for (auto& hash : this->hashesByPath)
+    {
+        out << hash.second << "  " << hash.first << "\n";
+    }
+
+    if (!out.flush())
+    {
+        throw runtime_error("Could not write manifest " + manifestPath);
+    }
+
+    return this->failedPaths.size();
+}
+
+/**
+ * Checks whether an algorithm name is one of the supported ones.
+ */
+bool HashManifest::isSupportedAlgorithm(const string algorithm)
+{
+    return algorithm == "sha256" || algorithm == "xxh64";
+}
+
+/**
+ * Hashes the uncompressed data of a payload.
+ */
+string HashManifest::hashPayload(CompressedPayload& payload)
+{
+    FileHasher hasher = this->createHasher();
+
+    const auto consumer = [&hasher](const unsigned char* chunk, size_t chunkLength) {
+        hasher.update(chunk, chunkLength);
+    };
+
+    if (!payload.walkStoredBlocks(consumer) && payload.inflateChunks(consumer) != Z_OK)
+    {
+        throw runtime_error("Compressed file is corrupt.");
+    }
+
+    return hasher.digestHex();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CompressedPayload.h"
+#include "Sha256.h"
+#include "WorkerPool.h"
+#include "Xxh64.h"
+
+using namespace std;
+
+/**
+ * Compressed bytes waiting to be hashed at most, before unpacking has to wait for the hashing to catch up.
+ */
+constexpr uint64_t HASH_MANIFEST_MAXIMUM_PENDING = 0x10000000;
+
+/**
+ * Hash of a single file in one of the algorithms of HashManifest, fed piece by piece.
+ */
+class FileHasher {
+public:
+    FileHasher(const string algorithm);
+    void update(const unsigned char* data, size_t length);
+    uint64_t getLength();
+    string digestHex();
+private:
+    const bool useSha256;
+    Sha256 sha256;
+    Xxh64 xxh64;
+    uint64_t length;
+};
+
+/**
+ * Checksums of every unpacked file, written as "HASH  PATH" lines sorted by path, the format of sha256sum and xxhsum.
+ * Running "sha256sum -c" (or "xxhsum -c" for XXH64) on it in the output directory checks the unpacked tree.
+ *
+ * Files are usually hashed while they are unpacked, from the data the sink inflates anyway (see CompressedPayload::setTee),
+ * and handed over with addHash. Files the sink doesn't inflate itself (stored data copied into zip archives, files that
+ * are in the output already) are hashed on a pool of workers from the payload read from the drive, while the unpacker
+ * goes on with the next file. Stored blocks are hashed right where they are in the payload, only other block types
+ * have to be inflated for it. Either way, nothing is read back from the output.
+ */
+class HashManifest {
+public:
+    HashManifest(const string algorithm, const unsigned int threadCount);
+    HashManifest(const HashManifest&) = delete;
+    HashManifest& operator=(const HashManifest&) = delete;
+    FileHasher createHasher();
+    void addHash(const string filePath, const string hash);
+    void addFile(const string filePath, shared_ptr<CompressedPayload> payload);
+    void addFailedFile(const string filePath);
+    void addAlias(const string filePath, const string targetPath);
+    size_t write(const string manifestPath);
+    static bool isSupportedAlgorithm(const string algorithm);
+private:
+    string hashPayload(CompressedPayload& payload);
+
+    const string algorithm;
+    WorkerPool workers;
+
+    mutex hashesMutex;
+    condition_variable pendingBytesFreed;
+    uint64_t pendingBytes;
+    map<string, string> hashesByPath;
+    vector<pair<string, string>> aliases;
+    vector<string> failedPaths;
+};
@@ -0,0 +1,216 @@
+#include "IncrementalManifest.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "PathIndex.h"
+
+using namespace std;
+
+/**
+ * Checks whether the drive still has an entry of the given type, spelled exactly like that in the output.
+ * Lookups in the drive ignore case, but a patch spelling a directory differently unpacks into a different one on most systems.
+ */
+static bool isInDrive(DriveOverlay& overlay, const string& path, const bool isDirectory)
+{
+    if (!overlay.contains(path) || overlay.open(path).entry.isDirectory() != isDirectory)
+    {
+        return false;
+    }
+
+    for (size_t nameStart = 0; nameStart < path.size();)
+    {
+        const size_t nameEnd = min(path.find('/', nameStart), path.size());
+
+        if (overlay.open(path.substr(0, nameEnd)).entry.getFileName() != path.substr(nameStart, nameEnd - nameStart))
+        {
+            return false;
+        }
+
+        nameStart = nameEnd + 1;
+    }
+
+    return true;
+}
+
+IncrementalManifest::IncrementalManifest(const filesystem::path rootPath):
+    rootPath(rootPath), previousRecords(), currentRecords(), unchangedCount(0)
+{}
+
+/**
+ * Reads the manifest left behind by the previous run, if there is one.
+ * Every line holds the location, compressed size, checksum and unpacked size of a file, followed by its path.
+ */
+void IncrementalManifest::load()
+{
+    ifstream in(this->rootPath / INCREMENTAL_MANIFEST_NAME);
+    string line;
+
+    while (getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        istringstream fields(line);
+        ManifestRecord record;
+        string filePath;
+
+        fields >> record.fileStart >> record.fileSize >> hex >> record.checksum >> dec >> record.uncompressedSize;
+
+        // The path is everything after the separator following the last number, spaces included.
+        if (!fields || fields.get() != ' ' || !getline(fields, filePath) || filePath.empty())
+        {
+            throw runtime_error("Corrupt line in " + INCREMENTAL_MANIFEST_NAME + ": " + line);
+        }
+
+        this->previousRecords[filePath] = record;
+    }
+}
+
+/**
+ * Checks whether a file was unpacked from the same data before and is still there, in which case it's kept as it is.
+ * Fills in the unpacked size of unchanged files.
+ */
+bool IncrementalManifest::isUnchanged(const string filePath, ManifestRecord& record)
+{
+    auto previousRecord = this->previousRecords.find(filePath);
+
+    if (previousRecord == this->previousRecords.end()
+        || previousRecord->second.fileStart != record.fileStart
+        || previousRecord->second.fileSize != record.fileSize
+        || previousRecord->second.checksum != record.checksum)
+    {
+        return false;
+    }
+
+    // Catches output files that were deleted or cut short since, a missing file simply fails the check.
+    error_code sizeError;
+    if (filesystem::file_size(this->resolve(filePath), sizeError) != previousRecord->second.uncompressedSize || sizeError)
+    {
+        return false;
+    }
+
+    record.uncompressedSize = previousRecord->second.uncompressedSize;
+    this->currentRecords[filePath] = previousRecord->second;
+    this->unchangedCount++;
+
+    return true;
+}
+
+/**
+ * Records a file that was just written.
+ */
+void IncrementalManifest::markUnpacked(const string filePath, const ManifestRecord& record)
+{
+    this->currentRecords[filePath] = record;
+}
+
+/**
+ * Deletes the files of the previous run that are no longer in the drive, along with directories left empty by that.
+ * Files the drive still has are kept, even if this run didn't unpack them because of a filter.
+ * Returns the amount of files deleted.
+ */
+int IncrementalManifest::removeStaleFiles(DriveOverlay& overlay)
+{
+    unordered_map<string, string> currentPathsByNormalizedPath;
+    int removedCount = 0;
+
+    for (auto& currentRecord : this->currentRecords)
+    {
+        currentPathsByNormalizedPath[PathIndex::normalize(currentRecord.first)] = currentRecord.first;
+    }
+
+    for (auto previousRecord = this->previousRecords.begin(); previousRecord != this->previousRecords.end();)
+    {
+        const string& filePath = previousRecord->first;
+
+        if (this->currentRecords.count(filePath) > 0 || isInDrive(overlay, filePath, false))
+        {
+            ++previousRecord;
+            continue;
+        }
+
+        // On file systems that ignore case, the old spelling may well be the very file this run just wrote.
+        error_code removeError;
+        auto currentPath = currentPathsByNormalizedPath.find(PathIndex::normalize(filePath));
+
+        if (currentPath == currentPathsByNormalizedPath.end() || !filesystem::equivalent(this->resolve(filePath), this->resolve(currentPath->second), removeError))
+        {
+            filesystem::remove(this->resolve(filePath), removeError);
+            removedCount++;
+        }
+
+        // Walk up the tree as long as directories end up empty, without touching the ones the drive still has.
+        for (filesystem::path directoryPath = filesystem::path(filePath).parent_path(); !directoryPath.empty(); directoryPath = directoryPath.parent_path())
+        {
+            if (isInDrive(overlay, directoryPath.generic_string(), true) || !filesystem::is_empty(this->resolve(directoryPath.generic_string()), removeError) || removeError)
+            {
+                break;
+            }
+
+            filesystem::remove(this->resolve(directoryPath.generic_string()), removeError);
+        }
+
+        previousRecord = this->previousRecords.erase(previousRecord);
+    }
+
+    return removedCount;
+}
+
+/**
+ * Writes the manifest for the next run, replacing the previous one in a single step.
+ * Files of the previous run this run didn't get to are carried over unchanged.
+ */
+void IncrementalManifest::save()
+{
+    // Sorted by path, so the manifest doesn't change between runs that unpack the same.
+    map<string, ManifestRecord> records(this->previousRecords.begin(), this->previousRecords.end());
+
+    for (auto& currentRecord : this->currentRecords)
+    {
+        records[currentRecord.first] = currentRecord.second;
+    }
+
+    const filesystem::path manifestPath = this->rootPath / INCREMENTAL_MANIFEST_NAME;
+    filesystem::path tempPath = manifestPath;
+    tempPath += ".tmp";
+
+    {
+        ofstream out(tempPath, ios::out | ios::trunc);
+        out << "# mha-vdrv-unpacker manifest: fileStart fileSize adler32 uncompressedSize path" << endl;
+
+        for (auto& record : records)
+        {
+            out << record.second.fileStart << " " << record.second.fileSize << " " << hex << record.second.checksum << dec;
+            out << " " << record.second.uncompressedSize << " " << record.first << "\n";
+        }
+
+        if (!out.flush())
+        {
+            throw runtime_error("Could not write " + tempPath.string());
+        }
+    }
+
+    filesystem::rename(tempPath, manifestPath);
+}
+
+/**
+ * Gets the amount of files that were found unchanged and skipped.
+ */
+int IncrementalManifest::getUnchangedCount()
+{
+    return this->unchangedCount;
+}
+
+/**
+ * Turns a path within the drive into a path on the file system.
+ */
+filesystem::path IncrementalManifest::resolve(const string filePath)
+{
+    return this->rootPath / filesystem::path(filePath).make_preferred();
+}
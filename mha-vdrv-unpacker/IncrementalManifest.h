@@ -0,0 +1,53 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+#include "DriveOverlay.h"
+
+using namespace std;
+
+/**
+ * Name of the manifest file, in the root of the output directory.
+ */
+const string INCREMENTAL_MANIFEST_NAME = ".vdrv-manifest";
+
+/**
+ * Where the data of an unpacked file came from, and what it turned into.
+ */
+struct ManifestRecord {
+    uint fileStart;
+    uint fileSize;
+    uint checksum;
+    uint64_t uncompressedSize;
+};
+
+/**
+ * Remembers which drive entry every file of an output directory was unpacked from, so unpacking a drive again
+ * (say, after a small patch) only has to write the files that actually changed.
+ *
+ * A file counts as unchanged if its entry still has the same location, compressed size and Adler-32 checksum
+ * (taken from the end of the zlib stream, so nothing has to be inflated), and the output file is still there with
+ * its full size. The manifest is a plain text file with one file per line and is only replaced once the unpack is done,
+ * so an aborted run simply redoes whatever it didn't get to.
+ */
+class IncrementalManifest {
+public:
+    IncrementalManifest(const filesystem::path rootPath);
+    void load();
+    bool isUnchanged(const string filePath, ManifestRecord& record);
+    void markUnpacked(const string filePath, const ManifestRecord& record);
+    int removeStaleFiles(DriveOverlay& overlay);
+    void save();
+    int getUnchangedCount();
+private:
+    filesystem::path resolve(const string filePath);
+
+    const filesystem::path rootPath;
+
+    // Records of the previous run, and of the files this run already dealt with.
+    unordered_map<string, ManifestRecord> previousRecords;
+    unordered_map<string, ManifestRecord> currentRecords;
+    int unchangedCount;
+};
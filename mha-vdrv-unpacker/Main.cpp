@@ -1,159 +1,950 @@
-﻿#include <iostream>
+﻿#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
 #include <filesystem>
 #include <memory>
+#include <optional>
+#include <unordered_map>
 
+#include <sys/stat.h>
+
+#include "AssetServer.h"
+#include "BatchUnpacker.h"
+#include "CompressedPayload.h"
+#include "DirectorySink.h"
+#include "DriveAnalyzer.h"
+#include "DriveOverlay.h"
+#include "DriveVerifier.h"
+#include "HashManifest.h"
+#include "IncrementalManifest.h"
+#include "MetadataListing.h"
+#include "MetadataQuery.h"
+#include "MetadataTable.h"
+#include "PathFilter.h"
+#include "PathIndex.h"
+#include "SeekableArchiveReader.h"
+#include "SeekableArchiveSink.h"
+#include "SelfTest.h"
+#include "Sharding.h"
+#include "StoreSink.h"
+#include "TarSink.h"
+#include "Unpacker.h"
+#include "UnpackJournal.h"
+#include "WorkerPool.h"
+#include "ZipSink.h"
 #include "VDRV.h"
 #include "zlib.h"
 
 using namespace std;
 
 /**
- * Creates a directory if it does not exist already on the file system.
+ * Switches that change how the drive is unpacked.
  */
-void ensureDirectory(const string absoluteDirPath) {
-    if (!filesystem::exists(absoluteDirPath)) {
-        filesystem::create_directories(absoluteDirPath);
+struct UnpackOptions {
+    // Output format, either a plain directory tree ("dir"), a single tar archive ("tar"), a zip archive ("zip"),
+    // a compressed archive with random access to single files ("seekable") or a store shared by many drives ("store").
+    string format = "dir";
+
+    // Name of the drive's tree in the store, the name of the drive file by default.
+    string treeName;
+
+    // Preallocate and map every output file, then inflate straight into the mapping.
+    bool mappedOutput = false;
+
+    // Leave large runs of zeros out of the output files as holes.
+    bool sparseOutput = false;
+
+    // Amount of data collected before it is written out, for archive formats.
+    size_t writeBufferSize = 0x100000;
+
+    // Amount of worker threads for the formats that compress in parallel.
+    unsigned int threadCount = WorkerPool::getDefaultThreadCount();
+
+    // zlib compression level for the formats that recompress the data.
+    int compressionLevel = Z_BEST_COMPRESSION;
+
+    // Rules for unpacking only part of the drive.
+    PathFilter filter;
+
+    // Drives stacked on top of the source drive (patches), later ones replacing entries of earlier ones.
+    vector<string> overlayPaths;
+
+    // Part of the drive this process unpacks (counting from 0), when the unpack is split across several of them.
+    int shardIndex = 0;
+    int shardCount = 0;
+
+    // Only write the files that changed since the last unpack into the same directory, optionally deleting the ones that are gone.
+    bool incremental = false;
+    bool pruneStale = false;
+
+    // Write files atomically and keep a journal of the finished ones, so an aborted unpack can be resumed.
+    bool journaled = false;
+
+    // File to write the checksums of all unpacked files to, and the hash algorithm for them.
+    string manifestPath;
+    string hashAlgorithm = "sha256";
+};
+
+/**
+ * Opens every drive of a stack and merges their metadata, the first one being the bottom.
+ */
+void loadDrives(DriveOverlay& overlay, const vector<string>& drivePaths) {
+    for (const string& drivePath : drivePaths) {
+        cout << "Opening drive " << drivePath << "..." << endl;
+
+        unique_ptr<VDRV> vdrv = make_unique<VDRV>(drivePath.c_str());
+
+        cout << "=> Drive file size: " << vdrv->getFileSize() << " B." << endl;
+        cout << "Parsing metadata...";
+
+        // Decrypts and parses the obfuscated/encrypted metadata which tells us where 
+        // which files are located and how they are linked.
+        DriveMetadata meta = vdrv->readMetadata();
+
+        cout << " DONE." << endl;
+        cout << "=> Found " << meta.getSize() << " entries in the drive metadata." << endl;
+
+        overlay.addDrive(drivePath, move(vdrv), move(meta));
+    }
+
+    if (drivePaths.size() > 1) {
+        cout << "=> " << overlay.getSize() << " entries in the merged tree of " << drivePaths.size() << " drives." << endl;
     }
 }
 
 /**
- * Processes a single file entry from the drive and saves it to the result directory.
+ * Creates the output sink matching the selected format.
  */
-void processFile(VDRV& vdrv, DriveMetadataEntry fileEntry, const string currentDestPath) {
-    cout << "* " << fileEntry.getFileName() << " -> " << fileEntry.getFileSize() << " B compressed";
+unique_ptr<OutputSink> createSink(const char* sourcePath, const string destPath, const UnpackOptions& options) {
+    if (options.format == "store") {
+        return make_unique<StoreSink>(destPath, options.treeName.empty() ? filesystem::path(sourcePath).stem().string() : options.treeName);
+    }
 
-    // Append file name to the current destination path.
-    const string filePath = currentDestPath + "\\" + fileEntry.getFileName();
+    if (options.format == "seekable") {
+        return make_unique<SeekableArchiveSink>(destPath, options.writeBufferSize, options.threadCount, options.compressionLevel);
+    }
 
-    // Read the compressed data from the drive file in a zlib compatible way.
-    unique_ptr<char[]> compressedFile = vdrv.readCompressedFile(fileEntry);
-    unsigned char* compressedBuf = reinterpret_cast<unsigned char*>(&compressedFile[0]);
-    
-    // Create a new zlib compatible buffer.
-    // Length is estimated by the original file size because the files never actually really got compressed, just converted to zlib format.
-    uLongf uncompressedLength = fileEntry.getFileSize();
-    unique_ptr<unsigned char[]> uncompressedBuf(new unsigned char[uncompressedLength]);
+    if (options.format != "dir") {
+        // The drive does not store any timestamps, so every entry gets the one of the drive file itself.
+        struct stat sourceStat;
+        const time_t modificationTime = stat(sourcePath, &sourceStat) == 0 ? sourceStat.st_mtime : 0;
 
-    // Zlib call. Stores the actual length of the uncompressed data back into uncompressed length. (should be the same for this file format)
-    const int decompressionSuccessful = uncompress(&uncompressedBuf[0], &uncompressedLength, compressedBuf, fileEntry.getFileSize());
+        if (options.format == "zip") {
+            return make_unique<ZipSink>(destPath, options.writeBufferSize, modificationTime);
+        }
 
-    cout << ", " << uncompressedLength << " B uncompressed" << endl;
+        return make_unique<TarSink>(destPath, options.writeBufferSize, modificationTime);
+    }
 
-    if (decompressionSuccessful != Z_OK) {
-        cout << "Error during decompression, buffer size might not have been enough. This shouldn't happen!" << endl;
+    if (!filesystem::exists(destPath)) {
+        filesystem::create_directories(destPath);
     }
 
-    // Write out the uncompressed data.
-    ofstream binFile(filePath, ios::out | ios::binary);
-    if (binFile.is_open())
+    return make_unique<DirectorySink>(destPath, options.mappedOutput, options.sparseOutput, options.journaled);
+}
+
+/**
+ * Extracts a single file from an archive written with "--format seekable", inflating only that file's frames.
+ * Takes in the archive, the path of the file within it and optionally an output file (stdout if omitted or "-").
+ */
+int extractFromArchive(int argc, char* argv[]) {
+    if (argc < 4 || argc > 5) {
+        cerr << "Usage: " << argv[0] << " extract ARCHIVE PATH [OUTPUT_FILE]" << endl;
+        return 1;
+    }
+
+    try
     {
-        size_t len = fileEntry.getFileSize();
-        binFile.write(reinterpret_cast<char*>(&uncompressedBuf[0]), uncompressedLength);
+        SeekableArchiveReader archive(argv[2]);
+        BufferedWriter out(argc == 5 ? argv[4] : "-", 0x100000);
+
+        archive.readFile(argv[3], [&out](const unsigned char* chunk, size_t chunkLength) {
+            out.write(chunk, chunkLength);
+        });
+
+        out.flush();
+    } catch (std::exception& e)
+    {
+        cerr << "Error during execution: " << e.what() << endl;
+        return 1;
     }
+
+    return 0;
 }
 
 /**
- * Processes a single directory entry from the drive, recursively walking into sub-directories and writing out files.
+ * Looks up a single file by its path, decrypting metadata entries only until it is found.
+ * Parents are usually listed before their children. Should that not be the case, the lookup ends up reading
+ * the whole metadata anyway, and simply looks the path up in there.
  */
-void processDirectory(VDRV& vdrv, DriveMetadata metadata, DriveMetadataEntry directoryEntry, const string currentDestPath) {
-    // Append file name to the current destination path.
-    const string currentDirPath = currentDestPath + "\\" + directoryEntry.getFileName();
+optional<DriveMetadataEntry> findFileEntry(VDRV& vdrv, const string path) {
+    const string normalizedPath = PathIndex::normalize(path);
+    const string normalizedName = normalizedPath.substr(normalizedPath.rfind('/') + 1);
 
-    cout << endl << "Processing directory: " << currentDirPath << endl;
+    unordered_map<uint, int> positionsByOffset;
+    optional<DriveMetadataEntry> fileEntry;
 
-    // Create the directory in the file system.
-    ensureDirectory(currentDirPath);
-    
-    // Get all entries contained within this directory (files and sub-directories).
-    vector<DriveMetadataEntry> childEntries = metadata.getChildEntries(directoryEntry);
+    DriveMetadata meta = vdrv.readMetadataUntil([&](DriveMetadata& partialMeta) {
+        const int pos = partialMeta.getSize() - 1;
+        DriveMetadataEntry entry = partialMeta.getEntryAt(pos);
+        positionsByOffset[entry.getEntryOffset()] = pos;
 
-    // Separate the list by of entries by entry type. The only purpose of this split is so we can
-    // output the console logs in the right order without putting in any actual effort, tbh.
-    vector<DriveMetadataEntry> fileEntries;
-    vector<DriveMetadataEntry> dirEntries;
+        if (entry.isDirectory() || PathIndex::normalize(entry.getFileName()) != normalizedName) {
+            return false;
+        }
 
-    copy_if(childEntries.begin(), childEntries.end(), back_inserter(fileEntries), [](DriveMetadataEntry entry) {
-        return !entry.isDirectory();
-    });
-    
-    copy_if(childEntries.begin(), childEntries.end(), back_inserter(dirEntries), [](DriveMetadataEntry entry) {
-        return entry.isDirectory();
+        // The name fits, check the rest of the path against the parents read so far.
+        string fullPath = entry.getFileName();
+        uint parentOffset = entry.getParentOffset();
+
+        while (parentOffset != 0) {
+            auto parentPos = positionsByOffset.find(parentOffset);
+
+            if (parentPos == positionsByOffset.end() || fullPath.size() > normalizedPath.size()) {
+                return false;
+            }
+
+            DriveMetadataEntry parentEntry = partialMeta.getEntryAt(parentPos->second);
+            fullPath = parentEntry.getFileName() + "/" + fullPath;
+            parentOffset = parentEntry.getParentOffset();
+        }
+
+        if (PathIndex::normalize(fullPath) != normalizedPath) {
+            return false;
+        }
+
+        fileEntry.emplace(entry);
+        return true;
     });
 
-    // Write out files first for correct console print order.
-    for (auto entry : fileEntries) {
-        processFile(vdrv, entry, currentDirPath);
+    if (!fileEntry) {
+        PathIndex index(meta);
+
+        if (index.contains(path) && !index.open(path).isDirectory()) {
+            fileEntry.emplace(index.open(path));
+        }
+    }
+
+    return fileEntry;
+}
+
+/**
+ * Streams a single file from the drive to stdout, without unpacking anything else.
+ * Takes in the drive and the path of the file within it.
+ */
+int catFile(int argc, char* argv[]) {
+    if (argc < 4 || argc > 6) {
+        cerr << "Usage: " << argv[0] << " cat SOURCE_VDRV PATH [OFFSET [LENGTH]]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        VDRV vdrv(argv[2]);
+        optional<DriveMetadataEntry> fileEntry = findFileEntry(vdrv, argv[3]);
+
+        if (!fileEntry) {
+            cerr << "File not found in drive: " << argv[3] << endl;
+            return 1;
+        }
+
+        BufferedWriter out("-", INFLATE_CHUNK_SIZE);
+
+        // A byte range is read through the seek index, so nothing in front of it gets inflated.
+        if (argc > 4) {
+            uLong offset = strtoull(argv[4], nullptr, 10);
+            uLong remainingLength = argc > 5 ? strtoull(argv[5], nullptr, 10) : ULONG_MAX;
+            unique_ptr<char[]> chunkBuf(new char[INFLATE_CHUNK_SIZE]);
+
+            while (remainingLength > 0) {
+                const uLong chunkLength = vdrv.readRange(*fileEntry, offset, &chunkBuf[0], min<uLong>(remainingLength, INFLATE_CHUNK_SIZE));
+
+                if (chunkLength == 0) {
+                    break;
+                }
+
+                out.write(&chunkBuf[0], chunkLength);
+                offset += chunkLength;
+                remainingLength -= chunkLength;
+            }
+
+            out.flush();
+            return 0;
+        }
+
+        // Only this entry's compressed range is read, and inflated in fixed size chunks.
+        CompressedPayload payload(vdrv.readCompressedFile(*fileEntry), fileEntry->getFileSize());
+
+        const int decompressionResult = payload.inflateChunks([&out](const unsigned char* chunk, size_t chunkLength) {
+            out.write(chunk, chunkLength);
+        });
+
+        out.flush();
+
+        if (decompressionResult != Z_OK) {
+            cerr << "Error during decompression, the compressed data seems to be corrupt." << endl;
+            return 1;
+        }
+    } catch (std::exception& e)
+    {
+        cerr << "Error during execution: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a line for every metadata entry of the drive, as NDJSON (default) or CSV, without unpacking anything.
+ * The listing goes to stdout unless an output file is given.
+ */
+int listDrive(int argc, char* argv[]) {
+    string format = "ndjson";
+    string outputPath = "-";
+    bool validArgs = argc >= 3;
+
+    for (int i = 3; validArgs && i < argc; i++) {
+        const string arg(argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--format" && hasValue) {
+            format = argv[++i];
+            validArgs = isListingFormat(format);
+        } else if (arg == "--output" && hasValue) {
+            outputPath = argv[++i];
+        } else {
+            validArgs = false;
+        }
+    }
+
+    if (!validArgs) {
+        cerr << "Usage: " << argv[0] << " list SOURCE_VDRV [--format ndjson|csv] [--output FILE]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        VDRV vdrv(argv[2]);
+        DriveMetadata meta = vdrv.readMetadata();
+        BufferedWriter out(outputPath, 0x100000);
+
+        writeListing(vdrv, meta, out, format);
+        out.flush();
+    } catch (std::exception& e)
+    {
+        cerr << "Error during execution: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Loads the metadata of a drive once and serves its files over HTTP, until the process is stopped.
+ */
+int serveDrive(int argc, char* argv[]) {
+    vector<string> drivePaths = { argc > 2 ? argv[2] : "" };
+    string socketPath;
+    int port = 0;
+    unsigned int threadCount = WorkerPool::getDefaultThreadCount();
+    size_t cacheBudget = 0;
+    bool validArgs = argc >= 5;
+
+    for (int i = 3; validArgs && i < argc; i++) {
+        const string arg(argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--port" && hasValue) {
+            port = atoi(argv[++i]);
+            validArgs = port > 0 && port <= 0xFFFF;
+        } else if (arg == "--socket" && hasValue) {
+            socketPath = argv[++i];
+        } else if (arg == "--overlay" && hasValue) {
+            drivePaths.push_back(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            threadCount = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+            validArgs = threadCount > 0;
+        } else if (arg == "--cache" && hasValue) {
+            cacheBudget = strtoull(argv[++i], nullptr, 10);
+            validArgs = cacheBudget > 0;
+        } else {
+            validArgs = false;
+        }
+    }
+
+    if (!validArgs || (port == 0) == socketPath.empty()) {
+        cerr << "Usage: " << argv[0] << " serve SOURCE_VDRV [--overlay PATCH_VDRV]... (--port N | --socket PATH) [--threads N] [--cache BYTES]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        DriveOverlay overlay;
+        loadDrives(overlay, drivePaths);
+
+        AssetServer server(overlay, threadCount);
+
+        if (cacheBudget > 0) {
+            server.setCache(cacheBudget);
+        }
+
+        if (port != 0) {
+            server.listenTcp(port);
+            cout << "Serving " << argv[2] << " on http://127.0.0.1:" << port << "/" << endl;
+        } else {
+            server.listenUnix(socketPath);
+            cout << "Serving " << argv[2] << " on " << socketPath << endl;
+        }
+
+        server.serve();
+    } catch (std::exception& e)
+    {
+        cerr << "Error during execution: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Unpacks many drives at once into their own directories below a common root, sharing one pool of workers.
+ * Sources can be drive files or directories, which are searched for drive files.
+ */
+int batchUnpack(int argc, char* argv[]) {
+    vector<string> sourcePaths;
+    unsigned int threadCount = WorkerPool::getDefaultThreadCount();
+    unsigned int ioSlots = 4;
+    bool mappedOutput = false;
+    bool sparseOutput = false;
+    PathFilter filter;
+    bool validArgs = true;
+
+    for (int i = 2; validArgs && i < argc; i++) {
+        const string arg(argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--threads" && hasValue) {
+            threadCount = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+            validArgs = threadCount > 0;
+        } else if (arg == "--io" && hasValue) {
+            ioSlots = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+            validArgs = ioSlots > 0;
+        } else if (arg == "--mmap") {
+            mappedOutput = true;
+        } else if (arg == "--sparse") {
+            sparseOutput = true;
+        } else if ((arg == "--include" || arg == "--include-regex" || arg == "--exclude" || arg == "--exclude-regex") && hasValue) {
+            try
+            {
+                if (arg.rfind("--include", 0) == 0) {
+                    filter.addInclude(argv[++i], arg == "--include-regex");
+                } else {
+                    filter.addExclude(argv[++i], arg == "--exclude-regex");
+                }
+            } catch (regex_error&)
+            {
+                validArgs = false;
+            }
+        } else if (arg.rfind("--", 0) == 0) {
+            validArgs = false;
+        } else {
+            sourcePaths.push_back(arg);
+        }
+    }
+
+    if (!validArgs || sourcePaths.size() < 2) {
+        cerr << "Usage: " << argv[0] << " batch DESTINATION_ROOT SOURCE_VDRV_OR_DIR... [--threads N] [--io N] [--mmap] [--sparse]" << endl;
+        cerr << "       [--include GLOB] [--exclude GLOB] [--include-regex REGEX] [--exclude-regex REGEX]" << endl;
+        return 1;
+    }
+
+    const filesystem::path destRoot = sourcePaths[0];
+    sourcePaths.erase(sourcePaths.begin());
+
+    try
+    {
+        WorkerPool workers(threadCount);
+        BatchUnpacker batch(workers, ioSlots, filter, mappedOutput, sparseOutput);
+        unordered_map<string, int> outputNameCounts;
+
+        // Every drive is unpacked into a directory named after it. Drives found in a directory keep their relative path,
+        // so different versions of the same drive don't end up in the same place.
+        const auto addDrive = [&](const filesystem::path& drivePath, filesystem::path outputName) {
+            outputName.replace_extension();
+            const int nameCount = ++outputNameCounts[outputName.generic_string()];
+
+            if (nameCount > 1) {
+                outputName += "-" + to_string(nameCount);
+            }
+
+            batch.addDrive(drivePath.string(), destRoot / outputName);
+        };
+
+        for (const string& sourcePath : sourcePaths) {
+            if (!filesystem::is_directory(sourcePath)) {
+                addDrive(sourcePath, filesystem::path(sourcePath).filename());
+                continue;
+            }
+
+            vector<filesystem::path> drivePaths;
+            for (const auto& directoryEntry : filesystem::recursive_directory_iterator(sourcePath)) {
+                if (directoryEntry.is_regular_file() && BatchUnpacker::isDriveFile(directoryEntry.path())) {
+                    drivePaths.push_back(directoryEntry.path());
+                }
+            }
+
+            sort(drivePaths.begin(), drivePaths.end());
+
+            for (const filesystem::path& drivePath : drivePaths) {
+                addDrive(drivePath, filesystem::relative(drivePath, sourcePath));
+            }
+        }
+
+        const int failedDrives = batch.unpack();
+
+        cout << endl << (failedDrives == 0 ? "All drives fully unpacked." : to_string(failedDrives) + " drive(s) could not be unpacked completely.") << endl;
+        return failedDrives == 0 ? 0 : 1;
+    } catch (std::exception& e)
+    {
+        cerr << "Error during execution: " << e.what() << endl;
+        return 1;
+    }
+}
+
+/**
+ * Checks that drives are intact without writing anything: metadata, consistency of the entries and the data of every file.
+ * Returns 0 only if all drives are free of problems.
+ */
+int verifyDrives(int argc, char* argv[]) {
+    vector<string> drivePaths;
+    unsigned int threadCount = WorkerPool::getDefaultThreadCount();
+    bool validArgs = true;
+
+    for (int i = 2; validArgs && i < argc; i++) {
+        const string arg(argv[i]);
+
+        if (arg == "--threads" && i + 1 < argc) {
+            threadCount = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+            validArgs = threadCount > 0;
+        } else if (arg.rfind("--", 0) == 0) {
+            validArgs = false;
+        } else {
+            drivePaths.push_back(arg);
+        }
+    }
+
+    if (!validArgs || drivePaths.empty()) {
+        cerr << "Usage: " << argv[0] << " verify SOURCE_VDRV... [--threads N]" << endl;
+        return 1;
+    }
+
+    WorkerPool workers(threadCount);
+    DriveVerifier verifier(workers);
+    int failedDrives = 0;
+
+    for (const string& drivePath : drivePaths) {
+        if (!verifier.verify(drivePath)) {
+            failedDrives++;
+        }
+
+        cout << endl;
+    }
+
+    cout << (failedDrives == 0 ? "All drives are intact." : to_string(failedDrives) + " drive(s) have problems.") << endl;
+    return failedDrives == 0 ? 0 : 1;
+}
+
+/**
+ * Reads drives back through the random access paths of the tool and checks the result against plain inflating.
+ * Returns 1 if any check failed.
+ */
+int selfTest(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " selftest SOURCE_VDRV..." << endl;
+        return 1;
+    }
+
+    SelfTest test;
+    int failedDrives = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (!test.run(argv[i])) {
+            failedDrives++;
+        }
+
+        cout << endl;
+    }
+
+    return failedDrives == 0 ? 0 : 1;
+}
+
+/**
+ * Loads the metadata of one or more drives into a table and runs a query over it, writing the result as CSV (default) or NDJSON.
+ * The timings go to stderr, so the result can be piped on.
+ */
+int queryDrives(int argc, char* argv[]) {
+    vector<string> drivePaths;
+    vector<pair<string, string>> queryArgs;
+    string format = "csv";
+    string outputPath = "-";
+    bool validArgs = true;
+
+    for (int i = 2; validArgs && i < argc; i++) {
+        const string arg(argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if ((arg == "--where" || arg == "--under" || arg == "--select" || arg == "--group-by" || arg == "--sort" || arg == "--limit") && hasValue) {
+            queryArgs.emplace_back(arg, argv[++i]);
+        } else if (arg == "--format" && hasValue) {
+            format = argv[++i];
+            validArgs = isListingFormat(format);
+        } else if (arg == "--output" && hasValue) {
+            outputPath = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            validArgs = false;
+        } else {
+            drivePaths.push_back(arg);
+        }
+    }
+
+    if (!validArgs || drivePaths.empty()) {
+        cerr << "Usage: " << argv[0] << " query SOURCE_VDRV... [--where CONDITION]... [--under PATH] [--select COLUMN,...] [--group-by COLUMN] [--sort COLUMN[:desc]] [--limit N] [--format ndjson|csv] [--output FILE]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        const auto loadStart = chrono::steady_clock::now();
+        MetadataTable table;
+
+        for (const string& drivePath : drivePaths) {
+            VDRV vdrv(drivePath.c_str());
+            DriveMetadata meta = vdrv.readMetadata();
+            table.addDrive(drivePath, meta);
+        }
+
+        const auto queryStart = chrono::steady_clock::now();
+        MetadataQuery query(table);
+
+        for (const auto& queryArg : queryArgs) {
+            if (queryArg.first == "--where") {
+                query.addCondition(queryArg.second);
+            } else if (queryArg.first == "--under") {
+                query.addPathPrefix(queryArg.second);
+            } else if (queryArg.first == "--select") {
+                query.setSelection(queryArg.second);
+            } else if (queryArg.first == "--group-by") {
+                query.setGroupBy(queryArg.second);
+            } else if (queryArg.first == "--sort") {
+                query.setSortOrder(queryArg.second);
+            } else {
+                query.setLimit(static_cast<size_t>(stoull(queryArg.second)));
+            }
+        }
+
+        BufferedWriter out(outputPath, 0x100000);
+        const size_t rowCount = query.run(out, format);
+        out.flush();
+
+        const auto queryEnd = chrono::steady_clock::now();
+        cerr << "Loaded " << table.getRowCount() << " entries of " << drivePaths.size() << " drive(s) in ";
+        cerr << chrono::duration<double, milli>(queryStart - loadStart).count() << " ms, query took ";
+        cerr << chrono::duration<double, milli>(queryEnd - queryStart).count() << " ms (" << rowCount << " rows)." << endl;
+    } catch (std::exception& e)
+    {
+        cerr << "Error during execution: " << e.what() << endl;
+        return 1;
     }
-    
-    // Recursively walk any sub-directories.
-    for (auto entry : dirEntries) {
-        processDirectory(vdrv, metadata, entry, currentDirPath);
+
+    return 0;
+}
+
+/**
+ * Prints a layout report for each drive: regions, gaps, overlaps, sizes and seek estimates. Nothing is inflated.
+ */
+int analyzeDrives(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " analyze SOURCE_VDRV..." << endl;
+        return 1;
     }
+
+    DriveAnalyzer analyzer;
+    int failedDrives = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (!analyzer.analyze(argv[i])) {
+            failedDrives++;
+        }
+
+        cout << endl;
+    }
+
+    return failedDrives == 0 ? 0 : 1;
 }
 
 /**
  * Entry point.
  * Takes in two arguments:
  * 1) Source path to the VDRV file.
- * 2) Destination directory to unpack the files to.
+ * 2) Destination directory to unpack the files to, or the archive to write ("-" for stdout).
+ * Followed by any of these options:
+ * --format dir|tar|zip|seekable|store) Unpack into a directory tree (default), stream everything into a single tar archive,
+ *                               convert the drive into a zip archive without recompressing the data,
+ *                               write a compressed archive that allows extracting single files later on,
+ *                               or add the drive to a content-addressed store shared by many drives.
+ * --tree NAME) Name of the drive's tree in the store.
+ * --mmap) Preallocate and map the output files, inflating straight into them.
+ * --sparse) Turn large runs of zeros in the output files into holes.
+ * --write-buffer BYTES) Size of the write buffer for archive formats.
+ * --threads N) Amount of worker threads for the formats that compress in parallel.
+ * --level N) zlib compression level (1-9) for the formats that recompress the data.
+ * --include GLOB, --exclude GLOB, --include-regex REGEX, --exclude-regex REGEX) Only unpack matching files (repeatable).
+ * --overlay PATCH_VDRV) Stack another drive on top of the source drive, replacing its entries (repeatable).
+ * --shard I/N) Only unpack the I-th of N parts of the drive, so several processes can share the work.
+ * --incremental) Skip the files that are unchanged since the last unpack into the same directory.
+ * --prune) Along with --incremental, delete the files of the last unpack that are no longer in the drive.
+ * --journal) Keep track of the finished files, so running the same command again after a crash resumes the unpack.
+ * --manifest FILE) Write the checksums of all unpacked files to FILE, in the format of sha256sum.
+ * --hash sha256|xxh64) Hash algorithm for the manifest.
+ *
+ * Alternatively, "extract ARCHIVE PATH [OUTPUT_FILE]" gets a single file back out of a seekable archive,
+ * "batch DESTINATION_ROOT SOURCE_VDRV_OR_DIR..." unpacks many drives at once, each into its own directory,
+ * "cat SOURCE_VDRV PATH [OFFSET [LENGTH]]" writes a single file (or a byte range of it) from the drive to stdout,
+ * "verify SOURCE_VDRV..." checks drives for corrupt data without writing anything,
+ * "list SOURCE_VDRV [--format ndjson|csv]" lists all metadata entries of the drive,
+ * "query SOURCE_VDRV... [--where CONDITION]..." filters, sorts and groups the metadata entries of drives,
+ * "analyze SOURCE_VDRV..." reports how the data and metadata of drives are laid out,
+ * "selftest SOURCE_VDRV..." checks that reading the files of drives through the file system gives the same data as unpacking them,
+ * and "serve SOURCE_VDRV [--overlay PATCH_VDRV]... (--port N | --socket PATH) [--cache BYTES]" serves the files of the drive over HTTP.
  */
 int main(int argc, char* argv[])
 {
+    if (argc > 1 && string(argv[1]) == "extract") {
+        return extractFromArchive(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "cat") {
+        return catFile(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "batch") {
+        return batchUnpack(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "serve") {
+        return serveDrive(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "list") {
+        return listDrive(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "query") {
+        return queryDrives(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "analyze") {
+        return analyzeDrives(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "verify") {
+        return verifyDrives(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "selftest") {
+        return selfTest(argc, argv);
+    }
+
+    vector<string> positionalArgs;
+    UnpackOptions options;
+    bool validArgs = true;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg(argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--format" && hasValue) {
+            options.format = argv[++i];
+            validArgs = validArgs && (options.format == "dir" || options.format == "tar" || options.format == "zip" || options.format == "seekable" || options.format == "store");
+        } else if (arg == "--tree" && hasValue) {
+            options.treeName = argv[++i];
+        } else if (arg == "--mmap") {
+            options.mappedOutput = true;
+        } else if (arg == "--sparse") {
+            options.sparseOutput = true;
+        } else if (arg == "--write-buffer" && hasValue) {
+            options.writeBufferSize = strtoul(argv[++i], nullptr, 10);
+            validArgs = validArgs && options.writeBufferSize > 0;
+        } else if (arg == "--threads" && hasValue) {
+            options.threadCount = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+            validArgs = validArgs && options.threadCount > 0;
+        } else if (arg == "--level" && hasValue) {
+            options.compressionLevel = atoi(argv[++i]);
+            validArgs = validArgs && options.compressionLevel >= 1 && options.compressionLevel <= 9;
+        } else if ((arg == "--include" || arg == "--include-regex" || arg == "--exclude" || arg == "--exclude-regex") && hasValue) {
+            try
+            {
+                if (arg.rfind("--include", 0) == 0) {
+                    options.filter.addInclude(argv[++i], arg == "--include-regex");
+                } else {
+                    options.filter.addExclude(argv[++i], arg == "--exclude-regex");
+                }
+            } catch (regex_error&)
+            {
+                validArgs = false;
+            }
+        } else if (arg == "--overlay" && hasValue) {
+            options.overlayPaths.push_back(argv[++i]);
+        } else if (arg == "--shard" && hasValue) {
+            validArgs = validArgs && parseShard(argv[++i], options.shardIndex, options.shardCount);
+        } else if (arg == "--incremental") {
+            options.incremental = true;
+        } else if (arg == "--prune") {
+            options.pruneStale = true;
+        } else if (arg == "--journal") {
+            options.journaled = true;
+        } else if (arg == "--manifest" && hasValue) {
+            options.manifestPath = argv[++i];
+        } else if (arg == "--hash" && hasValue) {
+            options.hashAlgorithm = argv[++i];
+            validArgs = validArgs && HashManifest::isSupportedAlgorithm(options.hashAlgorithm);
+        } else if (arg.rfind("--", 0) == 0) {
+            validArgs = false;
+        } else {
+            positionalArgs.push_back(arg);
+        }
+    }
+
+    // The manifest lives in the output directory, and shards writing to the same one would overwrite each other's.
+    validArgs = validArgs && (!options.incremental || (options.format == "dir" && options.shardCount == 0)) && (!options.pruneStale || options.incremental);
+    validArgs = validArgs && (!options.journaled || options.format == "dir");
+
+    // When the archive goes to stdout, all of the progress output has to get out of its way.
+    if (positionalArgs.size() == 2 && positionalArgs[1] == "-" && options.format != "dir") {
+        cout.rdbuf(cerr.rdbuf());
+    }
+
     cout << "MHA2-VDRV-UNPACKER" << endl;
     cout << "==================" << endl;
 
     // Ensure argument list is correct.
-    if (argc != 3) {
-        cout << "Usage: " << argv[0] << " SOURCE_VDRV DESTINATION_FOLDER" << endl;
+    if (!validArgs || positionalArgs.size() != 2) {
+        cout << "Usage: " << argv[0] << " SOURCE_VDRV DESTINATION [--format dir|tar|zip|seekable|store] [--tree NAME] [--mmap] [--sparse] [--write-buffer BYTES] [--threads N] [--level N]" << endl;
+        cout << "       [--include GLOB] [--exclude GLOB] [--include-regex REGEX] [--exclude-regex REGEX] [--overlay PATCH_VDRV] [--shard I/N]" << endl;
+        cout << "       [--incremental [--prune]] [--journal] [--manifest FILE [--hash sha256|xxh64]]" << endl;
+        cout << "       " << argv[0] << " extract ARCHIVE PATH [OUTPUT_FILE]" << endl;
+        cout << "       " << argv[0] << " batch DESTINATION_ROOT SOURCE_VDRV_OR_DIR... [--threads N] [--io N] [--mmap] [--sparse]" << endl;
+        cout << "       " << argv[0] << " cat SOURCE_VDRV PATH [OFFSET [LENGTH]]" << endl;
+        cout << "       " << argv[0] << " verify SOURCE_VDRV... [--threads N]" << endl;
+        cout << "       " << argv[0] << " analyze SOURCE_VDRV..." << endl;
+        cout << "       " << argv[0] << " list SOURCE_VDRV [--format ndjson|csv] [--output FILE]" << endl;
+        cout << "       " << argv[0] << " query SOURCE_VDRV... [--where CONDITION]... [--under PATH] [--select COLUMN,...] [--group-by COLUMN] [--sort COLUMN[:desc]] [--limit N] [--format ndjson|csv] [--output FILE]" << endl;
+        cout << "       " << argv[0] << " serve SOURCE_VDRV [--overlay PATCH_VDRV] (--port N | --socket PATH) [--threads N]" << endl;
         return 1;
     }
 
-    const char* sourcePath = argv[1];
-    const string destPath = string(argv[2]);
+    const char* sourcePath = positionalArgs[0].c_str();
+    const string destPath = positionalArgs[1];
 
     cout << "Source: " << sourcePath << endl;
     cout << "Destination: " << destPath << endl;
 
-    // Check if the VDRV file actually exists.
+    vector<string> drivePaths = { sourcePath };
+    drivePaths.insert(drivePaths.end(), options.overlayPaths.begin(), options.overlayPaths.end());
+
+    // Check if the VDRV files actually exist.
     // This must suffice as an integrity check for now, in the future we could also read the magic string at the beginning of the file.
-    if (!filesystem::exists(sourcePath)) {
-        cout << "Source file does not exist." << endl;
-        return 1;
+    for (const string& drivePath : drivePaths) {
+        if (!filesystem::exists(drivePath)) {
+            cout << "Source file does not exist: " << drivePath << endl;
+            return 1;
+        }
     }
 
     try
     {
-        ensureDirectory(destPath);
+        unique_ptr<OutputSink> sink = createSink(sourcePath, destPath, options);
 
         cout << endl << "# 1. Read metadata" << endl << endl;
-        cout << "Opening drive..." << endl;
-    
-        VDRV vdrv(sourcePath);
 
-        cout << "=> Drive file size: " << vdrv.getFileSize() << " B." << endl;
-        cout << "Parsing metadata...";
-
-        // Decrypts and parses the obfuscated/encrypted metadata which tells us where 
-        // which files are located and how they are linked.
-        DriveMetadata meta = vdrv.readMetadata();
-        
-        cout << " DONE." << endl;
-        cout << "=> Found " << meta.getSize() << " entries in the drive metadata." << endl;
-        cout << "Generating list of root folders...";
+        DriveOverlay overlay;
+        loadDrives(overlay, drivePaths);
 
-        vector<DriveMetadataEntry> rootEntries = meta.getRootEntries();
+        if (options.shardCount > 0) {
+            const ShardSummary shard = restrictToShard(overlay, options.filter, options.shardIndex, options.shardCount);
+            cout << "=> Shard " << options.shardIndex + 1 << "/" << options.shardCount << ": " << shard.fileCount << " files, " << shard.compressedBytes << " B compressed." << endl;
+        }
 
-        cout << " DONE." << endl;
         cout << endl << "# 2. Unpack drive" << endl;
 
-        for (auto entry : rootEntries) {
-            processDirectory(vdrv, meta, entry, destPath);
+        unique_ptr<IncrementalManifest> manifest;
+
+        if (options.incremental) {
+            manifest = make_unique<IncrementalManifest>(destPath);
+            manifest->load();
+        }
+
+        unique_ptr<UnpackJournal> journal;
+
+        if (options.journaled) {
+            // Shards sharing an output directory each keep their own journal.
+            const string journalName = UNPACK_JOURNAL_NAME + (options.shardCount > 0 ? "." + to_string(options.shardIndex + 1) + "of" + to_string(options.shardCount) : "");
+            journal = make_unique<UnpackJournal>(filesystem::path(destPath) / journalName, overlay);
+
+            const size_t doneCount = journal->open();
+            if (doneCount > 0) {
+                cout << "=> Resuming, " << doneCount << " files were unpacked already." << endl;
+            }
+        }
+
+        unique_ptr<HashManifest> hashManifest;
+
+        if (!options.manifestPath.empty()) {
+            hashManifest = make_unique<HashManifest>(options.hashAlgorithm, options.threadCount);
+        }
+
+        Unpacker unpacker(overlay, *sink, options.filter);
+        unpacker.setManifest(manifest.get());
+        unpacker.setJournal(journal.get());
+        unpacker.setHashManifest(hashManifest.get());
+        unpacker.unpack();
+
+        if (hashManifest) {
+            const size_t failedCount = hashManifest->write(options.manifestPath);
+            cout << endl << "=> Wrote " << options.hashAlgorithm << " checksums to " << options.manifestPath;
+            cout << (failedCount > 0 ? ", leaving out " + to_string(failedCount) + " corrupt files." : ".") << endl;
+        }
+
+        if (unpacker.getLinkedCount() > 0) {
+            cout << endl << "=> " << unpacker.getLinkedCount() << " files shared their data with another file and were linked to it." << endl;
+        }
+
+        if (journal) {
+            journal->remove();
+        }
+
+        if (manifest) {
+            cout << endl << "=> " << manifest->getUnchangedCount() << " files unchanged since the last unpack." << endl;
+
+            if (options.pruneStale) {
+                cout << "=> Removed " << manifest->removeStaleFiles(overlay) << " files no longer in the drive." << endl;
+            }
+
+            manifest->save();
+        }
+
+        if (unpacker.getFailedCount() > 0) {
+            cout << endl << "=> " << unpacker.getFailedCount() << " files could not be unpacked, see above." << endl;
+            return 1;
         }
 
         cout << endl << "Drive fully unpacked." << endl;
     } catch (std::exception& e)
     {
         cout << endl << "Error during execution: " << e.what() << endl;
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,203 @@
+#include "MappedOutputFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedOutputFile::MappedOutputFile(const string filePath, const size_t size):
+    fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr), data(nullptr), size(size)
+{
+    this->fileHandle = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (this->fileHandle == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Could not create output file.");
+    }
+
+    // Empty files cannot be mapped, creating them is all there is to do.
+    if (this->size == 0)
+    {
+        return;
+    }
+
+    // Moving the end of file allocates the full size up front.
+    LARGE_INTEGER endOfFile;
+    endOfFile.QuadPart = static_cast<LONGLONG>(this->size);
+
+    if (!SetFilePointerEx(this->fileHandle, endOfFile, nullptr, FILE_BEGIN) || !SetEndOfFile(this->fileHandle))
+    {
+        CloseHandle(this->fileHandle);
+        throw runtime_error("Could not preallocate output file.");
+    }
+
+    this->mappingHandle = CreateFileMappingA(this->fileHandle, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (this->mappingHandle != nullptr)
+    {
+        this->data = static_cast<unsigned char*>(MapViewOfFile(this->mappingHandle, FILE_MAP_WRITE, 0, 0, 0));
+    }
+
+    if (this->data == nullptr)
+    {
+        if (this->mappingHandle != nullptr)
+        {
+            CloseHandle(this->mappingHandle);
+        }
+
+        CloseHandle(this->fileHandle);
+        throw runtime_error("Could not map output file.");
+    }
+}
+
+MappedOutputFile::~MappedOutputFile()
+{
+    if (this->data != nullptr)
+    {
+        UnmapViewOfFile(this->data);
+        CloseHandle(this->mappingHandle);
+    }
+
+    CloseHandle(this->fileHandle);
+}
+
+/**
+ * Releases the mapping and deallocates the given ranges, so they turn into holes that read back as zeros.
+ * The mapped data must be complete at this point. Failing to create a hole is harmless, the zeros just stay on disk.
+ */
+void MappedOutputFile::punchHoles(const vector<ZeroSpan>& spans)
+{
+    if (this->data == nullptr)
+    {
+        return;
+    }
+
+    FlushViewOfFile(this->data, 0);
+    UnmapViewOfFile(this->data);
+    CloseHandle(this->mappingHandle);
+    this->data = nullptr;
+
+    DWORD bytesReturned = 0;
+    if (spans.empty() || !DeviceIoControl(this->fileHandle, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &bytesReturned, nullptr))
+    {
+        return;
+    }
+
+    for (const ZeroSpan& span : spans)
+    {
+        FILE_ZERO_DATA_INFORMATION zeroData;
+        zeroData.FileOffset.QuadPart = static_cast<LONGLONG>(span.start);
+        zeroData.BeyondFinalZero.QuadPart = static_cast<LONGLONG>(span.start + span.length);
+        DeviceIoControl(this->fileHandle, FSCTL_SET_ZERO_DATA, &zeroData, sizeof(zeroData), nullptr, 0, &bytesReturned, nullptr);
+    }
+}
+
+#else
+
+MappedOutputFile::MappedOutputFile(const string filePath, const size_t size):
+    fd(-1), data(nullptr), size(size)
+{
+    this->fd = open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (this->fd < 0)
+    {
+        throw runtime_error("Could not create output file.");
+    }
+
+    // Empty files cannot be mapped, creating them is all there is to do.
+    if (this->size == 0)
+    {
+        return;
+    }
+
+    // Reserve the blocks for the whole file in one go, so the file system can hand out contiguous extents.
+    // File systems without fallocate support still get the right size, just without the reservation.
+#ifdef __linux__
+    int allocationResult = fallocate(this->fd, 0, 0, this->size) == 0 ? 0 : errno;
+#else
+    int allocationResult = posix_fallocate(this->fd, 0, this->size);
+#endif
+
+    if (allocationResult == EOPNOTSUPP || allocationResult == EINVAL)
+    {
+        allocationResult = ftruncate(this->fd, this->size) == 0 ? 0 : errno;
+    }
+
+    if (allocationResult != 0)
+    {
+        close(this->fd);
+        throw runtime_error("Could not preallocate output file.");
+    }
+
+    void* mapping = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        close(this->fd);
+        throw runtime_error("Could not map output file.");
+    }
+
+    this->data = static_cast<unsigned char*>(mapping);
+}
+
+MappedOutputFile::~MappedOutputFile()
+{
+    if (this->data != nullptr)
+    {
+        munmap(this->data, this->size);
+    }
+
+    close(this->fd);
+}
+
+/**
+ * Releases the mapping and deallocates the given ranges, so they turn into holes that read back as zeros.
+ * The mapped data must be complete at this point. Failing to create a hole is harmless, the zeros just stay on disk.
+ */
+void MappedOutputFile::punchHoles(const vector<ZeroSpan>& spans)
+{
+    if (this->data == nullptr)
+    {
+        return;
+    }
+
+    munmap(this->data, this->size);
+    this->data = nullptr;
+
+#ifdef __linux__
+    for (const ZeroSpan& span : spans)
+    {
+        fallocate(this->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, span.start, span.length);
+    }
+#endif
+}
+
+#endif
+
+/**
+ * Gets the writable mapping of the file. Null for empty files, or once the holes have been punched.
+ */
+unsigned char* MappedOutputFile::getData()
+{
+    return this->data;
+}
+
+/**
+ * Gets the size the file was created with.
+ */
+size_t MappedOutputFile::getSize()
+{
+    return this->size;
+}
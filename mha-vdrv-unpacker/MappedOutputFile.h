@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "SparseFile.h"
+
+using namespace std;
+
+/**
+ * An output file that is created with its final size preallocated and then mapped into memory,
+ * so data can be inflated straight into the page cache instead of going through an intermediate buffer.
+ */
+class MappedOutputFile {
+public:
+    MappedOutputFile(const string filePath, const size_t size);
+    MappedOutputFile(const MappedOutputFile&) = delete;
+    MappedOutputFile& operator=(const MappedOutputFile&) = delete;
+    ~MappedOutputFile();
+    unsigned char* getData();
+    size_t getSize();
+    void punchHoles(const vector<ZeroSpan>& spans);
+private:
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+    unsigned char* data;
+    const size_t size;
+};
@@ -0,0 +1,143 @@
+#include "MetadataListing.h"
+
+#include "PathIndex.h"
+
+using namespace std;
+
+/**
+ * Converts a Latin-1 string to UTF-8.
+ */
+string latin1ToUtf8(const string& latin1)
+{
+    string utf8;
+    utf8.reserve(latin1.size());
+
+    for (const char c : latin1)
+    {
+        const unsigned char byte = static_cast<unsigned char>(c);
+
+        if (byte < 0x80)
+        {
+            utf8.push_back(c);
+        } else
+        {
+            utf8.push_back(static_cast<char>(0xC0 | (byte >> 6)));
+            utf8.push_back(static_cast<char>(0x80 | (byte & 0x3F)));
+        }
+    }
+
+    return utf8;
+}
+
+/**
+ * Quotes a string for JSON.
+ */
+string toJsonString(const string& value)
+{
+    string quoted = "\"";
+
+    for (const char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted.push_back('\\');
+            quoted.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[7];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else
+        {
+            quoted.push_back(c);
+        }
+    }
+
+    return quoted + "\"";
+}
+
+/**
+ * Quotes a CSV field if it has to be, doubling any quotes in it.
+ */
+string toCsvField(const string& value)
+{
+    if (value.find_first_of(",\"\r\n") == string::npos)
+    {
+        return value;
+    }
+
+    string quoted = "\"";
+
+    for (const char c : value)
+    {
+        quoted.push_back(c);
+
+        if (c == '"')
+        {
+            quoted.push_back('"');
+        }
+    }
+
+    return quoted + "\"";
+}
+
+/**
+ * Checks whether a listing format is one of the supported ones.
+ */
+bool isListingFormat(const string format)
+{
+    return format == "ndjson" || format == "csv";
+}
+
+/**
+ * Writes the listing of a drive in the given format.
+ */
+void writeListing(VDRV& vdrv, DriveMetadata& metadata, BufferedWriter& out, const string format)
+{
+    PathIndex pathIndex(metadata);
+    const bool isCsv = format == "csv";
+    string line;
+
+    if (isCsv)
+    {
+        line = "path,type,entryOffset,parentOffset,fileStart,compressedSize,uncompressedSize\n";
+        out.write(line.data(), line.size());
+    }
+
+    for (int pos = 0; pos < metadata.getSize(); pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        const string path = latin1ToUtf8(pathIndex.getFullPath(entry));
+        const string emptyValue = isCsv ? "" : "null";
+        string fileStart = emptyValue;
+        string compressedSize = emptyValue;
+        string uncompressedSize = emptyValue;
+
+        if (!entry.isDirectory())
+        {
+            uLong storedSize;
+            fileStart = to_string(entry.getFileStart());
+            compressedSize = to_string(entry.getFileSize());
+
+            if (vdrv.readStoredSize(entry, storedSize))
+            {
+                uncompressedSize = to_string(storedSize);
+            }
+        }
+
+        const string type = entry.isDirectory() ? "directory" : "file";
+
+        if (isCsv)
+        {
+            line = toCsvField(path) + "," + type + "," + to_string(entry.getEntryOffset()) + "," + to_string(entry.getParentOffset());
+            line += "," + fileStart + "," + compressedSize + "," + uncompressedSize + "\n";
+        } else
+        {
+            line = "{\"path\":" + toJsonString(path) + ",\"type\":\"" + type + "\",\"entryOffset\":" + to_string(entry.getEntryOffset());
+            line += ",\"parentOffset\":" + to_string(entry.getParentOffset()) + ",\"fileStart\":" + fileStart;
+            line += ",\"compressedSize\":" + compressedSize + ",\"uncompressedSize\":" + uncompressedSize + "}\n";
+        }
+
+        out.write(line.data(), line.size());
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include "BufferedWriter.h"
+#include "DriveMetadata.h"
+#include "VDRV.h"
+
+using namespace std;
+
+/**
+ * Writes every metadata entry of a drive as one line, in metadata order, without unpacking anything:
+ * full path, type, entry offset, parent offset, data offset, compressed size and uncompressed size.
+ *
+ * "ndjson" writes one JSON object per line, "csv" a header line followed by one row per entry.
+ * Values that don't apply (data of directories, the uncompressed size of data that isn't stored blocks only) are null or empty.
+ * Names are taken to be Latin-1, as the game ran on western Windows, and written as UTF-8.
+ */
+bool isListingFormat(const string format);
+void writeListing(VDRV& vdrv, DriveMetadata& metadata, BufferedWriter& out, const string format);
+
+/**
+ * Helpers for writing names and values of the listing, also used by queries.
+ */
+string latin1ToUtf8(const string& latin1);
+string toJsonString(const string& value);
+string toCsvField(const string& value);
@@ -0,0 +1,532 @@
+#include "MetadataQuery.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#include "MetadataListing.h"
+#include "PathIndex.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define METADATA_QUERY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+MetadataQuery::MetadataQuery(MetadataTable& table):
+    table(table), valueConditions(), pathConditions(), selectedColumns(), isGrouped(false), groupColumn(QueryColumn::EXT),
+    sortColumn(), isSortDescending(false), limit(numeric_limits<size_t>::max())
+{}
+
+/**
+ * Adds a condition of the form COLUMN OP VALUE, like "size>=1M", "type=file" or "dir!=snd/sub".
+ * Conditions on text columns have to be added after all drives are in the table, as they are resolved to dictionary codes right away.
+ */
+void MetadataQuery::addCondition(const string condition)
+{
+    const size_t opStart = condition.find_first_of("=!<>");
+
+    if (opStart == string::npos || opStart == 0)
+    {
+        throw invalid_argument("Invalid condition: " + condition);
+    }
+
+    const size_t opLength = opStart + 1 < condition.size() && condition[opStart + 1] == '=' ? 2 : 1;
+    const string opText = condition.substr(opStart, opLength);
+    const string value = condition.substr(opStart + opLength);
+    const QueryColumn column = parseQueryColumn(condition.substr(0, opStart));
+    CompareOp op;
+
+    if (opText == "=" || opText == "==")
+    {
+        op = CompareOp::EQUAL;
+    } else if (opText == "!=")
+    {
+        op = CompareOp::NOT_EQUAL;
+    } else if (opText == "<")
+    {
+        op = CompareOp::LESS;
+    } else if (opText == "<=")
+    {
+        op = CompareOp::LESS_EQUAL;
+    } else if (opText == ">")
+    {
+        op = CompareOp::GREATER;
+    } else if (opText == ">=")
+    {
+        op = CompareOp::GREATER_EQUAL;
+    } else
+    {
+        throw invalid_argument("Invalid condition: " + condition);
+    }
+
+    if (this->table.isNumberColumn(column))
+    {
+        this->valueConditions.push_back({ column, op, parseNumber(value) });
+        return;
+    }
+
+    if (op != CompareOp::EQUAL && op != CompareOp::NOT_EQUAL)
+    {
+        throw invalid_argument("Text columns can only be compared with = and !=: " + condition);
+    }
+
+    if (column == QueryColumn::PATH)
+    {
+        this->pathConditions.push_back({ PathIndex::normalize(value), false, op == CompareOp::NOT_EQUAL });
+    } else
+    {
+        const uint code = this->table.findCode(column, value);
+
+        if (column == QueryColumn::TYPE && code == this->table.getDictionarySize(column))
+        {
+            throw invalid_argument("Type has to be file or directory: " + condition);
+        }
+
+        this->valueConditions.push_back({ column, op, code });
+    }
+}
+
+/**
+ * Restricts the query to entries below a directory, regardless of case and separator style.
+ */
+void MetadataQuery::addPathPrefix(const string directoryPath)
+{
+    this->pathConditions.push_back({ PathIndex::normalize(directoryPath), true, false });
+}
+
+/**
+ * Sets the columns to write, as a comma separated list of names.
+ */
+void MetadataQuery::setSelection(const string columnList)
+{
+    size_t start = 0;
+    this->selectedColumns.clear();
+
+    while (start <= columnList.size())
+    {
+        const size_t separator = min(columnList.find(',', start), columnList.size());
+        this->selectedColumns.push_back(parseQueryColumn(columnList.substr(start, separator - start)));
+        start = separator + 1;
+    }
+}
+
+/**
+ * Groups the rows by the values of a text column (drive, dir, ext or type).
+ */
+void MetadataQuery::setGroupBy(const string columnName)
+{
+    const QueryColumn column = parseQueryColumn(columnName);
+
+    if (column == QueryColumn::PATH || this->table.isNumberColumn(column))
+    {
+        throw invalid_argument("Can only group by drive, dir, ext or type: " + columnName);
+    }
+
+    this->isGrouped = true;
+    this->groupColumn = column;
+}
+
+/**
+ * Sets the column to sort by, optionally followed by ":desc" (or ":asc"). Rows that sort the same stay in metadata order.
+ */
+void MetadataQuery::setSortOrder(const string sortSpec)
+{
+    const size_t separator = sortSpec.find(':');
+    const string direction = separator == string::npos ? "asc" : sortSpec.substr(separator + 1);
+
+    if (direction != "asc" && direction != "desc")
+    {
+        throw invalid_argument("Sort direction has to be asc or desc: " + sortSpec);
+    }
+
+    this->sortColumn = sortSpec.substr(0, separator);
+    this->isSortDescending = direction == "desc";
+}
+
+/**
+ * Sets the maximum amount of rows to write, applied after sorting.
+ */
+void MetadataQuery::setLimit(const size_t limit)
+{
+    this->limit = limit;
+}
+
+/**
+ * Runs the query and writes the result as "ndjson" or "csv". Returns the amount of rows written.
+ */
+size_t MetadataQuery::run(BufferedWriter& out, const string format)
+{
+    if (!isListingFormat(format))
+    {
+        throw invalid_argument("Unknown output format: " + format);
+    }
+
+    if (this->isGrouped && !this->selectedColumns.empty())
+    {
+        throw invalid_argument("Grouped queries always write the group, count and size");
+    }
+
+    vector<size_t> rows = this->selectRows();
+    return this->isGrouped ? this->writeGroups(rows, out, format == "csv") : this->writeRows(rows, out, format == "csv");
+}
+
+/**
+ * Evaluates all conditions and gets the matching rows, in table order.
+ */
+vector<size_t> MetadataQuery::selectRows()
+{
+    const size_t rowCount = this->table.getRowCount();
+    vector<uint> selection(rowCount, ~0u);
+    vector<size_t> rows;
+
+    for (const ValueCondition& condition : this->valueConditions)
+    {
+        filterColumn(this->table.getValues(condition.column), rowCount, condition, selection.data());
+    }
+
+    for (size_t row = 0; row < rowCount; row++)
+    {
+        if (selection[row] != 0 && this->matchesPath(row))
+        {
+            rows.push_back(row);
+        }
+    }
+
+    return rows;
+}
+
+/**
+ * Sorts, limits and writes the selected rows with the selected columns.
+ */
+size_t MetadataQuery::writeRows(vector<size_t>& rows, BufferedWriter& out, const bool isCsv)
+{
+    if (!this->sortColumn.empty())
+    {
+        const QueryColumn column = parseQueryColumn(this->sortColumn);
+        const bool descending = this->isSortDescending;
+
+        if (column == QueryColumn::PATH)
+        {
+            stable_sort(rows.begin(), rows.end(), [this, descending](const size_t left, const size_t right) {
+                const string& leftPath = this->table.getNormalizedPath(left);
+                const string& rightPath = this->table.getNormalizedPath(right);
+                return descending ? rightPath < leftPath : leftPath < rightPath;
+            });
+        } else
+        {
+            // Dictionary codes are in order of appearance, so they are sorted by their rank among the values instead.
+            const uint* values = this->table.getValues(column);
+            vector<uint> sortKeys;
+
+            if (!this->table.isNumberColumn(column))
+            {
+                vector<uint> codes(this->table.getDictionarySize(column));
+                sortKeys.resize(codes.size());
+
+                for (uint code = 0; code < codes.size(); code++)
+                {
+                    codes[code] = code;
+                }
+
+                sort(codes.begin(), codes.end(), [this, column](const uint left, const uint right) {
+                    return this->table.getDictionaryValue(column, left) < this->table.getDictionaryValue(column, right);
+                });
+
+                for (uint rank = 0; rank < codes.size(); rank++)
+                {
+                    sortKeys[codes[rank]] = rank;
+                }
+            }
+
+            stable_sort(rows.begin(), rows.end(), [&values, &sortKeys, descending](const size_t left, const size_t right) {
+                const uint leftKey = sortKeys.empty() ? values[left] : sortKeys[values[left]];
+                const uint rightKey = sortKeys.empty() ? values[right] : sortKeys[values[right]];
+                return descending ? rightKey < leftKey : leftKey < rightKey;
+            });
+        }
+    }
+
+    rows.resize(min(rows.size(), this->limit));
+
+    vector<QueryColumn> columns = this->selectedColumns;
+
+    if (columns.empty())
+    {
+        if (this->table.getDictionarySize(QueryColumn::DRIVE) > 1)
+        {
+            columns.push_back(QueryColumn::DRIVE);
+        }
+
+        columns.insert(columns.end(), { QueryColumn::PATH, QueryColumn::TYPE, QueryColumn::FILE_START, QueryColumn::SIZE });
+    }
+
+    string line;
+
+    if (isCsv)
+    {
+        for (const QueryColumn column : columns)
+        {
+            line += (line.empty() ? "" : ",") + getQueryColumnName(column);
+        }
+
+        line += "\n";
+        out.write(line.data(), line.size());
+    }
+
+    for (const size_t row : rows)
+    {
+        line = isCsv ? "" : "{";
+
+        for (size_t pos = 0; pos < columns.size(); pos++)
+        {
+            const QueryColumn column = columns[pos];
+            string text = this->table.getText(column, row);
+
+            // Drive paths come from the command line, everything else from the drive.
+            if (!this->table.isNumberColumn(column))
+            {
+                text = column == QueryColumn::DRIVE ? text : latin1ToUtf8(text);
+                text = isCsv ? toCsvField(text) : toJsonString(text);
+            }
+
+            if (!isCsv)
+            {
+                line += toJsonString(getQueryColumnName(column)) + ":";
+            }
+
+            line += (pos > 0 && isCsv ? "," : "") + text + (pos + 1 < columns.size() && !isCsv ? "," : "");
+        }
+
+        line += isCsv ? "\n" : "}\n";
+        out.write(line.data(), line.size());
+    }
+
+    return rows.size();
+}
+
+/**
+ * Aggregates the selected rows per value of the group column, then sorts, limits and writes the groups.
+ */
+size_t MetadataQuery::writeGroups(vector<size_t>& rows, BufferedWriter& out, const bool isCsv)
+{
+    const uint groupCount = this->table.getDictionarySize(this->groupColumn);
+    const uint* keys = this->table.getValues(this->groupColumn);
+    const uint* sizes = this->table.getValues(QueryColumn::SIZE);
+    vector<uint64_t> counts(groupCount);
+    vector<uint64_t> totalSizes(groupCount);
+    vector<uint> groups;
+
+    for (const size_t row : rows)
+    {
+        counts[keys[row]]++;
+        totalSizes[keys[row]] += sizes[row];
+    }
+
+    for (uint code = 0; code < groupCount; code++)
+    {
+        if (counts[code] > 0)
+        {
+            groups.push_back(code);
+        }
+    }
+
+    const string groupName = getQueryColumnName(this->groupColumn);
+    const string sortColumn = this->sortColumn.empty() ? groupName : this->sortColumn;
+    const bool descending = this->isSortDescending;
+
+    if (sortColumn == groupName)
+    {
+        stable_sort(groups.begin(), groups.end(), [this, descending](const uint left, const uint right) {
+            const string& leftValue = this->table.getDictionaryValue(this->groupColumn, left);
+            const string& rightValue = this->table.getDictionaryValue(this->groupColumn, right);
+            return descending ? rightValue < leftValue : leftValue < rightValue;
+        });
+    } else if (sortColumn == "count" || sortColumn == "size")
+    {
+        const vector<uint64_t>& sortKeys = sortColumn == "count" ? counts : totalSizes;
+
+        stable_sort(groups.begin(), groups.end(), [&sortKeys, descending](const uint left, const uint right) {
+            return descending ? sortKeys[right] < sortKeys[left] : sortKeys[left] < sortKeys[right];
+        });
+    } else
+    {
+        throw invalid_argument("Grouped queries can only be sorted by " + groupName + ", count or size: " + sortColumn);
+    }
+
+    groups.resize(min(groups.size(), this->limit));
+
+    string line;
+
+    if (isCsv)
+    {
+        line = groupName + ",count,size\n";
+        out.write(line.data(), line.size());
+    }
+
+    for (const uint code : groups)
+    {
+        string value = this->table.getDictionaryValue(this->groupColumn, code);
+        value = this->groupColumn == QueryColumn::DRIVE ? value : latin1ToUtf8(value);
+
+        if (isCsv)
+        {
+            line = toCsvField(value) + "," + to_string(counts[code]) + "," + to_string(totalSizes[code]) + "\n";
+        } else
+        {
+            line = "{" + toJsonString(groupName) + ":" + toJsonString(value) + ",\"count\":" + to_string(counts[code]);
+            line += ",\"size\":" + to_string(totalSizes[code]) + "}\n";
+        }
+
+        out.write(line.data(), line.size());
+    }
+
+    return groups.size();
+}
+
+/**
+ * Checks a row against the path conditions. Prefixes match everything strictly below the directory.
+ */
+bool MetadataQuery::matchesPath(const size_t row)
+{
+    const string& path = this->table.getNormalizedPath(row);
+
+    for (const PathCondition& condition : this->pathConditions)
+    {
+        const string& conditionPath = condition.normalizedPath;
+        bool matches;
+
+        if (!condition.isPrefix)
+        {
+            matches = path == conditionPath;
+        } else if (conditionPath.empty())
+        {
+            matches = true;
+        } else
+        {
+            matches = path.size() > conditionPath.size() && path[conditionPath.size()] == '/' && path.compare(0, conditionPath.size(), conditionPath) == 0;
+        }
+
+        if (matches == condition.isNegated)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Clears the selection of all rows whose value doesn't satisfy the condition.
+ */
+void MetadataQuery::filterColumn(const uint* values, const size_t rowCount, const ValueCondition& condition, uint* selection)
+{
+    // "!=", ">=" and "<=" are evaluated as the opposite of "=", "<" and ">".
+    const bool isNegated = condition.op == CompareOp::NOT_EQUAL || condition.op == CompareOp::GREATER_EQUAL || condition.op == CompareOp::LESS_EQUAL;
+    CompareOp baseOp = condition.op;
+
+    if (isNegated)
+    {
+        baseOp = condition.op == CompareOp::NOT_EQUAL ? CompareOp::EQUAL : condition.op == CompareOp::GREATER_EQUAL ? CompareOp::LESS : CompareOp::GREATER;
+    }
+
+    size_t row = 0;
+
+#ifdef METADATA_QUERY_USE_SSE2
+    // SSE2 only compares signed integers, flipping the top bit of both sides keeps the unsigned order.
+    const __m128i signBit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    const __m128i conditionValue = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(condition.value)), signBit);
+    const __m128i negateMask = isNegated ? _mm_set1_epi32(-1) : _mm_setzero_si128();
+
+    for (; row + 4 <= rowCount; row += 4)
+    {
+        const __m128i rowValues = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + row)), signBit);
+        __m128i matches;
+
+        switch (baseOp)
+        {
+        case CompareOp::EQUAL:
+            matches = _mm_cmpeq_epi32(rowValues, conditionValue);
+            break;
+        case CompareOp::LESS:
+            matches = _mm_cmplt_epi32(rowValues, conditionValue);
+            break;
+        default:
+            matches = _mm_cmpgt_epi32(rowValues, conditionValue);
+            break;
+        }
+
+        __m128i* rowSelection = reinterpret_cast<__m128i*>(selection + row);
+        _mm_storeu_si128(rowSelection, _mm_and_si128(_mm_loadu_si128(rowSelection), _mm_xor_si128(matches, negateMask)));
+    }
+#endif
+
+    for (; row < rowCount; row++)
+    {
+        bool matches;
+
+        switch (baseOp)
+        {
+        case CompareOp::EQUAL:
+            matches = values[row] == condition.value;
+            break;
+        case CompareOp::LESS:
+            matches = values[row] < condition.value;
+            break;
+        default:
+            matches = values[row] > condition.value;
+            break;
+        }
+
+        if (matches == isNegated)
+        {
+            selection[row] = 0;
+        }
+    }
+}
+
+/**
+ * Parses a number with an optional binary K, M or G suffix.
+ */
+uint MetadataQuery::parseNumber(const string value)
+{
+    size_t digitCount = 0;
+    uint64_t number;
+
+    try
+    {
+        number = stoull(value, &digitCount);
+    } catch (std::exception&)
+    {
+        throw invalid_argument("Invalid number: " + value);
+    }
+
+    const string suffix = value.substr(digitCount);
+    int shift = 0;
+
+    if (value[0] == '-' || value[0] == '+' || (!suffix.empty() && suffix.size() != 1))
+    {
+        throw invalid_argument("Invalid number: " + value);
+    } else if (suffix == "K" || suffix == "k")
+    {
+        shift = 10;
+    } else if (suffix == "M" || suffix == "m")
+    {
+        shift = 20;
+    } else if (suffix == "G" || suffix == "g")
+    {
+        shift = 30;
+    } else if (!suffix.empty())
+    {
+        throw invalid_argument("Invalid number: " + value);
+    }
+
+    if (number > (numeric_limits<uint>::max() >> shift))
+    {
+        throw out_of_range("Number does not fit into 32 bits: " + value);
+    }
+
+    return static_cast<uint>(number << shift);
+}
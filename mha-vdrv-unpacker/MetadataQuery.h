@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "BufferedWriter.h"
+#include "MetadataTable.h"
+
+using namespace std;
+
+/**
+ * Filter, projection, sort and group-by over a metadata table, written as NDJSON or CSV.
+ *
+ * Conditions have the form COLUMN OP VALUE, e.g. "size>1M" or "ext=mus". Numbers take an optional K, M or G suffix (binary)
+ * and can be compared with =, !=, <, <=, > and >=; text columns only with = and !=. All conditions have to hold.
+ * Conditions on columns with values are evaluated over the whole column at once, four rows per SSE2 instruction where available,
+ * into a selection mask. Path conditions are only checked for the rows left over after that.
+ *
+ * With a group-by column, one row per distinct value is written with the amount of rows and their summed size
+ * ("count" and "size", which can also be sorted by).
+ */
+class MetadataQuery {
+public:
+    MetadataQuery(MetadataTable& table);
+    void addCondition(const string condition);
+    void addPathPrefix(const string directoryPath);
+    void setSelection(const string columnList);
+    void setGroupBy(const string columnName);
+    void setSortOrder(const string sortSpec);
+    void setLimit(const size_t limit);
+    size_t run(BufferedWriter& out, const string format);
+private:
+    enum class CompareOp { EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+    struct ValueCondition {
+        QueryColumn column;
+        CompareOp op;
+        uint value;
+    };
+
+    struct PathCondition {
+        string normalizedPath;
+        bool isPrefix;
+        bool isNegated;
+    };
+
+    vector<size_t> selectRows();
+    size_t writeRows(vector<size_t>& rows, BufferedWriter& out, const bool isCsv);
+    size_t writeGroups(vector<size_t>& rows, BufferedWriter& out, const bool isCsv);
+    bool matchesPath(const size_t row);
+    static void filterColumn(const uint* values, const size_t rowCount, const ValueCondition& condition, uint* selection);
+    static uint parseNumber(const string value);
+
+    MetadataTable& table;
+    vector<ValueCondition> valueConditions;
+    vector<PathCondition> pathConditions;
+    vector<QueryColumn> selectedColumns;
+    bool isGrouped;
+    QueryColumn groupColumn;
+    string sortColumn;
+    bool isSortDescending;
+    size_t limit;
+};
@@ -0,0 +1,227 @@
+#include "MetadataTable.h"
+
+#include <stdexcept>
+
+#include "PathIndex.h"
+
+using namespace std;
+
+/**
+ * Resolves a column name as used in queries.
+ */
+QueryColumn parseQueryColumn(const string name)
+{
+    static const unordered_map<string, QueryColumn> columnsByName = {
+        { "drive", QueryColumn::DRIVE },
+        { "path", QueryColumn::PATH },
+        { "dir", QueryColumn::DIR },
+        { "ext", QueryColumn::EXT },
+        { "type", QueryColumn::TYPE },
+        { "entryOffset", QueryColumn::ENTRY_OFFSET },
+        { "parentOffset", QueryColumn::PARENT_OFFSET },
+        { "fileStart", QueryColumn::FILE_START },
+        { "size", QueryColumn::SIZE },
+    };
+
+    auto column = columnsByName.find(name);
+
+    if (column == columnsByName.end())
+    {
+        throw invalid_argument("Unknown column: " + name);
+    }
+
+    return column->second;
+}
+
+/**
+ * Gets the name of a column as used in queries.
+ */
+string getQueryColumnName(const QueryColumn column)
+{
+    switch (column)
+    {
+    case QueryColumn::DRIVE: return "drive";
+    case QueryColumn::PATH: return "path";
+    case QueryColumn::DIR: return "dir";
+    case QueryColumn::EXT: return "ext";
+    case QueryColumn::TYPE: return "type";
+    case QueryColumn::ENTRY_OFFSET: return "entryOffset";
+    case QueryColumn::PARENT_OFFSET: return "parentOffset";
+    case QueryColumn::FILE_START: return "fileStart";
+    default: return "size";
+    }
+}
+
+MetadataTable::MetadataTable():
+    driveCodes(), dirCodes(), extCodes(), types(), entryOffsets(), parentOffsets(), fileStarts(), sizes(), paths(), normalizedPaths(),
+    drives(), dirs(), exts(), typeNames()
+{
+    this->encode(this->typeNames, "file", "file");
+    this->encode(this->typeNames, "directory", "directory");
+}
+
+/**
+ * Appends all metadata entries of a drive.
+ */
+void MetadataTable::addDrive(const string drivePath, DriveMetadata& metadata)
+{
+    PathIndex pathIndex(metadata);
+    const uint driveCode = this->encode(this->drives, drivePath, drivePath);
+    const size_t rowCount = this->paths.size() + metadata.getSize();
+
+    for (vector<uint>* values : { &this->driveCodes, &this->dirCodes, &this->extCodes, &this->types, &this->entryOffsets, &this->parentOffsets, &this->fileStarts, &this->sizes })
+    {
+        values->reserve(rowCount);
+    }
+
+    this->paths.reserve(rowCount);
+    this->normalizedPaths.reserve(rowCount);
+
+    for (int pos = 0; pos < metadata.getSize(); pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        const string fullPath = pathIndex.getFullPath(entry);
+        const size_t separator = fullPath.rfind('/');
+        const string dirPath = separator == string::npos ? "" : fullPath.substr(0, separator);
+        string ext;
+
+        if (!entry.isDirectory())
+        {
+            const string fileName = entry.getFileName();
+            const size_t dot = fileName.rfind('.');
+            ext = dot == string::npos ? "" : fileName.substr(dot + 1);
+        }
+
+        this->driveCodes.push_back(driveCode);
+        this->dirCodes.push_back(this->encode(this->dirs, toKey(QueryColumn::DIR, dirPath), dirPath));
+        this->extCodes.push_back(this->encode(this->exts, toKey(QueryColumn::EXT, ext), ext));
+        this->types.push_back(entry.isDirectory() ? 1 : 0);
+        this->entryOffsets.push_back(entry.getEntryOffset());
+        this->parentOffsets.push_back(entry.getParentOffset());
+        this->fileStarts.push_back(entry.getFileStart());
+        this->sizes.push_back(entry.getFileSize());
+        this->paths.push_back(fullPath);
+        this->normalizedPaths.push_back(PathIndex::normalize(fullPath));
+    }
+}
+
+size_t MetadataTable::getRowCount()
+{
+    return this->paths.size();
+}
+
+/**
+ * Gets the values of a column, one per row. The path has no such column.
+ */
+const uint* MetadataTable::getValues(const QueryColumn column)
+{
+    switch (column)
+    {
+    case QueryColumn::DRIVE: return this->driveCodes.data();
+    case QueryColumn::DIR: return this->dirCodes.data();
+    case QueryColumn::EXT: return this->extCodes.data();
+    case QueryColumn::TYPE: return this->types.data();
+    case QueryColumn::ENTRY_OFFSET: return this->entryOffsets.data();
+    case QueryColumn::PARENT_OFFSET: return this->parentOffsets.data();
+    case QueryColumn::FILE_START: return this->fileStarts.data();
+    case QueryColumn::SIZE: return this->sizes.data();
+    default: throw invalid_argument("Column has no values: " + getQueryColumnName(column));
+    }
+}
+
+/**
+ * Checks whether the values of a column are plain numbers rather than dictionary codes.
+ */
+bool MetadataTable::isNumberColumn(const QueryColumn column)
+{
+    return column == QueryColumn::ENTRY_OFFSET || column == QueryColumn::PARENT_OFFSET || column == QueryColumn::FILE_START || column == QueryColumn::SIZE;
+}
+
+/**
+ * Gets the amount of distinct values of a dictionary column.
+ */
+uint MetadataTable::getDictionarySize(const QueryColumn column)
+{
+    return static_cast<uint>(this->getDictionary(column).values.size());
+}
+
+/**
+ * Looks up the code of a value in a dictionary column. Values that don't occur get the dictionary size, which matches no row.
+ */
+uint MetadataTable::findCode(const QueryColumn column, const string value)
+{
+    Dictionary& dictionary = this->getDictionary(column);
+    auto code = dictionary.codesByKey.find(toKey(column, value));
+
+    return code == dictionary.codesByKey.end() ? static_cast<uint>(dictionary.values.size()) : code->second;
+}
+
+const string& MetadataTable::getDictionaryValue(const QueryColumn column, const uint code)
+{
+    return this->getDictionary(column).values.at(code);
+}
+
+/**
+ * Gets the value of a row as text.
+ */
+string MetadataTable::getText(const QueryColumn column, const size_t row)
+{
+    if (column == QueryColumn::PATH)
+    {
+        return this->paths[row];
+    }
+
+    const uint value = this->getValues(column)[row];
+    return this->isNumberColumn(column) ? to_string(value) : this->getDictionaryValue(column, value);
+}
+
+/**
+ * Gets the path of a row, normalized like all paths matched against it.
+ */
+const string& MetadataTable::getNormalizedPath(const size_t row)
+{
+    return this->normalizedPaths[row];
+}
+
+uint MetadataTable::encode(Dictionary& dictionary, const string key, const string& value)
+{
+    auto code = dictionary.codesByKey.emplace(key, static_cast<uint>(dictionary.values.size()));
+
+    if (code.second)
+    {
+        dictionary.values.push_back(value);
+    }
+
+    return code.first->second;
+}
+
+MetadataTable::Dictionary& MetadataTable::getDictionary(const QueryColumn column)
+{
+    switch (column)
+    {
+    case QueryColumn::DRIVE: return this->drives;
+    case QueryColumn::DIR: return this->dirs;
+    case QueryColumn::EXT: return this->exts;
+    case QueryColumn::TYPE: return this->typeNames;
+    default: throw invalid_argument("Column has no dictionary: " + getQueryColumnName(column));
+    }
+}
+
+/**
+ * Gets the key a value of a dictionary column is matched by: directories like paths, extensions without case or leading dot.
+ */
+string MetadataTable::toKey(const QueryColumn column, const string value)
+{
+    if (column == QueryColumn::DIR)
+    {
+        return PathIndex::normalize(value);
+    }
+
+    if (column == QueryColumn::EXT)
+    {
+        const string ext = PathIndex::normalize(value);
+        return ext.empty() || ext[0] != '.' ? ext : ext.substr(1);
+    }
+
+    return value;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DriveMetadata.h"
+
+using namespace std;
+
+/**
+ * Columns of the metadata table, as named in queries.
+ */
+enum class QueryColumn {
+    DRIVE,
+    PATH,
+    DIR,
+    EXT,
+    TYPE,
+    ENTRY_OFFSET,
+    PARENT_OFFSET,
+    FILE_START,
+    SIZE,
+};
+
+QueryColumn parseQueryColumn(const string name);
+string getQueryColumnName(const QueryColumn column);
+
+/**
+ * Column-wise copy of the metadata of one or more drives, for queries.
+ *
+ * Every column except the path is a plain array of 32-bit values, one per entry, so predicates can be evaluated
+ * over a whole column at once. Numbers (offsets, sizes) are stored as they are, the type as 0 (file) or 1 (directory),
+ * and the text columns with few distinct values (drive, parent directory, extension) as codes into a dictionary.
+ * Directories and extensions are matched regardless of case, each dictionary value keeps the first spelling seen.
+ * Entries of all drives are kept as they are, one row each, in the order of the drives and their metadata.
+ */
+class MetadataTable {
+public:
+    MetadataTable();
+    void addDrive(const string drivePath, DriveMetadata& metadata);
+    size_t getRowCount();
+    const uint* getValues(const QueryColumn column);
+    bool isNumberColumn(const QueryColumn column);
+    uint getDictionarySize(const QueryColumn column);
+    uint findCode(const QueryColumn column, const string value);
+    const string& getDictionaryValue(const QueryColumn column, const uint code);
+    string getText(const QueryColumn column, const size_t row);
+    const string& getNormalizedPath(const size_t row);
+private:
+    struct Dictionary {
+        vector<string> values;
+        unordered_map<string, uint> codesByKey;
+    };
+
+    uint encode(Dictionary& dictionary, const string key, const string& value);
+    Dictionary& getDictionary(const QueryColumn column);
+    static string toKey(const QueryColumn column, const string value);
+
+    vector<uint> driveCodes;
+    vector<uint> dirCodes;
+    vector<uint> extCodes;
+    vector<uint> types;
+    vector<uint> entryOffsets;
+    vector<uint> parentOffsets;
+    vector<uint> fileStarts;
+    vector<uint> sizes;
+    vector<string> paths;
+    vector<string> normalizedPaths;
+
+    Dictionary drives;
+    Dictionary dirs;
+    Dictionary exts;
+    Dictionary typeNames;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+#include "CompressedPayload.h"
+
+using namespace std;
+
+/**
+ * Destination for the unpacked drive tree.
+ * Paths are relative to the drive root and always use '/' as separator. Directories are added before their contents.
+ */
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    virtual void addDirectory(const string directoryPath) = 0;
+    virtual int addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize) = 0;
+
+    // Adds a file with the same contents as one added before, without writing them again.
+    // Returns false if the sink can't do that, the file is then added in full instead.
+    virtual bool addLink(const string /* filePath */, const string /* targetPath */) { return false; }
+    virtual void finish() {}
+};
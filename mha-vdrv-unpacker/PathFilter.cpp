@@ -0,0 +1,262 @@
+#include "PathFilter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "PathIndex.h"
+
+using namespace std;
+
+/**
+ * Lower cases ASCII letters, so globs can be compared without regard to case.
+ */
+static char foldCase(const char c)
+{
+    return static_cast<char>(tolower(static_cast<unsigned char>(c)));
+}
+
+PathFilter::PathFilter():
+    includes(), excludes(), isRestricted(false), allowedFiles(), allowedDirectories(), keptDirectories()
+{}
+
+/**
+ * Adds a pattern that files have to match to be unpacked.
+ */
+void PathFilter::addInclude(const string pattern, const bool isRegex)
+{
+    this->includes.push_back(PathFilter::compile(pattern, isRegex));
+}
+
+/**
+ * Adds a pattern for files and directories that must not be unpacked.
+ */
+void PathFilter::addExclude(const string pattern, const bool isRegex)
+{
+    this->excludes.push_back(PathFilter::compile(pattern, isRegex));
+}
+
+/**
+ * Gets whether any rules were added at all.
+ */
+bool PathFilter::isActive()
+{
+    return !this->includes.empty() || !this->excludes.empty() || this->isRestricted;
+}
+
+/**
+ * Gets whether a file with the given full path should be unpacked.
+ */
+bool PathFilter::matchesFile(const string path)
+{
+    if (this->isRestricted && this->allowedFiles.count(PathIndex::normalize(path)) == 0)
+    {
+        return false;
+    }
+
+    const auto matchesPath = [&path](const Pattern& pattern) {
+        return PathFilter::matches(pattern, path);
+    };
+
+    if (any_of(this->excludes.begin(), this->excludes.end(), matchesPath))
+    {
+        return false;
+    }
+
+    return this->includes.empty() || any_of(this->includes.begin(), this->includes.end(), matchesPath);
+}
+
+/**
+ * Gets whether anything below the given directory could still be unpacked. If not, the directory can be skipped entirely.
+ * Only globs with a "/" can rule out a directory, for name globs and regular expressions anything could still match.
+ */
+bool PathFilter::mayMatchBelow(const string directoryPath)
+{
+    if (this->isRestricted && this->allowedDirectories.count(PathIndex::normalize(directoryPath)) == 0)
+    {
+        return false;
+    }
+
+    const string pathPrefix = directoryPath + "/";
+
+    // Excludes can either name the directory itself, or everything in it (like "snd/**").
+    const auto matchesPath = [&directoryPath, &pathPrefix](const Pattern& pattern) {
+        return PathFilter::matches(pattern, directoryPath) || PathFilter::matches(pattern, pathPrefix);
+    };
+
+    if (any_of(this->excludes.begin(), this->excludes.end(), matchesPath))
+    {
+        return false;
+    }
+
+    return this->includes.empty() || any_of(this->includes.begin(), this->includes.end(), [&pathPrefix](const Pattern& pattern) {
+        return pattern.isRegex || pattern.glob.find('/') == string::npos || PathFilter::matchesGlob(pattern.glob.c_str(), pathPrefix.c_str(), true);
+    });
+}
+
+/**
+ * Limits the filter to the given files, on top of the rules. Kept directories are created even if nothing is unpacked into them.
+ */
+void PathFilter::restrictTo(const vector<string>& filePaths, const vector<string>& keptDirectoryPaths)
+{
+    this->isRestricted = true;
+    this->allowedFiles.clear();
+    this->allowedDirectories.clear();
+    this->keptDirectories.clear();
+
+    // Every directory on the way to an allowed path has to be walked into.
+    const auto allowParents = [this](const string& normalizedPath) {
+        for (size_t separator = normalizedPath.find('/'); separator != string::npos; separator = normalizedPath.find('/', separator + 1))
+        {
+            this->allowedDirectories.insert(normalizedPath.substr(0, separator));
+        }
+    };
+
+    for (const string& filePath : filePaths)
+    {
+        const string normalizedPath = PathIndex::normalize(filePath);
+        this->allowedFiles.insert(normalizedPath);
+        allowParents(normalizedPath);
+    }
+
+    for (const string& directoryPath : keptDirectoryPaths)
+    {
+        const string normalizedPath = PathIndex::normalize(directoryPath);
+        this->keptDirectories.insert(normalizedPath);
+        this->allowedDirectories.insert(normalizedPath);
+        allowParents(normalizedPath);
+    }
+}
+
+/**
+ * Gets whether a directory has to be created even if no file is unpacked into it.
+ */
+bool PathFilter::keepsDirectory(const string directoryPath)
+{
+    return this->isRestricted && this->keptDirectories.count(PathIndex::normalize(directoryPath)) > 0;
+}
+
+/**
+ * Prepares a pattern for matching.
+ */
+PathFilter::Pattern PathFilter::compile(const string pattern, const bool isRegex)
+{
+    if (isRegex)
+    {
+        return { pattern, regex(pattern, regex::ECMAScript | regex::icase | regex::optimize), true };
+    }
+
+    return { pattern, regex(), false };
+}
+
+/**
+ * Matches a pattern against a full path.
+ */
+bool PathFilter::matches(const Pattern& pattern, const string path)
+{
+    if (pattern.isRegex)
+    {
+        return regex_match(path, pattern.expression);
+    }
+
+    // Globs without a separator only look at the name of the entry.
+    if (pattern.glob.find('/') == string::npos)
+    {
+        const size_t nameStart = path.rfind('/');
+        return PathFilter::matchesGlob(pattern.glob.c_str(), path.c_str() + (nameStart == string::npos ? 0 : nameStart + 1), false);
+    }
+
+    return PathFilter::matchesGlob(pattern.glob.c_str(), path.c_str(), false);
+}
+
+/**
+ * Recursive glob matcher. With allowPartial, running out of text while there is still pattern left counts as a match,
+ * which tells whether the text is a prefix of anything the glob could match.
+ */
+bool PathFilter::matchesGlob(const char* glob, const char* text, const bool allowPartial)
+{
+    while (*glob != 0)
+    {
+        if (*text == 0 && allowPartial)
+        {
+            return true;
+        }
+
+        if (*glob == '*')
+        {
+            const bool crossesDirectories = glob[1] == '*';
+            glob += crossesDirectories ? 2 : 1;
+
+            // "**/" also matches no directory at all.
+            if (crossesDirectories && *glob == '/' && PathFilter::matchesGlob(glob + 1, text, allowPartial))
+            {
+                return true;
+            }
+
+            // Try every possible length for the wildcard, stopping at a separator unless it is "**".
+            while (true)
+            {
+                if (PathFilter::matchesGlob(glob, text, allowPartial))
+                {
+                    return true;
+                }
+
+                if (*text == 0 || (*text == '/' && !crossesDirectories))
+                {
+                    return false;
+                }
+
+                text++;
+            }
+        }
+
+        if (*text == 0)
+        {
+            return false;
+        }
+
+        if (*glob == '[')
+        {
+            const char* classEnd = strchr(glob + 1, ']');
+
+            if (classEnd != nullptr && *text != '/')
+            {
+                const char* classPos = glob + 1;
+                const bool negated = *classPos == '!' || *classPos == '^';
+                classPos += negated ? 1 : 0;
+
+                bool inClass = false;
+                for (; classPos < classEnd; classPos++)
+                {
+                    if (classPos + 2 < classEnd && classPos[1] == '-')
+                    {
+                        inClass = inClass || (foldCase(*text) >= foldCase(classPos[0]) && foldCase(*text) <= foldCase(classPos[2]));
+                        classPos += 2;
+                    } else
+                    {
+                        inClass = inClass || foldCase(*text) == foldCase(*classPos);
+                    }
+                }
+
+                if (inClass == negated)
+                {
+                    return false;
+                }
+
+                glob = classEnd + 1;
+                text++;
+                continue;
+            }
+        }
+
+        if (*glob == '?' ? *text == '/' : foldCase(*glob) != foldCase(*text))
+        {
+            return false;
+        }
+
+        glob++;
+        text++;
+    }
+
+    return *text == 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <regex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Include and exclude rules on full paths within the drive, used to unpack only part of it.
+ *
+ * Globs support "*" (anything but "/"), "**" (anything, including "/"), "?" and character classes like "[a-z]".
+ * A glob without any "/" is matched against the name of the entry only, at any depth.
+ * Regular expressions have to match the whole path. All matching ignores case, as the game ran on Windows.
+ *
+ * A file is unpacked if it matches any include (or there are none) and no exclude.
+ * A directory that matches an exclude is skipped entirely.
+ *
+ * On top of the rules, the filter can be restricted to a fixed set of files (see Sharding.h). Directories that don't
+ * lead to any of them are skipped, and directories listed as kept are created even without any file in them.
+ */
+class PathFilter {
+public:
+    PathFilter();
+    void addInclude(const string pattern, const bool isRegex);
+    void addExclude(const string pattern, const bool isRegex);
+    bool isActive();
+    bool matchesFile(const string path);
+    bool mayMatchBelow(const string directoryPath);
+    void restrictTo(const vector<string>& filePaths, const vector<string>& keptDirectoryPaths);
+    bool keepsDirectory(const string directoryPath);
+private:
+    struct Pattern {
+        string glob;
+        regex expression;
+        bool isRegex;
+    };
+
+    static Pattern compile(const string pattern, const bool isRegex);
+    static bool matches(const Pattern& pattern, const string path);
+    static bool matchesGlob(const char* glob, const char* text, const bool allowPartial);
+
+    vector<Pattern> includes;
+    vector<Pattern> excludes;
+
+    bool isRestricted;
+    unordered_set<string> allowedFiles;
+    unordered_set<string> allowedDirectories;
+    unordered_set<string> keptDirectories;
+};
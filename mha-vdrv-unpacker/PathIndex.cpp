@@ -0,0 +1,184 @@
+#include "PathIndex.h"
+
+#include <cctype>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std;
+
+/**
+ * Indexes all entries of the metadata.
+ */
+PathIndex::PathIndex(DriveMetadata& metadata):
+    metadata(metadata), positionsByOffset(), childPositionsByOffset(), positionsByPath(), fullPaths(metadata.getSize()),
+    resolvedPaths(metadata.getSize(), false)
+{
+    const int entryCount = metadata.getSize();
+
+    this->positionsByOffset.reserve(entryCount);
+    this->positionsByPath.reserve(entryCount);
+
+    // Metadata entries are identified by their offset, and that is also what children point to.
+    for (int pos = 0; pos < entryCount; pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        this->positionsByOffset[entry.getEntryOffset()] = pos;
+        this->childPositionsByOffset[entry.getParentOffset()].push_back(pos);
+    }
+
+    for (int pos = 0; pos < entryCount; pos++)
+    {
+        this->positionsByPath[PathIndex::normalize(this->resolveFullPath(pos))] = pos;
+    }
+}
+
+/**
+ * Gets whether an entry with the given path exists.
+ */
+bool PathIndex::contains(const string path)
+{
+    return this->positionsByPath.find(PathIndex::normalize(path)) != this->positionsByPath.end();
+}
+
+/**
+ * Resolves a full path within the drive to its entry, regardless of case and separator style.
+ */
+DriveMetadataEntry PathIndex::open(const string path)
+{
+    auto pos = this->positionsByPath.find(PathIndex::normalize(path));
+
+    if (pos == this->positionsByPath.end())
+    {
+        throw out_of_range("Path not found in drive: " + path);
+    }
+
+    return this->metadata.getEntryAt(pos->second);
+}
+
+/**
+ * Gets the full path of an entry within the drive, in its original case.
+ */
+string PathIndex::getFullPath(DriveMetadataEntry entry)
+{
+    auto pos = this->positionsByOffset.find(entry.getEntryOffset());
+
+    if (pos == this->positionsByOffset.end())
+    {
+        throw out_of_range("Entry is not part of the drive.");
+    }
+
+    return this->fullPaths[pos->second];
+}
+
+/**
+ * Lists the entries within a directory. An empty path lists the root of the drive.
+ */
+vector<DriveMetadataEntry> PathIndex::list(const string directoryPath)
+{
+    if (PathIndex::normalize(directoryPath).empty())
+    {
+        return this->metadata.getRootEntries();
+    }
+
+    DriveMetadataEntry directoryEntry = this->open(directoryPath);
+
+    if (!directoryEntry.isDirectory())
+    {
+        throw invalid_argument("Path is not a directory: " + directoryPath);
+    }
+
+    return this->getChildEntries(directoryEntry);
+}
+
+/**
+ * Gets the sub-entries of a directory type entry, in metadata order. Same as DriveMetadata::getChildEntries, without the scan.
+ */
+vector<DriveMetadataEntry> PathIndex::getChildEntries(DriveMetadataEntry entry)
+{
+    vector<DriveMetadataEntry> childEntries;
+    auto childPositions = this->childPositionsByOffset.find(entry.getEntryOffset());
+
+    if (childPositions != this->childPositionsByOffset.end())
+    {
+        for (const int pos : childPositions->second)
+        {
+            childEntries.push_back(this->metadata.getEntryAt(pos));
+        }
+    }
+
+    return childEntries;
+}
+
+/**
+ * Brings a path into the form used as lookup key: "/" separated, without empty components and lower case.
+ */
+string PathIndex::normalize(const string path)
+{
+    string normalizedPath;
+    normalizedPath.reserve(path.size());
+
+    for (const char c : path)
+    {
+        const char normalizedChar = c == '\\' ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+        // Drop leading and repeated separators.
+        if (normalizedChar == '/' && (normalizedPath.empty() || normalizedPath.back() == '/'))
+        {
+            continue;
+        }
+
+        normalizedPath.push_back(normalizedChar);
+    }
+
+    if (!normalizedPath.empty() && normalizedPath.back() == '/')
+    {
+        normalizedPath.pop_back();
+    }
+
+    return normalizedPath;
+}
+
+/**
+ * Builds the full path of an entry from its parent chain, remembering the result for every entry on the way.
+ * Walks the chain iteratively, so deep or looping hierarchies in a damaged drive cannot exhaust the stack.
+ */
+const string& PathIndex::resolveFullPath(const int pos)
+{
+    // Collects the entries up to the root or up to the first one that is already resolved.
+    vector<int> chain;
+    unordered_set<int> visited;
+
+    for (int current = pos; current >= 0 && !this->resolvedPaths[current];)
+    {
+        if (!visited.insert(current).second)
+        {
+            throw out_of_range("Found a loop in the directory structure.");
+        }
+
+        chain.push_back(current);
+
+        DriveMetadataEntry entry = this->metadata.getEntryAt(current);
+        auto parentPos = this->positionsByOffset.find(entry.getParentOffset());
+
+        current = entry.getParentOffset() == 0 || parentPos == this->positionsByOffset.end() ? -1 : parentPos->second;
+    }
+
+    // Resolves the collected entries from the top down, each one below the one resolved before.
+    for (auto current = chain.rbegin(); current != chain.rend(); current++)
+    {
+        DriveMetadataEntry entry = this->metadata.getEntryAt(*current);
+        auto parentPos = this->positionsByOffset.find(entry.getParentOffset());
+
+        if (entry.getParentOffset() == 0 || parentPos == this->positionsByOffset.end())
+        {
+            this->fullPaths[*current] = entry.getFileName();
+        } else
+        {
+            this->fullPaths[*current] = this->fullPaths[parentPos->second] + "/" + entry.getFileName();
+        }
+
+        this->resolvedPaths[*current] = true;
+    }
+
+    return this->fullPaths[pos];
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DriveMetadata.h"
+
+using namespace std;
+
+/**
+ * Lookup structures over the drive metadata, built once in a single pass:
+ * - full paths (normalized: case folded, "/" separated) to entries, for constant time access to single files,
+ * - a tree of child lists per directory (a trie over the path components), for directory listings.
+ */
+class PathIndex {
+public:
+    PathIndex(DriveMetadata& metadata);
+    bool contains(const string path);
+    DriveMetadataEntry open(const string path);
+    string getFullPath(DriveMetadataEntry entry);
+    vector<DriveMetadataEntry> list(const string directoryPath);
+    vector<DriveMetadataEntry> getChildEntries(DriveMetadataEntry entry);
+    static string normalize(const string path);
+private:
+    const string& resolveFullPath(const int pos);
+
+    DriveMetadata& metadata;
+    unordered_map<uint, int> positionsByOffset;
+    unordered_map<uint, vector<int>> childPositionsByOffset;
+    unordered_map<string, int> positionsByPath;
+    vector<string> fullPaths;
+    // Kept apart from fullPaths, as an entry with an empty name legitimately resolves to an empty path.
+    vector<bool> resolvedPaths;
+};
@@ -0,0 +1,246 @@
+#include "SeekIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * Amount of compressed data read from the drive at once when inflating from a checkpoint.
+ */
+constexpr size_t SEEK_INDEX_INPUT_CHUNK_SIZE = 0x10000;
+
+/**
+ * Builds the index in a single pass over the compressed stream.
+ */
+SeekIndex::SeekIndex(CompressedPayload& payload):
+    points(), uncompressedSize(0), compressedSize(payload.getSize()), isStoredOnly(false)
+{
+    uLong blockStart = 0;
+
+    this->isStoredOnly = payload.walkStoredBlocks([this, &blockStart, &payload](const unsigned char* block, uint blockLength) {
+        const uint compressedOffset = static_cast<uint>(block - payload.getData());
+        this->points.push_back({ blockStart, compressedOffset, blockLength, 0, {} });
+        blockStart += blockLength;
+    });
+
+    if (this->isStoredOnly)
+    {
+        this->uncompressedSize = blockStart;
+        return;
+    }
+
+    this->points.clear();
+    this->buildCheckpoints(payload);
+}
+
+/**
+ * Gets the size of the data once inflated.
+ */
+uLong SeekIndex::getUncompressedSize()
+{
+    return this->uncompressedSize;
+}
+
+/**
+ * Reads a range of the uncompressed data. Only the compressed data from the closest seek point on is read and inflated.
+ * Returns the amount of bytes copied, which is less than requested if the range goes beyond the end of the data.
+ */
+uLong SeekIndex::read(const uLong offset, unsigned char* destBuf, const uLong length, const CompressedRangeReader& readCompressed)
+{
+    if (offset >= this->uncompressedSize || length == 0)
+    {
+        return 0;
+    }
+
+    const uLong usableLength = min(length, this->uncompressedSize - offset);
+
+    if (this->isStoredOnly)
+    {
+        return this->readStored(offset, destBuf, usableLength, readCompressed);
+    }
+
+    return this->readFromCheckpoint(offset, destBuf, usableLength, readCompressed);
+}
+
+/**
+ * Inflates the whole stream once with Z_BLOCK, remembering a checkpoint at the first block boundary after every
+ * SEEK_INDEX_SPACING bytes of output. The output itself only goes into a circular window buffer.
+ */
+void SeekIndex::buildCheckpoints(CompressedPayload& payload)
+{
+    unique_ptr<unsigned char[]> window(new unsigned char[SEEK_INDEX_WINDOW_SIZE]);
+
+    z_stream stream = {};
+    stream.next_in = const_cast<unsigned char*>(payload.getData());
+    stream.avail_in = payload.getSize();
+
+    if (inflateInit(&stream) != Z_OK)
+    {
+        throw runtime_error("Could not initialize zlib.");
+    }
+
+    uLong totalIn = 0;
+    uLong totalOut = 0;
+    uLong lastPointOut = 0;
+    int result;
+
+    do
+    {
+        if (stream.avail_out == 0)
+        {
+            stream.next_out = &window[0];
+            stream.avail_out = SEEK_INDEX_WINDOW_SIZE;
+        }
+
+        totalIn += stream.avail_in;
+        totalOut += stream.avail_out;
+        result = inflate(&stream, Z_BLOCK);
+        totalIn -= stream.avail_in;
+        totalOut -= stream.avail_out;
+
+        if (result != Z_OK && result != Z_STREAM_END)
+        {
+            inflateEnd(&stream);
+            throw runtime_error("Compressed file is corrupt.");
+        }
+
+        // Bit 7 of data_type marks the end of a block header, bit 6 the end of the last block.
+        const bool isBlockBoundary = (stream.data_type & 128) != 0 && (stream.data_type & 64) == 0;
+
+        if (result == Z_OK && isBlockBoundary && (this->points.empty() || totalOut - lastPointOut > SEEK_INDEX_SPACING))
+        {
+            // Only the output so far is history, the window is not full until it wrapped around once.
+            SeekPoint point = { totalOut, static_cast<uint>(totalIn), 0, stream.data_type & 7, vector<unsigned char>() };
+
+            if (totalOut < SEEK_INDEX_WINDOW_SIZE)
+            {
+                point.window.assign(&window[0], &window[totalOut]);
+            } else
+            {
+                // Unroll the circular window, so the oldest byte comes first.
+                const size_t windowFill = stream.avail_out;
+                point.window.resize(SEEK_INDEX_WINDOW_SIZE);
+                memcpy(point.window.data(), &window[SEEK_INDEX_WINDOW_SIZE - windowFill], windowFill);
+                memcpy(point.window.data() + windowFill, &window[0], SEEK_INDEX_WINDOW_SIZE - windowFill);
+            }
+
+            this->points.push_back(move(point));
+            lastPointOut = totalOut;
+        }
+    } while (result != Z_STREAM_END);
+
+    inflateEnd(&stream);
+    this->uncompressedSize = totalOut;
+}
+
+/**
+ * Finds the last seek point at or before the given uncompressed offset.
+ */
+size_t SeekIndex::findPoint(const uLong offset)
+{
+    auto nextPoint = upper_bound(this->points.begin(), this->points.end(), offset, [](const uLong value, const SeekPoint& point) {
+        return value < point.uncompressedOffset;
+    });
+
+    return nextPoint == this->points.begin() ? 0 : static_cast<size_t>(nextPoint - this->points.begin()) - 1;
+}
+
+/**
+ * Copies a range straight out of the stored blocks it spans.
+ */
+uLong SeekIndex::readStored(const uLong offset, unsigned char* destBuf, const uLong length, const CompressedRangeReader& readCompressed)
+{
+    uLong bytesRead = 0;
+
+    for (size_t pointIndex = this->findPoint(offset); bytesRead < length && pointIndex < this->points.size(); pointIndex++)
+    {
+        const SeekPoint& point = this->points[pointIndex];
+        const uLong offsetInBlock = offset + bytesRead - point.uncompressedOffset;
+        const uLong chunkLength = min<uLong>(point.storedLength - offsetInBlock, length - bytesRead);
+
+        readCompressed(point.compressedOffset + static_cast<uint>(offsetInBlock), destBuf + bytesRead, chunkLength);
+        bytesRead += chunkLength;
+    }
+
+    return bytesRead;
+}
+
+/**
+ * Resumes inflating at the closest checkpoint, skips the output up to the offset and inflates the range itself.
+ */
+uLong SeekIndex::readFromCheckpoint(const uLong offset, unsigned char* destBuf, const uLong length, const CompressedRangeReader& readCompressed)
+{
+    const SeekPoint& point = this->points[this->findPoint(offset)];
+
+    z_stream stream = {};
+    if (inflateInit2(&stream, -15) != Z_OK)
+    {
+        throw runtime_error("Could not initialize zlib.");
+    }
+
+    unique_ptr<unsigned char[]> inputBuf(new unsigned char[SEEK_INDEX_INPUT_CHUNK_SIZE]);
+    uint compressedPos = point.compressedOffset;
+
+    // A checkpoint can lie in the middle of a byte, whose remaining bits have to be fed in first.
+    if (point.bits != 0)
+    {
+        unsigned char partialByte;
+        readCompressed(compressedPos - 1, &partialByte, 1);
+        inflatePrime(&stream, point.bits, partialByte >> (8 - point.bits));
+    }
+
+    if (!point.window.empty())
+    {
+        inflateSetDictionary(&stream, point.window.data(), static_cast<uInt>(point.window.size()));
+    }
+
+    unique_ptr<unsigned char[]> discardBuf(new unsigned char[SEEK_INDEX_WINDOW_SIZE]);
+    uLong bytesToSkip = offset - point.uncompressedOffset;
+    uLong bytesRead = 0;
+    int result = Z_OK;
+
+    while (bytesRead < length && result == Z_OK)
+    {
+        if (stream.avail_in == 0)
+        {
+            // The adler32 trailer is not part of the raw deflate stream.
+            const uint inputLength = static_cast<uint>(min<size_t>(SEEK_INDEX_INPUT_CHUNK_SIZE, this->compressedSize - compressedPos));
+
+            if (inputLength == 0)
+            {
+                break;
+            }
+
+            readCompressed(compressedPos, &inputBuf[0], inputLength);
+            compressedPos += inputLength;
+            stream.next_in = &inputBuf[0];
+            stream.avail_in = inputLength;
+        }
+
+        if (bytesToSkip > 0)
+        {
+            stream.next_out = &discardBuf[0];
+            stream.avail_out = static_cast<uInt>(min<uLong>(bytesToSkip, SEEK_INDEX_WINDOW_SIZE));
+            result = inflate(&stream, Z_NO_FLUSH);
+            bytesToSkip -= stream.next_out - &discardBuf[0];
+        } else
+        {
+            stream.next_out = destBuf + bytesRead;
+            stream.avail_out = static_cast<uInt>(length - bytesRead);
+            result = inflate(&stream, Z_NO_FLUSH);
+            bytesRead = static_cast<uLong>(stream.next_out - destBuf);
+        }
+    }
+
+    inflateEnd(&stream);
+
+    if (result != Z_OK && result != Z_STREAM_END)
+    {
+        throw runtime_error("Compressed file is corrupt.");
+    }
+
+    return bytesRead;
+}
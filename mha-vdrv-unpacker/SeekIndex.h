@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "CompressedPayload.h"
+
+using namespace std;
+
+/**
+ * Distance between two checkpoints of a compressed stream, in uncompressed bytes.
+ */
+constexpr uLong SEEK_INDEX_SPACING = 0x100000;
+
+/**
+ * Size of the deflate window, which is all the history needed to resume inflating at a block boundary.
+ */
+constexpr size_t SEEK_INDEX_WINDOW_SIZE = 0x8000;
+
+/**
+ * Reads a chunk of the compressed stream of an entry, with the position relative to the start of the stream.
+ */
+using CompressedRangeReader = function<void(const uint from, unsigned char* destBuf, const size_t length)>;
+
+/**
+ * Seek points into a zlib stream, so a range of the uncompressed data can be read without inflating everything before it.
+ *
+ * Streams made up of stored blocks only (which is what the game uses) get one point per block, and ranges are
+ * copied straight out of the blocks. Anything else gets a checkpoint every SEEK_INDEX_SPACING bytes at the next block
+ * boundary, holding the bit position and up to 32 KiB of window needed to resume inflating there (like zlib's zran example).
+ */
+class SeekIndex {
+public:
+    SeekIndex(CompressedPayload& payload);
+    uLong getUncompressedSize();
+    uLong read(const uLong offset, unsigned char* destBuf, const uLong length, const CompressedRangeReader& readCompressed);
+private:
+    struct SeekPoint {
+        uLong uncompressedOffset;
+        uint compressedOffset;
+        uint storedLength;
+        int bits;
+        vector<unsigned char> window;
+    };
+
+    void buildCheckpoints(CompressedPayload& payload);
+    size_t findPoint(const uLong offset);
+    uLong readStored(const uLong offset, unsigned char* destBuf, const uLong length, const CompressedRangeReader& readCompressed);
+    uLong readFromCheckpoint(const uLong offset, unsigned char* destBuf, const uLong length, const CompressedRangeReader& readCompressed);
+
+    vector<SeekPoint> points;
+    uLong uncompressedSize;
+    uint compressedSize;
+    bool isStoredOnly;
+};
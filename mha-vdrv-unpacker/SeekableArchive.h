@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Layout of the seekable archive format written by SeekableArchiveSink.
+ *
+ * [header]   magic "VDSA", uint32 version
+ * [frames]   independent zlib streams, every file is split into frames of at most SEEKABLE_FRAME_SIZE bytes
+ * [index]    per entry: uint16 path length, path, uint8 is directory, uint64 uncompressed size, uint32 frame count,
+ *            then per frame: uint64 archive offset, uint32 compressed size, uint32 uncompressed size
+ * [footer]   uint64 index offset, uint32 entry count, magic "VDSX"
+ *
+ * All values are little endian. The footer has a fixed size, so a reader can find the index from the end of the file
+ * and then only needs to inflate the frames of the files it actually wants.
+ */
+constexpr char SEEKABLE_HEADER_MAGIC[4] = { 'V', 'D', 'S', 'A' };
+constexpr char SEEKABLE_FOOTER_MAGIC[4] = { 'V', 'D', 'S', 'X' };
+constexpr uint32_t SEEKABLE_VERSION = 1;
+constexpr size_t SEEKABLE_HEADER_SIZE = 8;
+constexpr size_t SEEKABLE_FOOTER_SIZE = 16;
+
+/**
+ * Maximum amount of uncompressed data per frame. Also bounds how much has to be inflated for a partial read.
+ */
+constexpr size_t SEEKABLE_FRAME_SIZE = 0x100000;
+
+/**
+ * Maximum length of an entry path, the index stores it as a uint16.
+ */
+constexpr size_t SEEKABLE_MAXIMUM_PATH_LENGTH = 0xFFFF;
+
+struct SeekableFrame {
+    uint64_t offset;
+    uint32_t compressedSize;
+    uint32_t uncompressedSize;
+};
+
+struct SeekableEntry {
+    string path;
+    bool isDirectory;
+    uint64_t uncompressedSize;
+    vector<SeekableFrame> frames;
+};
@@ -0,0 +1,172 @@
+#include "SeekableArchiveReader.h"
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "PathIndex.h"
+#include "zlib.h"
+
+using namespace std;
+
+/**
+ * Reads a little endian value of the given width from a buffer and moves past it.
+ */
+static uint64_t readValue(const unsigned char*& pos, const unsigned char* end, const size_t width)
+{
+    if (static_cast<size_t>(end - pos) < width)
+    {
+        throw out_of_range("Archive index is truncated.");
+    }
+
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; i++)
+    {
+        value |= static_cast<uint64_t>(pos[i]) << (8 * i);
+    }
+
+    pos += width;
+    return value;
+}
+
+/**
+ * Opens the archive and loads its index.
+ */
+SeekableArchiveReader::SeekableArchiveReader(const char* archivePath):
+    in(archivePath, std::ios::binary), entries()
+{
+    if (!this->in.is_open())
+    {
+        throw runtime_error("Could not open archive.");
+    }
+
+    this->readIndex();
+}
+
+/**
+ * Gets whether the archive holds an entry with the given path, compared case insensitively and with either separator.
+ */
+bool SeekableArchiveReader::contains(const string path)
+{
+    return this->entries.find(PathIndex::normalize(path)) != this->entries.end();
+}
+
+/**
+ * Gets the index entry of a path, compared the same way as in contains.
+ */
+SeekableEntry SeekableArchiveReader::getEntry(const string path)
+{
+    auto entry = this->entries.find(PathIndex::normalize(path));
+
+    if (entry == this->entries.end())
+    {
+        throw out_of_range("Path not found in archive.");
+    }
+
+    return entry->second;
+}
+
+/**
+ * Inflates the frames of a single file one after another and hands each of them to the consumer.
+ */
+void SeekableArchiveReader::readFile(const string path, const function<void(const unsigned char*, size_t)>& consumer)
+{
+    const SeekableEntry entry = this->getEntry(path);
+
+    if (entry.isDirectory)
+    {
+        throw invalid_argument("Path is a directory.");
+    }
+
+    vector<unsigned char> compressedBuf;
+    unique_ptr<unsigned char[]> frameBuf(new unsigned char[SEEKABLE_FRAME_SIZE]);
+
+    for (const SeekableFrame& frame : entry.frames)
+    {
+        if (frame.uncompressedSize > SEEKABLE_FRAME_SIZE)
+        {
+            throw out_of_range("Archive frame is too large.");
+        }
+
+        compressedBuf.resize(frame.compressedSize);
+        this->in.seekg(frame.offset);
+        this->in.read(reinterpret_cast<char*>(compressedBuf.data()), frame.compressedSize);
+
+        uLongf frameLength = frame.uncompressedSize;
+        if (!this->in || uncompress(&frameBuf[0], &frameLength, compressedBuf.data(), frame.compressedSize) != Z_OK || frameLength != frame.uncompressedSize)
+        {
+            throw runtime_error("Archive frame is corrupt.");
+        }
+
+        consumer(&frameBuf[0], frameLength);
+    }
+}
+
+/**
+ * Locates the index through the footer and parses it into the path lookup.
+ */
+void SeekableArchiveReader::readIndex()
+{
+    this->in.seekg(0, std::ios::end);
+    const uint64_t archiveSize = static_cast<uint64_t>(this->in.tellg());
+
+    if (archiveSize < SEEKABLE_HEADER_SIZE + SEEKABLE_FOOTER_SIZE)
+    {
+        throw out_of_range("Archive is too short.");
+    }
+
+    unsigned char footer[SEEKABLE_FOOTER_SIZE];
+    this->in.seekg(archiveSize - SEEKABLE_FOOTER_SIZE);
+    this->in.read(reinterpret_cast<char*>(footer), sizeof(footer));
+
+    if (memcmp(footer + 12, SEEKABLE_FOOTER_MAGIC, sizeof(SEEKABLE_FOOTER_MAGIC)) != 0)
+    {
+        throw runtime_error("Not a seekable archive.");
+    }
+
+    const unsigned char* footerPos = footer;
+    const uint64_t indexOffset = readValue(footerPos, footer + sizeof(footer), 8);
+    const uint64_t entryCount = readValue(footerPos, footer + sizeof(footer), 4);
+
+    if (indexOffset < SEEKABLE_HEADER_SIZE || indexOffset > archiveSize - SEEKABLE_FOOTER_SIZE)
+    {
+        throw out_of_range("Archive index offset is invalid.");
+    }
+
+    vector<unsigned char> index(archiveSize - SEEKABLE_FOOTER_SIZE - indexOffset);
+    this->in.seekg(indexOffset);
+    this->in.read(reinterpret_cast<char*>(index.data()), index.size());
+
+    const unsigned char* pos = index.data();
+    const unsigned char* end = index.data() + index.size();
+
+    for (uint64_t i = 0; i < entryCount; i++)
+    {
+        SeekableEntry entry;
+
+        const size_t pathLength = static_cast<size_t>(readValue(pos, end, 2));
+        if (static_cast<size_t>(end - pos) < pathLength)
+        {
+            throw out_of_range("Archive index is truncated.");
+        }
+
+        entry.path.assign(reinterpret_cast<const char*>(pos), pathLength);
+        pos += pathLength;
+
+        entry.isDirectory = readValue(pos, end, 1) != 0;
+        entry.uncompressedSize = readValue(pos, end, 8);
+
+        const uint64_t frameCount = readValue(pos, end, 4);
+        for (uint64_t j = 0; j < frameCount; j++)
+        {
+            SeekableFrame frame;
+            frame.offset = readValue(pos, end, 8);
+            frame.compressedSize = static_cast<uint32_t>(readValue(pos, end, 4));
+            frame.uncompressedSize = static_cast<uint32_t>(readValue(pos, end, 4));
+            entry.frames.push_back(frame);
+        }
+
+        const string key = PathIndex::normalize(entry.path);
+        this->entries[key] = move(entry);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+
+#include "SeekableArchive.h"
+
+using namespace std;
+
+/**
+ * Reads single files back from an archive written by SeekableArchiveSink, inflating only the frames of that file.
+ */
+class SeekableArchiveReader {
+public:
+    SeekableArchiveReader(const char* archivePath);
+    bool contains(const string path);
+    SeekableEntry getEntry(const string path);
+    void readFile(const string path, const function<void(const unsigned char*, size_t)>& consumer);
+private:
+    void readIndex();
+
+    std::ifstream in;
+    // Keyed by the normalized path, see PathIndex::normalize.
+    unordered_map<string, SeekableEntry> entries;
+};
@@ -0,0 +1,167 @@
+#include "SeekableArchiveSink.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * Amount of frames that may be in flight per worker, bounds the memory held by compressed but unwritten frames.
+ */
+constexpr size_t SEEKABLE_PENDING_FRAMES_PER_WORKER = 4;
+
+/**
+ * Appends a little endian value of the given width to a record.
+ */
+static void appendValue(string& record, uint64_t value, const size_t width)
+{
+    for (size_t i = 0; i < width; i++)
+    {
+        record.push_back(static_cast<char>(value & 0xFF));
+        value >>= 8;
+    }
+}
+
+/**
+ * Makes sure a path fits into the uint16 length field of the index.
+ */
+static void checkPathLength(const string& path)
+{
+    if (path.size() > SEEKABLE_MAXIMUM_PATH_LENGTH)
+    {
+        throw out_of_range("Path is too long for a seekable archive.");
+    }
+}
+
+/**
+ * Opens the archive for writing and starts the compression workers.
+ * compressionLevel: zlib compression level of the frames, from 1 (fastest) to 9 (smallest).
+ */
+SeekableArchiveSink::SeekableArchiveSink(const string archivePath, const size_t writeBufferSize, const unsigned int threadCount, const int compressionLevel):
+    out(archivePath, writeBufferSize), workers(threadCount), compressionLevel(compressionLevel), entries(), pendingFrames()
+{
+    string header(SEEKABLE_HEADER_MAGIC, sizeof(SEEKABLE_HEADER_MAGIC));
+    appendValue(header, SEEKABLE_VERSION, 4);
+
+    this->out.write(header.data(), header.size());
+}
+
+/**
+ * Adds a directory to the index, directories have no frames.
+ */
+void SeekableArchiveSink::addDirectory(const string directoryPath)
+{
+    checkPathLength(directoryPath);
+
+    this->entries.push_back({ directoryPath, true, 0, {} });
+}
+
+/**
+ * Inflates a file, splits it into frames and queues them for compression.
+ * Returns the zlib status code of the decompression.
+ */
+int SeekableArchiveSink::addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize)
+{
+    checkPathLength(filePath);
+
+    // The frames of a file share one buffer, which is released once the last of them is compressed.
+    shared_ptr<unsigned char[]> uncompressedBuf(new unsigned char[uncompressedSize]);
+    const int decompressionResult = payload.inflateTo(uncompressedBuf.get(), uncompressedSize);
+
+    if (decompressionResult != Z_OK)
+    {
+        return decompressionResult;
+    }
+
+    this->entries.push_back({ filePath, false, uncompressedSize, {} });
+    const size_t entryIndex = this->entries.size() - 1;
+    const int level = this->compressionLevel;
+
+    for (uLong frameStart = 0; frameStart < uncompressedSize; frameStart += SEEKABLE_FRAME_SIZE)
+    {
+        const uLong frameLength = min<uLong>(SEEKABLE_FRAME_SIZE, uncompressedSize - frameStart);
+
+        auto task = make_shared<packaged_task<vector<unsigned char>()>>([uncompressedBuf, frameStart, frameLength, level]() {
+            uLongf compressedLength = compressBound(frameLength);
+            vector<unsigned char> compressedData(compressedLength);
+
+            if (compress2(compressedData.data(), &compressedLength, uncompressedBuf.get() + frameStart, frameLength, level) != Z_OK)
+            {
+                throw runtime_error("Could not compress frame.");
+            }
+
+            compressedData.resize(compressedLength);
+            return compressedData;
+        });
+
+        this->pendingFrames.push_back({ entryIndex, static_cast<uint32_t>(frameLength), task->get_future() });
+        this->workers.submit([task]() {
+            (*task)();
+        });
+
+        this->writePendingFrames(this->workers.getThreadCount() * SEEKABLE_PENDING_FRAMES_PER_WORKER);
+    }
+
+    return Z_OK;
+}
+
+/**
+ * Writes out all remaining frames, followed by the index and the footer.
+ */
+void SeekableArchiveSink::finish()
+{
+    this->writePendingFrames(0);
+    this->writeIndex();
+    this->out.flush();
+}
+
+/**
+ * Writes frames in the order they were queued, waiting for their compression until at most maximumPending are left.
+ */
+void SeekableArchiveSink::writePendingFrames(const size_t maximumPending)
+{
+    while (this->pendingFrames.size() > maximumPending)
+    {
+        PendingFrame& frame = this->pendingFrames.front();
+        const vector<unsigned char> compressedData = frame.compressedData.get();
+
+        this->entries[frame.entryIndex].frames.push_back({ this->out.getBytesWritten(), static_cast<uint32_t>(compressedData.size()), frame.uncompressedSize });
+        this->out.write(compressedData.data(), compressedData.size());
+
+        this->pendingFrames.pop_front();
+    }
+}
+
+/**
+ * Writes the index of all entries and the fixed size footer pointing to it.
+ */
+void SeekableArchiveSink::writeIndex()
+{
+    const uint64_t indexOffset = this->out.getBytesWritten();
+
+    for (const SeekableEntry& entry : this->entries)
+    {
+        string record;
+        appendValue(record, entry.path.size(), 2);
+        record += entry.path;
+        appendValue(record, entry.isDirectory ? 1 : 0, 1);
+        appendValue(record, entry.uncompressedSize, 8);
+        appendValue(record, entry.frames.size(), 4);
+
+        for (const SeekableFrame& frame : entry.frames)
+        {
+            appendValue(record, frame.offset, 8);
+            appendValue(record, frame.compressedSize, 4);
+            appendValue(record, frame.uncompressedSize, 4);
+        }
+
+        this->out.write(record.data(), record.size());
+    }
+
+    string footer;
+    appendValue(footer, indexOffset, 8);
+    appendValue(footer, this->entries.size(), 4);
+    footer.append(SEEKABLE_FOOTER_MAGIC, sizeof(SEEKABLE_FOOTER_MAGIC));
+
+    this->out.write(footer.data(), footer.size());
+}
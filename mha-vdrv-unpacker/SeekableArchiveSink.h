@@ -0,0 +1,39 @@
+#pragma once
+
+#include <deque>
+#include <future>
+#include <memory>
+
+#include "BufferedWriter.h"
+#include "OutputSink.h"
+#include "SeekableArchive.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+/**
+ * Writes the drive into a compressed archive that still allows random access to single files (see SeekableArchive.h).
+ * Frames are compressed on a worker pool, while this sink writes the finished ones out in order.
+ */
+class SeekableArchiveSink : public OutputSink {
+public:
+    SeekableArchiveSink(const string archivePath, const size_t writeBufferSize, const unsigned int threadCount, const int compressionLevel);
+    void addDirectory(const string directoryPath) override;
+    int addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize) override;
+    void finish() override;
+private:
+    struct PendingFrame {
+        size_t entryIndex;
+        uint32_t uncompressedSize;
+        future<vector<unsigned char>> compressedData;
+    };
+
+    void writePendingFrames(const size_t maximumPending);
+    void writeIndex();
+
+    BufferedWriter out;
+    WorkerPool workers;
+    const int compressionLevel;
+    vector<SeekableEntry> entries;
+    deque<PendingFrame> pendingFrames;
+};
@@ -0,0 +1,295 @@
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+
+#include "CompressedPayload.h"
+#include "DriveFileSystem.h"
+#include "EntryCache.h"
+#include "PathIndex.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+SelfTest::SelfTest():
+    failures()
+{}
+
+/**
+ * Runs all checks against a drive and lists the failed ones. Returns whether everything passed.
+ */
+bool SelfTest::run(const string drivePath)
+{
+    this->failures.clear();
+
+    cout << "Testing " << drivePath << "..." << endl;
+
+    try
+    {
+        VDRV vdrv(drivePath.c_str());
+        DriveMetadata metadata = vdrv.readMetadata();
+
+        this->checkFileSystem(drivePath, vdrv, metadata);
+        this->checkEntryCache();
+        this->checkCachedReads(vdrv, metadata);
+    } catch (std::exception& e)
+    {
+        cout << "=> Tests could not run: " << e.what() << endl;
+        return false;
+    }
+
+    for (const string& failure : this->failures)
+    {
+        cout << "* " << failure << endl;
+    }
+
+    cout << (this->failures.empty() ? "=> OK." : "=> " + to_string(this->failures.size()) + " check(s) failed.") << endl;
+    return this->failures.empty();
+}
+
+/**
+ * Reads every file through a file system, sequentially in all of SELF_TEST_CHUNK_LENGTHS and at random positions,
+ * and compares the result with the file inflated as a whole. The reference is read through a drive of its own,
+ * so it does not interfere with the file system's reads and read-ahead.
+ */
+void SelfTest::checkFileSystem(const string& drivePath, VDRV& vdrv, DriveMetadata& metadata)
+{
+    VDRV referenceDrive(drivePath.c_str());
+    PathIndex index(metadata);
+    WorkerPool workers(2);
+    DriveFileSystem fileSystem(vdrv, metadata);
+
+    fileSystem.setPrefetchHook([&workers](function<void()> task) {
+        workers.submit(task);
+    });
+
+    // Seeded with something fixed, so a failure shows up again on the next run.
+    mt19937 random(static_cast<unsigned int>(metadata.getSize()));
+    int fileCount = 0;
+
+    for (int pos = 0; pos < metadata.getSize(); pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        const string path = index.getFullPath(entry);
+
+        // Entries sharing their path with another one can't be opened by path.
+        if (entry.isDirectory() || index.open(path).getEntryOffset() != entry.getEntryOffset())
+        {
+            continue;
+        }
+
+        vector<char> expected;
+
+        try
+        {
+            CompressedPayload payload(referenceDrive.readCompressedFile(entry), entry.getFileSize());
+            expected.resize(payload.getUncompressedSize());
+
+            if (payload.inflateTo(reinterpret_cast<unsigned char*>(expected.data()), expected.size()) != Z_OK)
+            {
+                continue;
+            }
+        } catch (std::exception&)
+        {
+            continue;
+        }
+
+        try
+        {
+            const uLong size = fileSystem.stat(path).size;
+
+            if (size != expected.size())
+            {
+                this->addFailure(path, "stat reports " + to_string(size) + " B instead of " + to_string(expected.size()) + " B");
+            }
+
+            for (const uLong chunkLength : SELF_TEST_CHUNK_LENGTHS)
+            {
+                const int handle = fileSystem.open(path);
+                vector<char> actual;
+                vector<char> chunk(chunkLength);
+                uLong bytesRead;
+
+                while ((bytesRead = fileSystem.read(handle, chunk.data(), chunkLength)) > 0)
+                {
+                    actual.insert(actual.end(), chunk.begin(), chunk.begin() + bytesRead);
+                }
+
+                fileSystem.close(handle);
+
+                if (actual != expected)
+                {
+                    this->addFailure(path, "reading in chunks of " + to_string(chunkLength) + " B gives different data");
+                }
+            }
+
+            const int handle = fileSystem.open(path);
+
+            for (int i = 0; i < SELF_TEST_SEEKS_PER_FILE; i++)
+            {
+                const uLong position = random() % (expected.size() + 1);
+                const uLong length = random() % 0x20000 + 1;
+                const uLong expectedLength = min<uLong>(length, expected.size() - position);
+                vector<char> actual(length);
+
+                fileSystem.seek(handle, position);
+                actual.resize(fileSystem.read(handle, actual.data(), length));
+
+                if (actual.size() != expectedLength || !equal(actual.begin(), actual.end(), expected.begin() + position))
+                {
+                    this->addFailure(path, "reading " + to_string(length) + " B at " + to_string(position) + " gives different data");
+                }
+            }
+
+            fileSystem.close(handle);
+        } catch (std::exception& e)
+        {
+            this->addFailure(path, e.what());
+        }
+
+        fileCount++;
+    }
+
+    cout << "=> Read " << fileCount << " files back through the file system." << endl;
+}
+
+/**
+ * Fills a cache shard to its budget and checks which entries are evicted once it overflows, and what is counted on the way.
+ * All keys share their payload offset, so they land in the same shard.
+ */
+void SelfTest::checkEntryCache()
+{
+    EntryCache cache(ENTRY_CACHE_SHARD_COUNT * 300);
+    const auto makeKey = [](const uint number) {
+        return (uint64_t(1) << 32) | number;
+    };
+    const auto makeData = [](const size_t size) {
+        return make_shared<const vector<char>>(size, '\0');
+    };
+
+    cache.put(makeKey(1), makeData(100));
+    cache.put(makeKey(2), makeData(100));
+    cache.put(makeKey(3), makeData(100));
+
+    // Using the oldest entry makes the second one the least recently used, which the fourth entry then pushes out.
+    const bool isFirstCached = cache.get(makeKey(1)) != nullptr;
+    cache.put(makeKey(4), makeData(100));
+
+    const bool isSecondEvicted = cache.get(makeKey(2)) == nullptr;
+    const bool areOthersCached = cache.get(makeKey(1)) && cache.get(makeKey(3)) && cache.get(makeKey(4));
+
+    // Data over the shard budget is never cached, and doesn't evict anything either.
+    cache.put(makeKey(5), makeData(301));
+    const bool isOversizedSkipped = cache.get(makeKey(5)) == nullptr && cache.get(makeKey(4)) != nullptr;
+
+    if (!isFirstCached || !isSecondEvicted || !areOthersCached || !isOversizedSkipped)
+    {
+        this->addFailure("entry cache", "entries are not evicted in least recently used order");
+    }
+
+    EntryCacheStats stats = cache.getStats();
+
+    if (stats.hits != 5 || stats.misses != 2 || stats.evictions != 1 || stats.bytes != 300)
+    {
+        this->addFailure("entry cache", "counted " + to_string(stats.hits) + " hits, " + to_string(stats.misses) + " misses, "
+            + to_string(stats.evictions) + " evictions and " + to_string(stats.bytes) + " B instead of 5, 2, 1 and 300 B");
+    }
+
+    // Without a budget for it, the compressed tier stores nothing and counts nothing.
+    cache.putCompressed(makeKey(1), makeData(100));
+
+    if (cache.getCompressed(makeKey(1)) != nullptr || cache.getStats().compressedMisses != 0)
+    {
+        this->addFailure("entry cache", "the compressed tier is used without a budget");
+    }
+}
+
+/**
+ * Reads up to SELF_TEST_CACHED_FILES small files twice through a file system with a cache large enough for all of them.
+ * The second pass has to be served from the cache entirely.
+ */
+void SelfTest::checkCachedReads(VDRV& vdrv, DriveMetadata& metadata)
+{
+    PathIndex index(metadata);
+    DriveFileSystem fileSystem(vdrv, metadata);
+    vector<string> paths;
+    size_t totalBytes = 0;
+
+    for (int pos = 0; pos < metadata.getSize() && paths.size() < SELF_TEST_CACHED_FILES; pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        const string path = index.getFullPath(entry);
+
+        if (entry.isDirectory() || entry.getFileSize() >= SEEK_INDEX_CACHE_MINIMUM_SIZE || index.open(path).getEntryOffset() != entry.getEntryOffset())
+        {
+            continue;
+        }
+
+        try
+        {
+            totalBytes += fileSystem.stat(path).size;
+            paths.push_back(path);
+        } catch (std::exception&)
+        {
+            continue;
+        }
+    }
+
+    // Every shard gets the whole budget the files need, so nothing can be evicted however they are spread.
+    EntryCache cache((totalBytes + 1) * ENTRY_CACHE_SHARD_COUNT);
+    fileSystem.setCache(&cache);
+
+    const auto readAll = [&fileSystem](const string& path) {
+        const int handle = fileSystem.open(path);
+        char chunk[0x10000];
+
+        while (fileSystem.read(handle, chunk, sizeof(chunk)) > 0)
+        {}
+
+        fileSystem.close(handle);
+    };
+
+    try
+    {
+        for (const string& path : paths)
+        {
+            readAll(path);
+        }
+
+        EntryCacheStats firstPass = cache.getStats();
+
+        for (const string& path : paths)
+        {
+            readAll(path);
+        }
+
+        EntryCacheStats secondPass = cache.getStats();
+
+        if (firstPass.hits + firstPass.misses != paths.size())
+        {
+            this->addFailure("cached reads", "looked up the cache " + to_string(firstPass.hits + firstPass.misses) + " times for " + to_string(paths.size()) + " files");
+        }
+
+        if (secondPass.hits - firstPass.hits != paths.size() || secondPass.misses != firstPass.misses || secondPass.evictions != 0)
+        {
+            this->addFailure("cached reads", "reading " + to_string(paths.size()) + " files again gave " + to_string(secondPass.hits - firstPass.hits)
+                + " hits, " + to_string(secondPass.misses - firstPass.misses) + " misses and " + to_string(secondPass.evictions) + " evictions");
+        }
+    } catch (std::exception& e)
+    {
+        this->addFailure("cached reads", e.what());
+    }
+
+    cout << "=> Read " << paths.size() << " small files twice through a cache." << endl;
+}
+
+/**
+ * Notes a failed check of a file.
+ */
+void SelfTest::addFailure(const string& path, const string& problem)
+{
+    this->failures.push_back(path + ": " + problem);
+}
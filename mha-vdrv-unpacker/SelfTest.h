@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "DriveMetadata.h"
+#include "VDRV.h"
+
+using namespace std;
+
+/**
+ * Chunk lengths the files are read back in, odd ones included so reads never line up with windows or blocks.
+ */
+constexpr uLong SELF_TEST_CHUNK_LENGTHS[] = { 0x1000, 777, 0x10001 };
+
+/**
+ * Amount of random positions every file is read from after it was read sequentially.
+ */
+constexpr int SELF_TEST_SEEKS_PER_FILE = 8;
+
+/**
+ * Amount of small files read twice through a cached file system, which bounds the memory the cache check takes.
+ */
+constexpr size_t SELF_TEST_CACHED_FILES = 64;
+
+/**
+ * Checks the random access paths of the tool against a real drive: every file read through a DriveFileSystem, with
+ * read-ahead on a worker and in odd sized chunks and after seeks, has to match the file inflated as a whole.
+ * The EntryCache is checked on its own for its eviction order and counters, and along with the file system for reading
+ * files a second time without inflating them again.
+ * Meant to be run against the drives at hand whenever the file system changes, as there is no reference unpack to diff against.
+ *
+ * Files that don't inflate at all are skipped, damaged drives are what "verify" is for.
+ */
+class SelfTest {
+public:
+    SelfTest();
+    bool run(const string drivePath);
+private:
+    void checkFileSystem(const string& drivePath, VDRV& vdrv, DriveMetadata& metadata);
+    void checkEntryCache();
+    void checkCachedReads(VDRV& vdrv, DriveMetadata& metadata);
+    void addFailure(const string& path, const string& problem);
+
+    vector<string> failures;
+};
@@ -0,0 +1,263 @@
+#include "Sha256.h"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SHA256_USE_SHANI
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHA256_TARGET
+#else
+#include <cpuid.h>
+#define SHA256_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#endif
+#endif
+
+using namespace std;
+
+/**
+ * Round constants, the first 32 bits of the fractional parts of the cube roots of the first 64 primes.
+ */
+alignas(16) static const uint32_t SHA256_ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotateRight(const uint32_t value, const int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+/**
+ * Runs the compression function over whole 64 byte blocks.
+ */
+static void compressBlocks(uint32_t state[8], const unsigned char* data, size_t blockCount)
+{
+    for (; blockCount > 0; blockCount--, data += 64)
+    {
+        uint32_t schedule[64];
+
+        for (int i = 0; i < 16; i++)
+        {
+            schedule[i] = (static_cast<uint32_t>(data[i * 4]) << 24) | (data[i * 4 + 1] << 16) | (data[i * 4 + 2] << 8) | data[i * 4 + 3];
+        }
+
+        for (int i = 16; i < 64; i++)
+        {
+            const uint32_t s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+            const uint32_t s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++)
+        {
+            const uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_ROUND_CONSTANTS[i] + schedule[i];
+            const uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA256_USE_SHANI
+
+/**
+ * Checks once whether the CPU supports the SHA extensions, along with the SSSE3 and SSE4.1 shuffles around them.
+ */
+static bool canUseShaExtensions()
+{
+#ifdef _MSC_VER
+    static const bool supported = []() {
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 1);
+        const bool hasSse = (cpuInfo[2] & (1 << 9)) != 0 && (cpuInfo[2] & (1 << 19)) != 0;
+        __cpuidex(cpuInfo, 7, 0);
+        return hasSse && (cpuInfo[1] & (1 << 29)) != 0;
+    }();
+#else
+    static const bool supported = []() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & (1 << 9)) == 0 || (ecx & (1 << 19)) == 0)
+        {
+            return false;
+        }
+
+        return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 29)) != 0;
+    }();
+#endif
+
+    return supported;
+}
+
+/**
+ * Compression function on the SHA extensions, after Intel's "New Instructions Supporting the Secure Hash Algorithm".
+ * The state is kept as ABEF and CDGH halves, every sha256rnds2 does two rounds, and the message schedule is expanded
+ * four words at a time with sha256msg1/sha256msg2.
+ */
+SHA256_TARGET static void compressBlocksShaExtensions(uint32_t state[8], const unsigned char* data, size_t blockCount)
+{
+    const __m128i byteSwapMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blockCount > 0; blockCount--, data += 64)
+    {
+        const __m128i savedState0 = state0;
+        const __m128i savedState1 = state1;
+        __m128i messages[4];
+
+        // 16 groups of four rounds. Groups 0 to 3 load the message, the others use the expanded schedule.
+        for (int group = 0; group < 16; group++)
+        {
+            __m128i& current = messages[group % 4];
+            __m128i& next = messages[(group + 1) % 4];
+            __m128i& previous = messages[(group + 3) % 4];
+
+            if (group < 4)
+            {
+                current = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + group * 16)), byteSwapMask);
+            }
+
+            __m128i message = _mm_add_epi32(current, _mm_load_si128(reinterpret_cast<const __m128i*>(&SHA256_ROUND_CONSTANTS[group * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+
+            if (group >= 3 && group <= 14)
+            {
+                next = _mm_add_epi32(next, _mm_alignr_epi8(current, previous, 4));
+                next = _mm_sha256msg2_epu32(next, current);
+            }
+
+            message = _mm_shuffle_epi32(message, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+
+            if (group >= 1 && group <= 12)
+            {
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, savedState0);
+        state1 = _mm_add_epi32(state1, savedState1);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+#endif
+
+/**
+ * Picks the fastest compression function the CPU supports.
+ */
+static void compress(uint32_t state[8], const unsigned char* data, size_t blockCount)
+{
+#ifdef SHA256_USE_SHANI
+    if (canUseShaExtensions())
+    {
+        compressBlocksShaExtensions(state, data, blockCount);
+        return;
+    }
+#endif
+
+    compressBlocks(state, data, blockCount);
+}
+
+Sha256::Sha256():
+    state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+    buffer(), bufferedLength(0), totalLength(0)
+{}
+
+/**
+ * Hashes another chunk of data. Whole blocks are hashed right away, the rest is kept until the next call.
+ */
+void Sha256::update(const unsigned char* data, size_t length)
+{
+    this->totalLength += length;
+
+    if (this->bufferedLength > 0)
+    {
+        const size_t fillLength = min(length, sizeof(this->buffer) - this->bufferedLength);
+        memcpy(this->buffer + this->bufferedLength, data, fillLength);
+        this->bufferedLength += fillLength;
+        data += fillLength;
+        length -= fillLength;
+
+        if (this->bufferedLength < sizeof(this->buffer))
+        {
+            return;
+        }
+
+        compress(this->state, this->buffer, 1);
+        this->bufferedLength = 0;
+    }
+
+    const size_t blockCount = length / sizeof(this->buffer);
+    compress(this->state, data, blockCount);
+    data += blockCount * sizeof(this->buffer);
+    length -= blockCount * sizeof(this->buffer);
+
+    memcpy(this->buffer, data, length);
+    this->bufferedLength = length;
+}
+
+/**
+ * Pads the message and gets the hash as 64 lower case hex digits. The object can't be used any further afterwards.
+ */
+string Sha256::digestHex()
+{
+    const uint64_t bitLength = this->totalLength * 8;
+    unsigned char padding[72] = { 0x80 };
+
+    // Pad with a single set bit and zeros up to 56 bytes into a block, followed by the message length in bits.
+    const size_t paddingLength = (this->bufferedLength < 56 ? 56 : 120) - this->bufferedLength;
+    for (int i = 0; i < 8; i++)
+    {
+        padding[paddingLength + i] = static_cast<unsigned char>(bitLength >> (56 - i * 8));
+    }
+
+    this->update(padding, paddingLength + 8);
+
+    char hex[65];
+    for (int i = 0; i < 8; i++)
+    {
+        snprintf(hex + i * 8, 9, "%08x", this->state[i]);
+    }
+
+    return hex;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/**
+ * Streaming SHA-256, for checksums that other tools (sha256sum and friends) can check as well.
+ * Uses the SHA extensions of the CPU where available, and a plain implementation otherwise.
+ */
+class Sha256 {
+public:
+    Sha256();
+    void update(const unsigned char* data, size_t length);
+    string digestHex();
+private:
+    uint32_t state[8];
+    unsigned char buffer[64];
+    size_t bufferedLength;
+    uint64_t totalLength;
+};
@@ -0,0 +1,102 @@
+#include "Sharding.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+#include "PathIndex.h"
+
+using namespace std;
+
+/**
+ * Parses a shard given as "i/n", with i counting from 1.
+ */
+bool parseShard(const string shardSpec, int& shardIndex, int& shardCount)
+{
+    const size_t separator = shardSpec.find('/');
+
+    if (separator == string::npos)
+    {
+        return false;
+    }
+
+    shardIndex = atoi(shardSpec.substr(0, separator).c_str()) - 1;
+    shardCount = atoi(shardSpec.substr(separator + 1).c_str());
+
+    return shardCount > 0 && shardIndex >= 0 && shardIndex < shardCount;
+}
+
+/**
+ * Restricts the filter to the part of the drive that belongs to one shard (counting from 0).
+ */
+ShardSummary restrictToShard(DriveOverlay& overlay, PathFilter& filter, const int shardIndex, const int shardCount)
+{
+    // The size is listed first, so sorting puts the largest files first.
+    vector<tuple<uint64_t, string, string>> files;
+    vector<string> emptyDirectories;
+
+    // Walks the tree just like the unpacker does, returns whether any file below the directory gets unpacked.
+    const function<bool(const string&)> collectFiles = [&](const string& directoryPath) {
+        bool hasFiles = false;
+
+        for (OverlayEntry childEntry : overlay.list(directoryPath))
+        {
+            const string childPath = directoryPath + "/" + childEntry.entry.getFileName();
+
+            if (!childEntry.entry.isDirectory())
+            {
+                if (filter.matchesFile(childPath))
+                {
+                    files.emplace_back(childEntry.entry.getFileSize(), PathIndex::normalize(childPath), childPath);
+                    hasFiles = true;
+                }
+            } else if (filter.mayMatchBelow(childPath))
+            {
+                hasFiles = collectFiles(childPath) || hasFiles;
+            }
+        }
+
+        // Only an unfiltered unpack creates directories that end up empty.
+        if (!hasFiles && !filter.isActive())
+        {
+            emptyDirectories.push_back(directoryPath);
+        }
+
+        return hasFiles;
+    };
+
+    for (OverlayEntry rootEntry : overlay.list(""))
+    {
+        if (rootEntry.entry.isDirectory() && filter.mayMatchBelow(rootEntry.entry.getFileName()))
+        {
+            collectFiles(rootEntry.entry.getFileName());
+        }
+    }
+
+    sort(files.begin(), files.end(), [](const auto& left, const auto& right) {
+        return get<0>(left) != get<0>(right) ? get<0>(left) > get<0>(right) : get<1>(left) < get<1>(right);
+    });
+
+    vector<uint64_t> shardBytes(shardCount, 0);
+    vector<string> shardFiles;
+    ShardSummary summary = { 0, 0 };
+
+    for (const auto& file : files)
+    {
+        const int targetShard = static_cast<int>(min_element(shardBytes.begin(), shardBytes.end()) - shardBytes.begin());
+        shardBytes[targetShard] += get<0>(file);
+
+        if (targetShard == shardIndex)
+        {
+            shardFiles.push_back(get<2>(file));
+            summary.fileCount++;
+            summary.compressedBytes += get<0>(file);
+        }
+    }
+
+    filter.restrictTo(shardFiles, shardIndex == 0 ? emptyDirectories : vector<string>());
+
+    return summary;
+}
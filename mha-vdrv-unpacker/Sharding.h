@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include "DriveOverlay.h"
+#include "PathFilter.h"
+
+using namespace std;
+
+/**
+ * What a shard ended up with.
+ */
+struct ShardSummary {
+    size_t fileCount;
+    uint64_t compressedBytes;
+};
+
+/**
+ * Splits the unpack of a drive across several processes that write into the same output.
+ *
+ * The files the filter lets through are dealt out to the shards largest first, each to the shard with the fewest bytes
+ * so far (ties broken by path, then by shard number). That only depends on the metadata, so every process computes
+ * the same split independently, and it stays the same across runs. Directories without any file below them go to
+ * the first shard, so the shards together produce exactly what a single unpack would.
+ */
+bool parseShard(const string shardSpec, int& shardIndex, int& shardCount);
+ShardSummary restrictToShard(DriveOverlay& overlay, PathFilter& filter, const int shardIndex, const int shardCount);
@@ -0,0 +1,196 @@
+#include "SparseFile.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPARSE_USE_SSE2
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/**
+ * Checks whether a chunk of memory only contains zeros.
+ * Ors together 64 bytes at a time and only compares once per round, bailing out at the first round with a set bit.
+ */
+bool isAllZero(const unsigned char* data, size_t length)
+{
+    size_t pos = 0;
+
+#ifdef SPARSE_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; pos + 64 <= length; pos += 64)
+    {
+        const __m128i* chunk = reinterpret_cast<const __m128i*>(data + pos);
+        const __m128i combined = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128(chunk), _mm_loadu_si128(chunk + 1)),
+            _mm_or_si128(_mm_loadu_si128(chunk + 2), _mm_loadu_si128(chunk + 3))
+        );
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(combined, zero)) != 0xFFFF)
+        {
+            return false;
+        }
+    }
+#endif
+
+    for (; pos < length; pos++)
+    {
+        if (data[pos] != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Finds all block aligned runs of zeros that are long enough to be turned into holes.
+ * The trailing partial block is never part of a span.
+ */
+vector<ZeroSpan> findZeroSpans(const unsigned char* data, size_t size)
+{
+    vector<ZeroSpan> spans;
+    size_t spanStart = 0;
+    size_t spanLength = 0;
+
+    for (size_t pos = 0; pos + SPARSE_BLOCK_SIZE <= size; pos += SPARSE_BLOCK_SIZE)
+    {
+        if (isAllZero(data + pos, SPARSE_BLOCK_SIZE))
+        {
+            if (spanLength == 0)
+            {
+                spanStart = pos;
+            }
+
+            spanLength += SPARSE_BLOCK_SIZE;
+            continue;
+        }
+
+        if (spanLength >= SPARSE_MINIMUM_SPAN)
+        {
+            spans.push_back({ spanStart, spanLength });
+        }
+
+        spanLength = 0;
+    }
+
+    if (spanLength >= SPARSE_MINIMUM_SPAN)
+    {
+        spans.push_back({ spanStart, spanLength });
+    }
+
+    return spans;
+}
+
+#ifdef _WIN32
+
+/**
+ * Writes a buffer to a new file, skipping over all large zero spans so they end up as holes.
+ * The file is flagged as sparse first, otherwise NTFS would still allocate the skipped ranges.
+ */
+void writeSparseFile(const string filePath, const unsigned char* data, size_t size)
+{
+    HANDLE fileHandle = CreateFileA(filePath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Could not create output file.");
+    }
+
+    DWORD bytesReturned = 0;
+    DeviceIoControl(fileHandle, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &bytesReturned, nullptr);
+
+    vector<ZeroSpan> spans = findZeroSpans(data, size);
+    spans.push_back({ size, 0 });
+
+    size_t pos = 0;
+    bool successful = true;
+
+    for (const ZeroSpan& span : spans)
+    {
+        LARGE_INTEGER filePointer;
+        filePointer.QuadPart = static_cast<LONGLONG>(pos);
+        successful = successful && SetFilePointerEx(fileHandle, filePointer, nullptr, FILE_BEGIN);
+
+        while (successful && pos < span.start)
+        {
+            DWORD bytesWritten = 0;
+            const DWORD chunkLength = static_cast<DWORD>(min<size_t>(span.start - pos, 0x40000000));
+            successful = WriteFile(fileHandle, data + pos, chunkLength, &bytesWritten, nullptr) && bytesWritten > 0;
+            pos += bytesWritten;
+        }
+
+        pos = span.start + span.length;
+    }
+
+    // Trailing holes are not covered by any write, so the file size has to be set explicitly.
+    LARGE_INTEGER endOfFile;
+    endOfFile.QuadPart = static_cast<LONGLONG>(size);
+    successful = successful && SetFilePointerEx(fileHandle, endOfFile, nullptr, FILE_BEGIN) && SetEndOfFile(fileHandle);
+
+    CloseHandle(fileHandle);
+
+    if (!successful)
+    {
+        throw runtime_error("Could not write output file.");
+    }
+}
+
+#else
+
+/**
+ * Writes a buffer to a new file, skipping over all large zero spans so they end up as holes.
+ */
+void writeSparseFile(const string filePath, const unsigned char* data, size_t size)
+{
+    const int fd = open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        throw runtime_error("Could not create output file.");
+    }
+
+    vector<ZeroSpan> spans = findZeroSpans(data, size);
+    spans.push_back({ size, 0 });
+
+    size_t pos = 0;
+    bool successful = true;
+
+    for (const ZeroSpan& span : spans)
+    {
+        while (successful && pos < span.start)
+        {
+            const ssize_t bytesWritten = pwrite(fd, data + pos, span.start - pos, pos);
+            successful = bytesWritten > 0;
+            pos += successful ? bytesWritten : 0;
+        }
+
+        pos = span.start + span.length;
+    }
+
+    // Trailing holes are not covered by any write, so the file size has to be set explicitly.
+    successful = successful && ftruncate(fd, size) == 0;
+
+    close(fd);
+
+    if (!successful)
+    {
+        throw runtime_error("Could not write output file.");
+    }
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Granularity of the zero scan. Holes can only be created for whole file system blocks, so spans are block aligned.
+ */
+constexpr size_t SPARSE_BLOCK_SIZE = 0x1000;
+
+/**
+ * Zero runs shorter than this are just written out, a hole would not be worth the extra extent.
+ */
+constexpr size_t SPARSE_MINIMUM_SPAN = 0x8000;
+
+/**
+ * A block aligned range of a file that consists of zeros only.
+ */
+struct ZeroSpan {
+    size_t start;
+    size_t length;
+};
+
+bool isAllZero(const unsigned char* data, size_t length);
+vector<ZeroSpan> findZeroSpans(const unsigned char* data, size_t size);
+void writeSparseFile(const string filePath, const unsigned char* data, size_t size);
@@ -0,0 +1,192 @@
+#include "StoreSink.h"
+
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include "Xxh64.h"
+
+using namespace std;
+
+/**
+ * Opens (or creates) the store and starts the tree of a drive over, the objects stay untouched.
+ * The tree name has to be a plain file name, as the tree gets deleted first.
+ */
+StoreSink::StoreSink(const filesystem::path storeRoot, const string treeName):
+    storeRoot(storeRoot), treeRoot(storeRoot / "trees" / treeName), treeName(treeName), canLink(true),
+    manifestLines(), hashesByPath(), writtenObjects(0), writtenBytes(0), reusedObjects(0), reusedBytes(0)
+{
+    if (treeName.empty() || treeName == "." || treeName.find("..") != string::npos || treeName.find_first_of("/\\:") != string::npos)
+    {
+        throw invalid_argument("Invalid tree name: " + treeName);
+    }
+
+    filesystem::create_directories(this->storeRoot / "objects");
+    filesystem::remove_all(this->treeRoot);
+    filesystem::create_directories(this->treeRoot);
+}
+
+/**
+ * Creates the directory in the tree.
+ */
+void StoreSink::addDirectory(const string directoryPath)
+{
+    filesystem::create_directories(this->treeRoot / filesystem::path(directoryPath).make_preferred());
+    this->manifestLines.push_back("D " + directoryPath);
+}
+
+/**
+ * Inflates a file into a temporary object while hashing it, then moves it to its place in the store,
+ * unless the store has the same data already. Returns the zlib status code of the decompression.
+ */
+int StoreSink::addFile(const string filePath, CompressedPayload& payload, const uLong /* uncompressedSize */)
+{
+    // Written under a name of its own and renamed, so other processes sharing the store never see a partial object.
+    static random_device randomSource;
+    const filesystem::path tempPath = this->storeRoot / "objects" / ("incoming" + to_string(randomSource()) + ".tmp");
+    Xxh64 hasher;
+    uintmax_t size = 0;
+    int decompressionResult;
+
+    try
+    {
+        ofstream objectFile(tempPath, ios::out | ios::binary | ios::trunc);
+
+        decompressionResult = payload.inflateChunks([&objectFile, &hasher, &size](const unsigned char* chunk, size_t chunkLength) {
+            hasher.update(chunk, chunkLength);
+            objectFile.write(reinterpret_cast<const char*>(chunk), chunkLength);
+            size += chunkLength;
+        });
+
+        if (!objectFile.flush())
+        {
+            throw runtime_error("Could not write object " + tempPath.string());
+        }
+    } catch (std::exception&)
+    {
+        error_code removeError;
+        filesystem::remove(tempPath, removeError);
+        throw;
+    }
+
+    if (decompressionResult != Z_OK)
+    {
+        filesystem::remove(tempPath);
+        return decompressionResult;
+    }
+
+    const string hash = Xxh64::toHex(hasher.digest());
+    const filesystem::path objectPath = this->getObjectPath(hash);
+    error_code sizeError;
+    const uintmax_t existingSize = filesystem::file_size(objectPath, sizeError);
+
+    if (!sizeError)
+    {
+        filesystem::remove(tempPath);
+
+        // A 64 bit hash is plenty to tell files apart, but not so much that a size mismatch can be ignored.
+        if (existingSize != size)
+        {
+            throw runtime_error("Hash collision in the store: " + filePath + " and object " + hash);
+        }
+
+        this->reusedObjects++;
+        this->reusedBytes += size;
+    } else
+    {
+        filesystem::create_directories(objectPath.parent_path());
+        filesystem::rename(tempPath, objectPath);
+
+        this->writtenObjects++;
+        this->writtenBytes += size;
+    }
+
+    this->linkIntoTree(filePath, hash);
+    this->manifestLines.push_back("F " + hash + " " + to_string(size) + " " + filePath);
+    this->hashesByPath[filePath] = hash;
+
+    return Z_OK;
+}
+
+/**
+ * Adds a file with the same data as one added before, which is the same object.
+ */
+bool StoreSink::addLink(const string filePath, const string targetPath)
+{
+    auto targetHash = this->hashesByPath.find(targetPath);
+
+    if (targetHash == this->hashesByPath.end())
+    {
+        return false;
+    }
+
+    const string hash = targetHash->second;
+    const uintmax_t size = filesystem::file_size(this->getObjectPath(hash));
+
+    this->linkIntoTree(filePath, hash);
+    this->manifestLines.push_back("F " + hash + " " + to_string(size) + " " + filePath);
+    this->hashesByPath[filePath] = hash;
+
+    this->reusedObjects++;
+    this->reusedBytes += size;
+
+    return true;
+}
+
+/**
+ * Writes the manifest of the tree and sums up how much of the drive was new to the store.
+ */
+void StoreSink::finish()
+{
+    const filesystem::path manifestPath = this->storeRoot / "trees" / (this->treeName + ".manifest");
+    filesystem::path tempPath = manifestPath;
+    tempPath += ".tmp";
+
+    {
+        ofstream out(tempPath, ios::out | ios::trunc);
+
+        for (const string& line : this->manifestLines)
+        {
+            out << line << "\n";
+        }
+
+        if (!out.flush())
+        {
+            throw runtime_error("Could not write " + tempPath.string());
+        }
+    }
+
+    filesystem::rename(tempPath, manifestPath);
+
+    cout << endl << "=> Store: " << this->writtenObjects << " new objects (" << this->writtenBytes << " B), ";
+    cout << this->reusedObjects << " files already stored (" << this->reusedBytes << " B)." << endl;
+}
+
+/**
+ * Gets where the object with the given hash lives, spread over 256 directories by its first two digits.
+ */
+filesystem::path StoreSink::getObjectPath(const string& hash)
+{
+    return this->storeRoot / "objects" / hash.substr(0, 2) / hash.substr(2);
+}
+
+/**
+ * Makes a file of the tree a hard link to its object. Once that fails, the tree is left to the manifest.
+ */
+void StoreSink::linkIntoTree(const string& filePath, const string& hash)
+{
+    if (!this->canLink)
+    {
+        return;
+    }
+
+    error_code linkError;
+    filesystem::create_hard_link(this->getObjectPath(hash), this->treeRoot / filesystem::path(filePath).make_preferred(), linkError);
+
+    if (linkError)
+    {
+        cout << "Could not create hard links in the store (" << linkError.message() << "), only the manifest lists the files of the tree." << endl;
+        this->canLink = false;
+    }
+}
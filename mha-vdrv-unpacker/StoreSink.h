@@ -0,0 +1,48 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OutputSink.h"
+
+using namespace std;
+
+/**
+ * Unpacks drives into a content-addressed store shared by all of them, so data that several drives (or several versions
+ * of the same drive) have in common is only stored once.
+ *
+ * Layout below the store root:
+ * - objects/ab/cdef0123456789: the unpacked data of a file, named after its XXH64 hash (see Xxh64.h),
+ * - trees/NAME/...: the tree of a drive, every file being a hard link to its object,
+ * - trees/NAME.manifest: the same tree as a list, "D path" per directory and "F hash size path" per file.
+ *
+ * The hash is computed while inflating, and objects that are in the store already are not written again.
+ * Where hard links are not supported, only the manifest describes the tree.
+ */
+class StoreSink : public OutputSink {
+public:
+    StoreSink(const filesystem::path storeRoot, const string treeName);
+    void addDirectory(const string directoryPath) override;
+    int addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize) override;
+    bool addLink(const string filePath, const string targetPath) override;
+    void finish() override;
+private:
+    filesystem::path getObjectPath(const string& hash);
+    void linkIntoTree(const string& filePath, const string& hash);
+
+    const filesystem::path storeRoot;
+    const filesystem::path treeRoot;
+    const string treeName;
+    bool canLink;
+
+    // Lines of the manifest, and the hash of every file added so far.
+    vector<string> manifestLines;
+    unordered_map<string, string> hashesByPath;
+
+    uint64_t writtenObjects;
+    uint64_t writtenBytes;
+    uint64_t reusedObjects;
+    uint64_t reusedBytes;
+};
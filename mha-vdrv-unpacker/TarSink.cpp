@@ -0,0 +1,164 @@
+#include "TarSink.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+/**
+ * Opens the archive for writing. An archive path of "-" writes to stdout.
+ * writeBufferSize: Amount of data collected before it is handed to the OS in a single write.
+ * modificationTime: Timestamp put on every entry, the drive itself does not store any.
+ */
+TarSink::TarSink(const string archivePath, const size_t writeBufferSize, const time_t modificationTime):
+    out(archivePath, writeBufferSize), modificationTime(modificationTime)
+{}
+
+/**
+ * Adds a directory entry to the archive.
+ */
+void TarSink::addDirectory(const string directoryPath)
+{
+    this->writeHeader(directoryPath + "/", 0, '5');
+}
+
+/**
+ * Adds a file entry to the archive, streaming its data straight from the decompressor.
+ * Returns the zlib status code of the decompression.
+ */
+int TarSink::addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize)
+{
+    this->writeHeader(filePath, uncompressedSize, '0');
+
+    uLong bytesWritten = 0;
+    const int decompressionResult = payload.inflateChunks([this, &bytesWritten, uncompressedSize](const unsigned char* chunk, size_t chunkLength) {
+        // Never write more than announced in the header, that would break the archive structure.
+        const size_t usableLength = min<uLong>(chunkLength, uncompressedSize - bytesWritten);
+        this->out.write(chunk, usableLength);
+        bytesWritten += usableLength;
+    });
+
+    // Keep the archive well formed even if the data turned out to be short.
+    if (bytesWritten < uncompressedSize)
+    {
+        const vector<char> zeros(uncompressedSize - bytesWritten, 0);
+        this->out.write(zeros.data(), zeros.size());
+    }
+
+    this->writeBlockPadding(uncompressedSize);
+
+    return decompressionResult;
+}
+
+/**
+ * Adds a hard link entry pointing at a file added before, which takes up a single header block.
+ * Targets too long for the link name field are left to a full copy.
+ */
+bool TarSink::addLink(const string filePath, const string targetPath)
+{
+    if (targetPath.size() > 100)
+    {
+        return false;
+    }
+
+    this->writeHeader(filePath, 0, '1', targetPath);
+    return true;
+}
+
+/**
+ * Writes the end of archive marker (two empty blocks) and flushes everything out.
+ */
+void TarSink::finish()
+{
+    const char endOfArchive[TAR_BLOCK_SIZE * 2] = {};
+    this->out.write(endOfArchive, sizeof(endOfArchive));
+    this->out.flush();
+}
+
+/**
+ * Writes a ustar header block.
+ * Paths that do not fit into the name and prefix fields get an additional pax header carrying the full path.
+ */
+void TarSink::writeHeader(const string path, const uLong size, const char typeFlag, const string linkName)
+{
+    char header[TAR_BLOCK_SIZE] = {};
+    string name = path;
+    string prefix;
+
+    if (path.size() > 100)
+    {
+        // Try to split the path at a separator, so that the tail fits the name field and the head the prefix field.
+        size_t splitPos = path.rfind('/', min<size_t>(path.size() - 2, 155));
+
+        while (splitPos != string::npos && path.size() - splitPos - 1 > 100)
+        {
+            splitPos = splitPos == 0 ? string::npos : path.rfind('/', splitPos - 1);
+        }
+
+        if (splitPos != string::npos && splitPos > 0)
+        {
+            prefix = path.substr(0, splitPos);
+            name = path.substr(splitPos + 1);
+        } else
+        {
+            this->writePathExtension(path);
+            name = path.substr(0, 100);
+        }
+    }
+
+    memcpy(header, name.data(), name.size());
+    snprintf(header + 100, 8, "%07o", typeFlag == '5' ? 0755 : 0644);
+    snprintf(header + 108, 8, "%07o", 0);
+    snprintf(header + 116, 8, "%07o", 0);
+    snprintf(header + 124, 12, "%011llo", static_cast<unsigned long long>(size));
+    snprintf(header + 136, 12, "%011llo", static_cast<unsigned long long>(this->modificationTime));
+    memset(header + 148, ' ', 8);
+    header[156] = typeFlag;
+    memcpy(header + 157, linkName.data(), linkName.size());
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memcpy(header + 345, prefix.data(), prefix.size());
+
+    // The checksum is the plain byte sum of the header, with the checksum field itself counted as spaces.
+    uint checksum = 0;
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+        checksum += static_cast<unsigned char>(header[i]);
+    }
+
+    snprintf(header + 148, 8, "%06o", checksum);
+    header[155] = ' ';
+
+    this->out.write(header, TAR_BLOCK_SIZE);
+}
+
+/**
+ * Writes a pax extended header, which overrides the path of the entry following it.
+ */
+void TarSink::writePathExtension(const string path)
+{
+    // A pax record is "<length> path=<value>\n", where the length includes its own digits.
+    const string recordBody = " path=" + path + "\n";
+    size_t recordLength = recordBody.size() + 1;
+
+    while (to_string(recordLength).size() + recordBody.size() != recordLength)
+    {
+        recordLength++;
+    }
+
+    const string record = to_string(recordLength) + recordBody;
+
+    this->writeHeader("PaxHeader", record.size(), 'x');
+    this->out.write(record.data(), record.size());
+    this->writeBlockPadding(record.size());
+}
+
+/**
+ * Pads data of the given length to the next block boundary.
+ */
+void TarSink::writeBlockPadding(const uLong length)
+{
+    const char padding[TAR_BLOCK_SIZE] = {};
+    const size_t paddingLength = (TAR_BLOCK_SIZE - length % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    this->out.write(padding, paddingLength);
+}
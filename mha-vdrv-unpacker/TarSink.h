@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ctime>
+
+#include "BufferedWriter.h"
+#include "OutputSink.h"
+
+using namespace std;
+
+/**
+ * Size of a tar block. Headers take exactly one block, file data is padded to a multiple of it.
+ */
+constexpr size_t TAR_BLOCK_SIZE = 512;
+
+/**
+ * Streams the drive tree into a single ustar archive, either into a file or to stdout.
+ * Nothing is ever written to a temporary file, file data goes from the decompressor through one write buffer.
+ */
+class TarSink : public OutputSink {
+public:
+    TarSink(const string archivePath, const size_t writeBufferSize, const time_t modificationTime);
+    void addDirectory(const string directoryPath) override;
+    int addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize) override;
+    bool addLink(const string filePath, const string targetPath) override;
+    void finish() override;
+private:
+    void writeHeader(const string path, const uLong size, const char typeFlag, const string linkName = "");
+    void writePathExtension(const string path);
+    void writeBlockPadding(const uLong length);
+
+    BufferedWriter out;
+    const time_t modificationTime;
+};
@@ -0,0 +1,155 @@
+#include "UnpackJournal.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Xxh64.h"
+
+using namespace std;
+
+/**
+ * Size of a single record: drive index and entry offset.
+ */
+constexpr size_t UNPACK_JOURNAL_RECORD_SIZE = 2 * sizeof(uint);
+
+UnpackJournal::UnpackJournal(const filesystem::path journalPath, DriveOverlay& overlay):
+    journalPath(journalPath), overlay(overlay), doneEntries(), out()
+{}
+
+/**
+ * Reads the files completed by an earlier run, then opens the journal for appending.
+ * A journal written for other drives is started over. Returns the amount of files that are done already.
+ */
+size_t UnpackJournal::open()
+{
+    const string header = this->createHeader();
+    uintmax_t validLength = 0;
+
+    {
+        ifstream in(this->journalPath, ios::in | ios::binary);
+        string existingHeader(header.size(), '\0');
+
+        if (in.read(&existingHeader[0], existingHeader.size()) && existingHeader == header)
+        {
+            validLength = header.size();
+            char record[UNPACK_JOURNAL_RECORD_SIZE];
+
+            while (in.read(record, sizeof(record)))
+            {
+                uint driveIndex;
+                uint entryOffset;
+                memcpy(&driveIndex, record, sizeof(driveIndex));
+                memcpy(&entryOffset, record + sizeof(driveIndex), sizeof(entryOffset));
+
+                this->doneEntries.insert((static_cast<uint64_t>(driveIndex) << 32) | entryOffset);
+                validLength += sizeof(record);
+            }
+        }
+    }
+
+    if (validLength == 0)
+    {
+        ofstream headerOut(this->journalPath, ios::out | ios::binary | ios::trunc);
+        headerOut.write(header.data(), header.size());
+    } else
+    {
+        // Cut off a record the previous run didn't get to finish, so new ones line up again.
+        filesystem::resize_file(this->journalPath, validLength);
+    }
+
+    this->out.open(this->journalPath, ios::out | ios::binary | ios::app);
+
+    if (!this->out.is_open())
+    {
+        throw runtime_error("Could not open journal " + this->journalPath.string());
+    }
+
+    return this->doneEntries.size();
+}
+
+/**
+ * Checks whether an earlier run already unpacked a file.
+ */
+bool UnpackJournal::isDone(const OverlayEntry& overlayEntry)
+{
+    return this->doneEntries.count(getKey(overlayEntry)) > 0;
+}
+
+/**
+ * Appends a completed file to the journal. The record is handed to the OS right away, so it survives the process dying.
+ */
+void UnpackJournal::markDone(const OverlayEntry& overlayEntry)
+{
+    const uint driveIndex = static_cast<uint>(overlayEntry.driveIndex);
+    const uint entryOffset = DriveMetadataEntry(overlayEntry.entry).getEntryOffset();
+    char record[UNPACK_JOURNAL_RECORD_SIZE];
+
+    memcpy(record, &driveIndex, sizeof(driveIndex));
+    memcpy(record + sizeof(driveIndex), &entryOffset, sizeof(entryOffset));
+
+    if (!this->out.write(record, sizeof(record)).flush())
+    {
+        throw runtime_error("Could not write journal " + this->journalPath.string());
+    }
+
+    this->doneEntries.insert(getKey(overlayEntry));
+}
+
+/**
+ * Deletes the journal once the unpack is complete, the next run starts from scratch again.
+ */
+void UnpackJournal::remove()
+{
+    this->out.close();
+    filesystem::remove(this->journalPath);
+}
+
+/**
+ * Builds the header identifying the drives the journal belongs to.
+ */
+string UnpackJournal::createHeader()
+{
+    string header = UNPACK_JOURNAL_MAGIC;
+    const uint driveCount = static_cast<uint>(this->overlay.getDriveCount());
+    header.append(reinterpret_cast<const char*>(&driveCount), sizeof(driveCount));
+
+    for (int driveIndex = 0; driveIndex < this->overlay.getDriveCount(); driveIndex++)
+    {
+        const uint driveSize = this->overlay.getDrive(driveIndex).getFileSize();
+        const uint64_t metadataHash = hashMetadata(this->overlay.getMetadata(driveIndex));
+        header.append(reinterpret_cast<const char*>(&driveSize), sizeof(driveSize));
+        header.append(reinterpret_cast<const char*>(&metadataHash), sizeof(metadataHash));
+    }
+
+    return header;
+}
+
+/**
+ * Hashes everything the journal records depend on: the offset of every entry and what it describes.
+ */
+uint64_t UnpackJournal::hashMetadata(DriveMetadata& metadata)
+{
+    Xxh64 hash;
+
+    for (int pos = 0; pos < metadata.getSize(); pos++)
+    {
+        DriveMetadataEntry entry = metadata.getEntryAt(pos);
+        const uint fields[] = { entry.getEntryOffset(), entry.getParentOffset(), entry.isDirectory() ? 1u : 0u, entry.getFileStart(), entry.getFileSize() };
+        const string fileName = entry.getFileName();
+        const uint fileNameLength = static_cast<uint>(fileName.size());
+
+        hash.update(reinterpret_cast<const unsigned char*>(fields), sizeof(fields));
+        hash.update(reinterpret_cast<const unsigned char*>(&fileNameLength), sizeof(fileNameLength));
+        hash.update(reinterpret_cast<const unsigned char*>(fileName.data()), fileName.size());
+    }
+
+    return hash.digest();
+}
+
+/**
+ * Combines drive index and entry offset into a single key.
+ */
+uint64_t UnpackJournal::getKey(const OverlayEntry& overlayEntry)
+{
+    return (static_cast<uint64_t>(overlayEntry.driveIndex) << 32) | DriveMetadataEntry(overlayEntry.entry).getEntryOffset();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+
+#include "DriveOverlay.h"
+
+using namespace std;
+
+/**
+ * Name of the journal file, in the root of the output directory.
+ */
+const string UNPACK_JOURNAL_NAME = ".vdrv-journal";
+
+/**
+ * Magic string at the start of the journal.
+ */
+const string UNPACK_JOURNAL_MAGIC = "VDJ2";
+
+/**
+ * Write-ahead journal of an unpack into a directory, so an unpack that died halfway can pick up where it left off.
+ *
+ * The journal starts with a header identifying the drives (their amount, and per drive its file size and an XXH64 hash
+ * of its decrypted metadata, so a patched drive of the same size is told apart), followed by one record
+ * per completed file: the index of the drive and the offset of the file's metadata entry, 4 bytes each.
+ * Records are only appended after the file got its final name (see DirectorySink's atomic writes), so every file listed
+ * is complete, and a record cut short by a crash is simply dropped. Resuming only reads the journal, not the output.
+ */
+class UnpackJournal {
+public:
+    UnpackJournal(const filesystem::path journalPath, DriveOverlay& overlay);
+    UnpackJournal(const UnpackJournal&) = delete;
+    UnpackJournal& operator=(const UnpackJournal&) = delete;
+    size_t open();
+    bool isDone(const OverlayEntry& overlayEntry);
+    void markDone(const OverlayEntry& overlayEntry);
+    void remove();
+private:
+    string createHeader();
+    static uint64_t hashMetadata(DriveMetadata& metadata);
+    static uint64_t getKey(const OverlayEntry& overlayEntry);
+
+    const filesystem::path journalPath;
+    DriveOverlay& overlay;
+    unordered_set<uint64_t> doneEntries;
+    ofstream out;
+};
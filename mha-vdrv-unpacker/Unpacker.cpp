@@ -0,0 +1,318 @@
+#include "Unpacker.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+using namespace std;
+
+Unpacker::Unpacker(DriveOverlay& overlay, OutputSink& sink, PathFilter& filter):
+    overlay(overlay), sink(sink), filter(filter), manifest(nullptr), journal(nullptr), hashManifest(nullptr), pendingDirectories(), unpackedPayloads(), linkedCount(0), failedCount(0)
+{}
+
+/**
+ * Skips the files the manifest knows to be unpacked already, and records the ones written.
+ * Only makes sense for output into a directory.
+ */
+void Unpacker::setManifest(IncrementalManifest* manifest)
+{
+    this->manifest = manifest;
+}
+
+/**
+ * Skips the files the journal lists as done, and appends every file written to it.
+ * The sink has to write files atomically, so no file is listed before it is complete.
+ */
+void Unpacker::setJournal(UnpackJournal* journal)
+{
+    this->journal = journal;
+}
+
+/**
+ * Unpacks every root directory of the drive.
+ */
+void Unpacker::unpack()
+{
+    for (auto entry : this->overlay.list(""))
+    {
+        if (entry.entry.isDirectory())
+        {
+            this->processDirectory(entry, "");
+        }
+    }
+
+    this->sink.finish();
+}
+
+/**
+ * Hashes every file unpacked, for a manifest of the output.
+ */
+void Unpacker::setHashManifest(HashManifest* hashManifest)
+{
+    this->hashManifest = hashManifest;
+}
+
+/**
+ * Gets the amount of files that shared their data with a file unpacked before, and were added as links to it.
+ */
+int Unpacker::getLinkedCount()
+{
+    return this->linkedCount;
+}
+
+/**
+ * Gets the amount of files that could not be unpacked.
+ */
+int Unpacker::getFailedCount()
+{
+    return this->failedCount;
+}
+
+/**
+ * Processes a single directory entry from the drive, recursively walking into sub-directories and writing out files.
+ */
+void Unpacker::processDirectory(OverlayEntry directoryEntry, const string currentDrivePath)
+{
+    // Append directory name to the current path within the drive. Root directories have no parent path.
+    const string directoryName = directoryEntry.entry.getFileName();
+    const string currentDirPath = currentDrivePath.empty() ? directoryName : currentDrivePath + "/" + directoryName;
+
+    // Don't even look at the contents of directories the filter rules out.
+    if (!this->filter.mayMatchBelow(currentDirPath))
+    {
+        return;
+    }
+
+    cout << endl << "Processing directory: " << currentDirPath << endl;
+
+    // Create the directory in the output. When filtering, only once we know that anything in it is unpacked.
+    this->pendingDirectories.push_back(currentDirPath);
+
+    if (!this->filter.isActive() || this->filter.keepsDirectory(currentDirPath))
+    {
+        this->addPendingDirectories();
+    }
+
+    // Get all entries contained within this directory (files and sub-directories).
+    // The overlay has them grouped already, so this doesn't scan the whole metadata for every directory.
+    vector<OverlayEntry> childEntries = this->overlay.list(currentDirPath);
+
+    // Separate the list by of entries by entry type. The only purpose of this split is so we can
+    // output the console logs in the right order without putting in any actual effort, tbh.
+    vector<OverlayEntry> fileEntries;
+    vector<OverlayEntry> dirEntries;
+
+    copy_if(childEntries.begin(), childEntries.end(), back_inserter(fileEntries), [](OverlayEntry entry) {
+        return !entry.entry.isDirectory();
+    });
+
+    copy_if(childEntries.begin(), childEntries.end(), back_inserter(dirEntries), [](OverlayEntry entry) {
+        return entry.entry.isDirectory();
+    });
+
+    // Write out files first for correct console print order.
+    for (auto entry : fileEntries)
+    {
+        this->processFile(entry, currentDirPath);
+    }
+
+    // Recursively walk any sub-directories.
+    for (auto entry : dirEntries)
+    {
+        this->processDirectory(entry, currentDirPath);
+    }
+
+    // Nothing was unpacked below this directory, so it never has to be created.
+    if (!this->pendingDirectories.empty() && this->pendingDirectories.back() == currentDirPath)
+    {
+        this->pendingDirectories.pop_back();
+    }
+}
+
+/**
+ * Processes a single file entry from the drive and hands it to the output sink.
+ */
+void Unpacker::processFile(OverlayEntry fileEntry, const string currentDrivePath)
+{
+    // Append file name to the current path within the drive.
+    const string filePath = currentDrivePath + "/" + fileEntry.entry.getFileName();
+
+    // Filtered files are skipped before anything is read from the drive.
+    if (!this->filter.matchesFile(filePath))
+    {
+        return;
+    }
+
+    this->addPendingDirectories();
+
+    if (this->journal != nullptr && this->journal->isDone(fileEntry))
+    {
+        cout << "* " << fileEntry.entry.getFileName() << " -> done already" << endl;
+        this->hashSkippedFile(fileEntry, filePath);
+        return;
+    }
+
+    const auto payloadKey = make_tuple(fileEntry.driveIndex, fileEntry.entry.getFileStart(), fileEntry.entry.getFileSize());
+
+    // The checksum at the end of the stream tells whether the file changed, without reading the rest of it.
+    ManifestRecord record = { fileEntry.entry.getFileStart(), fileEntry.entry.getFileSize(), 0, 0 };
+
+    if (this->manifest != nullptr)
+    {
+        try
+        {
+            record.checksum = this->overlay.readChecksum(fileEntry);
+        } catch (std::exception& e)
+        {
+            cout << "* " << fileEntry.entry.getFileName() << endl << "Error while reading the file: " << e.what() << endl;
+            this->failedCount++;
+            return;
+        }
+
+        if (this->manifest->isUnchanged(filePath, record))
+        {
+            cout << "* " << fileEntry.entry.getFileName() << " -> unchanged" << endl;
+            this->unpackedPayloads.emplace(payloadKey, make_pair(filePath, record.uncompressedSize));
+            this->hashSkippedFile(fileEntry, filePath);
+            return;
+        }
+    }
+
+    auto unpackedPayload = this->unpackedPayloads.find(payloadKey);
+
+    if (unpackedPayload != this->unpackedPayloads.end() && this->sink.addLink(filePath, unpackedPayload->second.first))
+    {
+        cout << "* " << fileEntry.entry.getFileName() << " -> same data as " << unpackedPayload->second.first << endl;
+
+        record.uncompressedSize = unpackedPayload->second.second;
+        this->markCompleted(fileEntry, filePath, record);
+        this->linkedCount++;
+
+        if (this->hashManifest != nullptr)
+        {
+            this->hashManifest->addAlias(filePath, unpackedPayload->second.first);
+        }
+        return;
+    }
+
+    cout << "* " << fileEntry.entry.getFileName() << " -> " << fileEntry.entry.getFileSize() << " B compressed";
+
+    // Read the compressed data from the drive file in a zlib compatible way.
+    // Shared, so the hash manifest can hold on to it after the sink is done with it.
+    shared_ptr<CompressedPayload> payload;
+    uLong uncompressedLength;
+
+    // Entries pointing beyond the end of the drive or with corrupt data are reported, the remaining files are still unpacked.
+    try
+    {
+        payload = make_shared<CompressedPayload>(this->overlay.readCompressedFile(fileEntry), fileEntry.entry.getFileSize());
+
+        // The files never actually really got compressed, just converted to zlib format,
+        // so the exact size can usually be taken straight from the zlib stream without inflating it.
+        uncompressedLength = payload->getUncompressedSize();
+    } catch (std::exception& e)
+    {
+        cout << endl << "Error while reading the file: " << e.what() << endl;
+        this->failedCount++;
+        return;
+    }
+
+    cout << ", " << uncompressedLength << " B uncompressed" << endl;
+
+    int decompressionResult;
+    unique_ptr<FileHasher> hasher;
+
+    // The file is hashed for the manifest while the sink inflates it, instead of inflating it once more afterwards.
+    if (this->hashManifest != nullptr)
+    {
+        hasher = make_unique<FileHasher>(this->hashManifest->createHasher());
+        payload->setTee([&hasher](const unsigned char* data, size_t length) {
+            hasher->update(data, length);
+        });
+    }
+
+    // Writing can fail as well (disk full, mapping failed), which only loses this file.
+    try
+    {
+        decompressionResult = this->sink.addFile(filePath, *payload, uncompressedLength);
+        payload->setTee(nullptr);
+    } catch (std::exception& e)
+    {
+        payload->setTee(nullptr);
+        cout << "Error while writing the file: " << e.what() << endl;
+        this->failedCount++;
+        return;
+    }
+
+    if (decompressionResult != Z_OK)
+    {
+        cout << "Error during decompression, the compressed data seems to be corrupt. This shouldn't happen!" << endl;
+        this->failedCount++;
+        return;
+    }
+
+    record.uncompressedSize = uncompressedLength;
+    this->markCompleted(fileEntry, filePath, record);
+    this->unpackedPayloads.emplace(payloadKey, make_pair(filePath, uncompressedLength));
+
+    // Sinks that copy stored data as it is never inflate it, and ones inflating twice handed out too much;
+    // both are hashed from the payload on the manifest's workers instead.
+    if (this->hashManifest != nullptr && hasher->getLength() == uncompressedLength)
+    {
+        this->hashManifest->addHash(filePath, hasher->digestHex());
+    } else if (this->hashManifest != nullptr)
+    {
+        this->hashManifest->addFile(filePath, payload);
+    }
+}
+
+/**
+ * Hashes a file that is in the output from an earlier run already, reading its data from the drive as usual.
+ * If it can't be read anymore, the file stays in the output but is left out of the manifest, which reports it as failed.
+ */
+void Unpacker::hashSkippedFile(OverlayEntry fileEntry, const string filePath)
+{
+    if (this->hashManifest == nullptr)
+    {
+        return;
+    }
+
+    try
+    {
+        this->hashManifest->addFile(filePath, make_shared<CompressedPayload>(this->overlay.readCompressedFile(fileEntry), fileEntry.entry.getFileSize()));
+    } catch (std::exception& e)
+    {
+        cout << "Error while reading the file for the manifest: " << e.what() << endl;
+        this->hashManifest->addFailedFile(filePath);
+    }
+}
+
+/**
+ * Notes a file that is complete in the output in the manifest and journal, if there are any.
+ */
+void Unpacker::markCompleted(OverlayEntry fileEntry, const string filePath, const ManifestRecord& record)
+{
+    if (this->manifest != nullptr)
+    {
+        this->manifest->markUnpacked(filePath, record);
+    }
+
+    if (this->journal != nullptr)
+    {
+        this->journal->markDone(fileEntry);
+    }
+}
+
+/**
+ * Adds all directories that were entered but not added yet to the sink, outermost first.
+ */
+void Unpacker::addPendingDirectories()
+{
+    for (const string& directoryPath : this->pendingDirectories)
+    {
+        this->sink.addDirectory(directoryPath);
+    }
+
+    this->pendingDirectories.clear();
+}
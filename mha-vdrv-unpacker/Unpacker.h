@@ -0,0 +1,60 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "DriveOverlay.h"
+#include "HashManifest.h"
+#include "IncrementalManifest.h"
+#include "OutputSink.h"
+#include "PathFilter.h"
+#include "UnpackJournal.h"
+
+using namespace std;
+
+/**
+ * Walks the directory tree of a drive (or the effective tree of several stacked drives) and hands every directory
+ * and file to an output sink.
+ */
+class Unpacker {
+public:
+    Unpacker(DriveOverlay& overlay, OutputSink& sink, PathFilter& filter);
+    void setManifest(IncrementalManifest* manifest);
+    void setJournal(UnpackJournal* journal);
+    void setHashManifest(HashManifest* hashManifest);
+    void unpack();
+    int getLinkedCount();
+    int getFailedCount();
+private:
+    void processDirectory(OverlayEntry directoryEntry, const string currentDrivePath);
+    void processFile(OverlayEntry fileEntry, const string currentDrivePath);
+    void addPendingDirectories();
+    void hashSkippedFile(OverlayEntry fileEntry, const string filePath);
+    void markCompleted(OverlayEntry fileEntry, const string filePath, const ManifestRecord& record);
+
+    DriveOverlay& overlay;
+    OutputSink& sink;
+    PathFilter& filter;
+
+    // Files of an earlier run, which are only written again if they changed. Null unless unpacking incrementally.
+    IncrementalManifest* manifest;
+
+    // Files completed by an earlier, aborted run, which are not written again. Null unless journaling.
+    UnpackJournal* journal;
+
+    // Checksums of all unpacked files, including the ones skipped because they are there already. Null unless requested.
+    HashManifest* hashManifest;
+
+    // Directories that were entered, but are only added to the sink once a file below them is actually unpacked.
+    vector<string> pendingDirectories;
+
+    // Packers store identical files only once and point several entries at the same data. Every (drive, offset, size)
+    // maps to the first file unpacked from it and its size, later files with the same data become links to that one.
+    map<tuple<int, uint, uint>, pair<string, uLong>> unpackedPayloads;
+    int linkedCount;
+
+    // Files that could not be read, inflated or written. They are reported and left out, everything else is still unpacked.
+    int failedCount;
+};
@@ -1,19 +1,20 @@
 #include "VDRV.h"
 
+#include <cstring>
 #include <stdexcept>
 
 using namespace std;
 
-VDRV::VDRV(const char* filePath):
-    in(filePath, std::ios::binary | std::ios::ate), fileSize(in.tellg())
-{
-    in.seekg(0);
-}
+template <class IO>
+BasicVDRV<IO>::BasicVDRV(const char* filePath):
+    in(filePath), fileSize(in.getSize())
+{}
 
 /**
  * Returns the total size of the read file.
  */
-uint VDRV::getFileSize()
+template <class IO>
+uint BasicVDRV<IO>::getFileSize()
 {
     return this->fileSize;
 }
@@ -21,16 +22,18 @@ uint VDRV::getFileSize()
 /**
  * Returns the current position of the file cursor.
  */
-uint VDRV::getCursorPos()
+template <class IO>
+uint BasicVDRV<IO>::getCursorPos()
 {
-    return this->in.tellg();
+    return this->in.tell();
 }
 
 /**
  * Reads a metadata entry at a given position within the file, and adds it to the entry list of the metadata object.
  * Returns the position of the next metadata entry.
  */
-uint VDRV::readMetadataEntry(const uint currentReadPointer, DriveMetadata& meta)
+template <class IO>
+uint BasicVDRV<IO>::readMetadataEntry(const uint currentReadPointer, DriveMetadata& meta)
 {
     this->moveTo(currentReadPointer);
 
@@ -46,6 +49,12 @@ uint VDRV::readMetadataEntry(const uint currentReadPointer, DriveMetadata& meta)
     // Pointer to the next metadata entry in files.
     const uint nextPointer = this->readUInt32FromFile();
     
+    // The entry header alone takes up 0x10 bytes.
+    if (entryLength < 0x10)
+    {
+        throw out_of_range("Metadata entry is too short.");
+    }
+
     // Size of the encrypted data.
     uint size = entryLength - 0x10;
 
@@ -105,7 +114,8 @@ uint VDRV::readMetadataEntry(const uint currentReadPointer, DriveMetadata& meta)
 /**
  * Decrypts a single metadata entry in the drive.
  */
-void VDRV::decryptEntry(unique_ptr<char[]>& entryData, const uint size)
+template <class IO>
+void BasicVDRV<IO>::decryptEntry(unique_ptr<char[]>& entryData, const uint size)
 {
     if (size < 0x10)
     {
@@ -122,20 +132,34 @@ void VDRV::decryptEntry(unique_ptr<char[]>& entryData, const uint size)
 /**
  * Moves the file cursor to the given position.
  */
-void VDRV::moveTo(const uint pos)
+template <class IO>
+void BasicVDRV<IO>::moveTo(const uint pos)
 {
     if (pos >= this->fileSize)
     {
         throw out_of_range("Tried to move beyond EOF.");
     }
 
-    this->in.seekg(pos);
+    this->in.seek(pos);
 }
 
 /**
  * Reads a the encrypted metadata section at the end of the file and parses it into something we can actually process.
  */
-DriveMetadata VDRV::readMetadata()
+template <class IO>
+DriveMetadata BasicVDRV<IO>::readMetadata()
+{
+    return this->readMetadataUntil([](DriveMetadata&) {
+        return false;
+    });
+}
+
+/**
+ * Same as readMetadata, but checks back after every entry and stops as soon as isComplete returns true.
+ * This allows looking for a single entry without decrypting the whole metadata section.
+ */
+template <class IO>
+DriveMetadata BasicVDRV<IO>::readMetadataUntil(const function<bool(DriveMetadata&)>& isComplete)
 {
     DriveMetadata meta;
 
@@ -147,6 +171,11 @@ DriveMetadata VDRV::readMetadata()
     while (currentReadPointer != 0)
     {
         currentReadPointer = this->readMetadataEntry(currentReadPointer, meta);
+
+        if (isComplete(meta))
+        {
+            break;
+        }
     }
 
     return meta;
@@ -155,7 +184,8 @@ DriveMetadata VDRV::readMetadata()
 /**
  * Reads an entire zlib compressed chunk from the drive based on the metadata read.
  */
-unique_ptr<char[]> VDRV::readCompressedFile(DriveMetadataEntry entry)
+template <class IO>
+unique_ptr<char[]> BasicVDRV<IO>::readCompressedFile(DriveMetadataEntry entry)
 {
     this->moveTo(entry.getFileStart());
 
@@ -166,14 +196,180 @@ unique_ptr<char[]> VDRV::readCompressedFile(DriveMetadataEntry entry)
     return resultPointer;
 }
 
+/**
+ * Reads a range of the uncompressed data of a file without inflating it as a whole.
+ * Returns the amount of bytes copied, which is less than requested if the range goes beyond the end of the file.
+ */
+template <class IO>
+uLong BasicVDRV<IO>::readRange(DriveMetadataEntry entry, const uLong offset, char* destBuf, const uLong length)
+{
+    shared_ptr<SeekIndex> seekIndex = this->getSeekIndex(entry);
+
+    return seekIndex->read(offset, reinterpret_cast<unsigned char*>(destBuf), length, [this, &entry](const uint from, unsigned char* chunkBuf, const size_t chunkLength) {
+        this->readCompressedRange(entry, from, reinterpret_cast<char*>(chunkBuf), chunkLength);
+    });
+}
+
+/**
+ * Reads a chunk of the compressed data of a file, with the position relative to the start of its payload.
+ * Serves as the CompressedRangeReader for seek indexes built elsewhere.
+ */
+template <class IO>
+void BasicVDRV<IO>::readCompressedRange(DriveMetadataEntry entry, const uint from, char* destBuf, const size_t length)
+{
+    if (from > entry.getFileSize() || length > entry.getFileSize() - from)
+    {
+        throw out_of_range("Tried to read beyond the end of the file.");
+    }
+
+    this->moveTo(entry.getFileStart() + from);
+    this->readByteArrayFromFile(destBuf, length);
+}
+
+/**
+ * Gets the size of a file once inflated. Comes for free with the seek index, so this is cheap after the first range read.
+ */
+template <class IO>
+uLong BasicVDRV<IO>::getUncompressedSize(DriveMetadataEntry entry)
+{
+    return this->getSeekIndex(entry)->getUncompressedSize();
+}
+
+/**
+ * Reads the Adler-32 checksum of the uncompressed data, which every zlib stream ends with.
+ * Only the last four bytes of the entry are read, so this is a cheap way to tell whether the contents of a file changed.
+ */
+template <class IO>
+uint BasicVDRV<IO>::readChecksum(DriveMetadataEntry entry)
+{
+    unsigned char checksumBytes[4];
+
+    // In 64 bits, so entries running past the end of the drive can't wrap around into it.
+    const uint64_t fileEnd = static_cast<uint64_t>(entry.getFileStart()) + entry.getFileSize();
+
+    if (entry.getFileSize() < sizeof(checksumBytes))
+    {
+        throw out_of_range("Entry is too small to hold a zlib stream.");
+    }
+
+    if (fileEnd > this->fileSize)
+    {
+        throw out_of_range("Entry reaches beyond EOF.");
+    }
+
+    this->moveTo(static_cast<uint>(fileEnd - sizeof(checksumBytes)));
+    this->readByteArrayFromFile(reinterpret_cast<char*>(checksumBytes), sizeof(checksumBytes));
+
+    // Unlike everything else in the drive, the checksum is stored big endian.
+    return (static_cast<uint>(checksumBytes[0]) << 24) | (checksumBytes[1] << 16) | (checksumBytes[2] << 8) | checksumBytes[3];
+}
+
+/**
+ * Reads the size the metadata entry itself takes up in the drive, header and encrypted data included.
+ */
+template <class IO>
+uint BasicVDRV<IO>::readEntrySize(DriveMetadataEntry entry)
+{
+    // Second field of the entry header, right after the entry type.
+    if (static_cast<uint64_t>(entry.getEntryOffset()) + 0x8 > this->fileSize)
+    {
+        throw out_of_range("Entry reaches beyond EOF.");
+    }
+
+    this->moveTo(entry.getEntryOffset() + 0x4);
+    return this->readUInt32FromFile();
+}
+
+/**
+ * Gets the uncompressed size of a file from the headers of its stored blocks, reading only the 5 bytes of every header.
+ * Returns false if the data contains anything but stored blocks (or doesn't fit the drive), the size then needs an inflate.
+ * Same rules as CompressedPayload::getUncompressedSize, without reading the data in between.
+ */
+template <class IO>
+bool BasicVDRV<IO>::readStoredSize(DriveMetadataEntry entry, uLong& uncompressedSize)
+{
+    const uint64_t fileStart = entry.getFileStart();
+    const uint fileSize = entry.getFileSize();
+
+    // 2 bytes zlib header, at least one block header and the adler32 trailer.
+    if (fileSize < 2 + 5 + 4 || fileStart + fileSize > this->fileSize)
+    {
+        return false;
+    }
+
+    unsigned char header[5];
+    this->moveTo(entry.getFileStart());
+    this->readByteArrayFromFile(reinterpret_cast<char*>(header), 2);
+
+    // A preset dictionary would put 4 more bytes in front of the first block.
+    if ((header[1] & 0x20) != 0)
+    {
+        return false;
+    }
+
+    const uint streamEnd = fileSize - 4;
+    uint pos = 2;
+    uncompressedSize = 0;
+
+    while (pos + 5 <= streamEnd)
+    {
+        this->moveTo(entry.getFileStart() + pos);
+        this->readByteArrayFromFile(reinterpret_cast<char*>(header), sizeof(header));
+
+        const bool isFinalBlock = (header[0] & 1) != 0;
+        const uint blockLength = header[1] | (header[2] << 8);
+        const uint blockLengthComplement = header[3] | (header[4] << 8);
+
+        if (((header[0] >> 1) & 3) != 0 || (blockLength ^ 0xFFFF) != blockLengthComplement || pos + 5 + blockLength > streamEnd)
+        {
+            return false;
+        }
+
+        pos += 5 + blockLength;
+        uncompressedSize += blockLength;
+
+        if (isFinalBlock)
+        {
+            return pos == streamEnd;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Gets the seek index of a file, building it from the compressed data on first use.
+ * Only the indexes of large files are kept, small files are cheaper to index again than to hold on to.
+ */
+template <class IO>
+shared_ptr<SeekIndex> BasicVDRV<IO>::getSeekIndex(DriveMetadataEntry entry)
+{
+    auto cachedIndex = this->seekIndexes.find(entry.getPayloadKey());
+    if (cachedIndex != this->seekIndexes.end())
+    {
+        return cachedIndex->second;
+    }
+
+    CompressedPayload payload(this->readCompressedFile(entry), entry.getFileSize());
+    shared_ptr<SeekIndex> seekIndex = make_shared<SeekIndex>(payload);
+
+    if (entry.getFileSize() >= SEEK_INDEX_CACHE_MINIMUM_SIZE)
+    {
+        this->seekIndexes[entry.getPayloadKey()] = seekIndex;
+    }
+
+    return seekIndex;
+}
+
 /**
  * Reads a uint32 from the file at the current position and jumps ahead 4 bytes.
  */
-uint VDRV::readUInt32FromFile()
+template <class IO>
+uint BasicVDRV<IO>::readUInt32FromFile()
 {
     uint target;
 
-    if (this->getCursorPos() > this->fileSize - sizeof(target))
+    if (sizeof(target) > this->fileSize || this->getCursorPos() > this->fileSize - sizeof(target))
     {
         throw out_of_range("Tried to read beyond EOF.");
     }
@@ -186,7 +382,8 @@ uint VDRV::readUInt32FromFile()
 /**
  * Reads a uint32 from the given buffer at the given position.
  */
-uint VDRV::readUInt32FromBuffer(const char* buffer, size_t bufferSize, const int from)
+template <class IO>
+uint BasicVDRV<IO>::readUInt32FromBuffer(const char* buffer, size_t bufferSize, const int from)
 {
     uint target;
 
@@ -203,11 +400,12 @@ uint VDRV::readUInt32FromBuffer(const char* buffer, size_t bufferSize, const int
 /**
  * Reads a byte from the file at the current position and jumps ahead 1 byte.
  */
-char VDRV::readUInt8FromFile()
+template <class IO>
+char BasicVDRV<IO>::readUInt8FromFile()
 {
     char target;
 
-    if (this->getCursorPos() > this->fileSize - sizeof(target))
+    if (sizeof(target) > this->fileSize || this->getCursorPos() > this->fileSize - sizeof(target))
     {
         throw out_of_range("Tried to read beyond EOF.");
     }
@@ -220,9 +418,11 @@ char VDRV::readUInt8FromFile()
 /**
  * Reads a chunk of bytes from the file at the current position and jumps ahead to the end of the chunk.
  */
-void VDRV::readByteArrayFromFile(char* destBuf, size_t arraySize)
+template <class IO>
+void BasicVDRV<IO>::readByteArrayFromFile(char* destBuf, size_t arraySize)
 {
-    if (this->getCursorPos() > this->fileSize - arraySize)
+    // Checked this way round, so sizes beyond the drive can't wrap around.
+    if (arraySize > this->fileSize || this->getCursorPos() > this->fileSize - arraySize)
     {
         throw out_of_range("Tried to read array beyond EOF.");
     }
@@ -236,7 +436,8 @@ void VDRV::readByteArrayFromFile(char* destBuf, size_t arraySize)
  * This is reconstructed as best as I could to resemble what the assembly does.
  * (And might therefore look a bit nuts.)
  */
-void VDRV::decrypt(unique_ptr<char[]>& entryData, const uint from, const uint size)
+template <class IO>
+void BasicVDRV<IO>::decrypt(unique_ptr<char[]>& entryData, const uint from, const uint size)
 {
     if (size == 0)
     {
@@ -381,3 +582,9 @@ void VDRV::decrypt(unique_ptr<char[]>& entryData, const uint from, const uint si
         }
     }
 }
+
+// Instantiate the reader for every I/O policy, so the policy's inline primitives get compiled into each variant.
+template class BasicVDRV<StreamIO>;
+template class BasicVDRV<PReadIO>;
+template class BasicVDRV<MappedIO>;
+template class BasicVDRV<MemoryIO>;
@@ -1,22 +1,38 @@
 #pragma once
 
-#include <fstream>
+#include <functional>
 #include <memory>
+#include <unordered_map>
 
+#include "DriveIO.h"
 #include "DriveMetadata.h"
+#include "SeekIndex.h"
 
 using uint = uint32_t;
 using namespace std;
 
-class VDRV {
+/**
+ * Reader for the VDRV drive format, statically dispatched on an I/O policy (see DriveIO.h).
+ * Member functions are defined in VDRV.cpp and explicitly instantiated for every policy shipped there.
+ */
+template <class IO>
+class BasicVDRV {
 public:
-    VDRV(const char* filePath);
-    VDRV(const VDRV&) = delete;
-    VDRV& operator=(const VDRV&) = delete;
+    BasicVDRV(const char* filePath);
+    BasicVDRV(const BasicVDRV&) = delete;
+    BasicVDRV& operator=(const BasicVDRV&) = delete;
     uint getFileSize();
     DriveMetadata readMetadata();
+    DriveMetadata readMetadataUntil(const function<bool(DriveMetadata&)>& isComplete);
     unique_ptr<char[]> readCompressedFile(DriveMetadataEntry entry);
+    uLong readRange(DriveMetadataEntry entry, const uLong offset, char* destBuf, const uLong length);
+    void readCompressedRange(DriveMetadataEntry entry, const uint from, char* destBuf, const size_t length);
+    uLong getUncompressedSize(DriveMetadataEntry entry);
+    uint readChecksum(DriveMetadataEntry entry);
+    bool readStoredSize(DriveMetadataEntry entry, uLong& uncompressedSize);
+    uint readEntrySize(DriveMetadataEntry entry);
 private:
+    shared_ptr<SeekIndex> getSeekIndex(DriveMetadataEntry entry);
     uint readUInt32FromFile();
     uint readUInt32FromBuffer(const char* buffer, size_t bufferSize, const int from);
     char readUInt8FromFile();
@@ -27,6 +43,17 @@ private:
     void decryptEntry(unique_ptr<char[]>& entryData, const uint size);
     void decrypt(unique_ptr<char[]>& entryData, const uint from, const uint size);
 
-    std::ifstream in;
+    IO in;
     uint fileSize;
+    unordered_map<uint64_t, shared_ptr<SeekIndex>> seekIndexes;
 };
+
+/**
+ * Entries with at least this many compressed bytes keep their seek index around for further range reads.
+ */
+constexpr uint SEEK_INDEX_CACHE_MINIMUM_SIZE = 0x100000;
+
+/**
+ * The backend used by the unpacker. Swap the policy here to benchmark the others (StreamIO, PReadIO, MemoryIO).
+ */
+using VDRV = BasicVDRV<MappedIO>;
@@ -0,0 +1,115 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Starts the given amount of worker threads, at least one.
+ */
+WorkerPool::WorkerPool(const unsigned int threadCount):
+    threads(), tasks(), tasksMutex(), taskAvailable(), allTasksDone(), unfinishedTasks(0), stopping(false)
+{
+    for (unsigned int i = 0; i < max(threadCount, 1u); i++)
+    {
+        this->threads.emplace_back(&WorkerPool::work, this);
+    }
+}
+
+/**
+ * Finishes all queued tasks and stops the workers.
+ */
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(this->tasksMutex);
+        this->stopping = true;
+    }
+
+    this->taskAvailable.notify_all();
+
+    for (thread& worker : this->threads)
+    {
+        worker.join();
+    }
+}
+
+/**
+ * Queues a task for the next free worker.
+ */
+void WorkerPool::submit(function<void()> task)
+{
+    {
+        lock_guard<mutex> lock(this->tasksMutex);
+        this->tasks.push(move(task));
+        this->unfinishedTasks++;
+    }
+
+    this->taskAvailable.notify_one();
+}
+
+/**
+ * Blocks until every task submitted so far has been processed.
+ */
+void WorkerPool::wait()
+{
+    unique_lock<mutex> lock(this->tasksMutex);
+    this->allTasksDone.wait(lock, [this]() {
+        return this->unfinishedTasks == 0;
+    });
+}
+
+/**
+ * Gets the amount of worker threads.
+ */
+unsigned int WorkerPool::getThreadCount()
+{
+    return static_cast<unsigned int>(this->threads.size());
+}
+
+/**
+ * Gets the amount of threads to use if nothing else was asked for, one per hardware thread.
+ */
+unsigned int WorkerPool::getDefaultThreadCount()
+{
+    return max(thread::hardware_concurrency(), 1u);
+}
+
+/**
+ * Worker loop, takes tasks from the queue until the pool is stopped and the queue is empty.
+ * Tasks are expected to handle their own errors, e.g. by passing them on through a future.
+ */
+void WorkerPool::work()
+{
+    while (true)
+    {
+        function<void()> task;
+
+        {
+            unique_lock<mutex> lock(this->tasksMutex);
+            this->taskAvailable.wait(lock, [this]() {
+                return this->stopping || !this->tasks.empty();
+            });
+
+            if (this->tasks.empty())
+            {
+                return;
+            }
+
+            task = move(this->tasks.front());
+            this->tasks.pop();
+        }
+
+        task();
+
+        {
+            lock_guard<mutex> lock(this->tasksMutex);
+            this->unfinishedTasks--;
+
+            if (this->unfinishedTasks == 0)
+            {
+                this->allTasksDone.notify_all();
+            }
+        }
+    }
+}
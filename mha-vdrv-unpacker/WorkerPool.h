@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Fixed set of worker threads processing a shared queue of tasks.
+ */
+class WorkerPool {
+public:
+    WorkerPool(const unsigned int threadCount);
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool();
+    void submit(function<void()> task);
+    void wait();
+    unsigned int getThreadCount();
+    static unsigned int getDefaultThreadCount();
+private:
+    void work();
+
+    vector<thread> threads;
+    queue<function<void()>> tasks;
+    mutex tasksMutex;
+    condition_variable taskAvailable;
+    condition_variable allTasksDone;
+    size_t unfinishedTasks;
+    bool stopping;
+};
@@ -0,0 +1,159 @@
+#include "Xxh64.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+constexpr uint64_t XXH64_PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t XXH64_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t XXH64_PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t XXH64_PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t XXH64_PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotateLeft(const uint64_t value, const int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Reads a little endian 64 bit word. The format is defined little endian, just like every CPU this runs on.
+ */
+static inline uint64_t read64(const unsigned char* data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t mixLane(uint64_t lane, const uint64_t input)
+{
+    lane += input * XXH64_PRIME2;
+    lane = rotateLeft(lane, 31);
+    return lane * XXH64_PRIME1;
+}
+
+static inline uint64_t mergeLane(uint64_t hash, const uint64_t lane)
+{
+    hash ^= mixLane(0, lane);
+    return hash * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+Xxh64::Xxh64(const uint64_t seed):
+    lanes{ seed + XXH64_PRIME1 + XXH64_PRIME2, seed + XXH64_PRIME2, seed, seed - XXH64_PRIME1 },
+    buffer(), bufferedLength(0), totalLength(0), seed(seed)
+{}
+
+/**
+ * Hashes another chunk of data. Data is consumed in stripes of 32 bytes, the rest is kept until the next call.
+ */
+void Xxh64::update(const unsigned char* data, size_t length)
+{
+    this->totalLength += length;
+
+    if (this->bufferedLength + length < sizeof(this->buffer))
+    {
+        memcpy(this->buffer + this->bufferedLength, data, length);
+        this->bufferedLength += length;
+        return;
+    }
+
+    if (this->bufferedLength > 0)
+    {
+        const size_t fillLength = sizeof(this->buffer) - this->bufferedLength;
+        memcpy(this->buffer + this->bufferedLength, data, fillLength);
+        data += fillLength;
+        length -= fillLength;
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            this->lanes[lane] = mixLane(this->lanes[lane], read64(this->buffer + lane * 8));
+        }
+
+        this->bufferedLength = 0;
+    }
+
+    // The four lanes are independent of each other, which keeps the multipliers of the CPU busy.
+    for (; length >= sizeof(this->buffer); data += sizeof(this->buffer), length -= sizeof(this->buffer))
+    {
+        this->lanes[0] = mixLane(this->lanes[0], read64(data));
+        this->lanes[1] = mixLane(this->lanes[1], read64(data + 8));
+        this->lanes[2] = mixLane(this->lanes[2], read64(data + 16));
+        this->lanes[3] = mixLane(this->lanes[3], read64(data + 24));
+    }
+
+    memcpy(this->buffer, data, length);
+    this->bufferedLength = length;
+}
+
+/**
+ * Gets the hash of everything passed in so far.
+ */
+uint64_t Xxh64::digest()
+{
+    uint64_t hash;
+
+    if (this->totalLength >= sizeof(this->buffer))
+    {
+        hash = rotateLeft(this->lanes[0], 1) + rotateLeft(this->lanes[1], 7) + rotateLeft(this->lanes[2], 12) + rotateLeft(this->lanes[3], 18);
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            hash = mergeLane(hash, this->lanes[lane]);
+        }
+    } else
+    {
+        hash = this->seed + XXH64_PRIME5;
+    }
+
+    hash += this->totalLength;
+
+    const unsigned char* data = this->buffer;
+    size_t length = this->bufferedLength;
+
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        hash ^= mixLane(0, read64(data));
+        hash = rotateLeft(hash, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+    }
+
+    if (length >= 4)
+    {
+        hash ^= read32(data) * XXH64_PRIME1;
+        hash = rotateLeft(hash, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+        data += 4;
+        length -= 4;
+    }
+
+    for (; length > 0; data++, length--)
+    {
+        hash ^= *data * XXH64_PRIME5;
+        hash = rotateLeft(hash, 11) * XXH64_PRIME1;
+    }
+
+    // Final avalanche.
+    hash ^= hash >> 33;
+    hash *= XXH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH64_PRIME3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/**
+ * Formats a hash as 16 lower case hex digits, the way xxhsum prints it.
+ */
+string Xxh64::toHex(const uint64_t hash)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
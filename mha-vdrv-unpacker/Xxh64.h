@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/**
+ * Streaming XXH64 (xxHash, 64 bit variant). Fast enough to run alongside inflating without slowing it down,
+ * and good enough to tell files apart, but not meant to hold up against deliberate collisions.
+ */
+class Xxh64 {
+public:
+    Xxh64(const uint64_t seed = 0);
+    void update(const unsigned char* data, size_t length);
+    uint64_t digest();
+    static string toHex(const uint64_t hash);
+private:
+    uint64_t lanes[4];
+    unsigned char buffer[32];
+    size_t bufferedLength;
+    uint64_t totalLength;
+    const uint64_t seed;
+};
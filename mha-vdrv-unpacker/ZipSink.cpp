@@ -0,0 +1,212 @@
+#include "ZipSink.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * Zip only supports 32 bit sizes and offsets and 16 bit entry counts without the zip64 extensions.
+ * A drive addresses its payloads with 32 bit offsets, so in practice the archive stays well below that.
+ */
+constexpr unsigned long long ZIP_MAXIMUM_OFFSET = 0xFFFFFFFF;
+constexpr size_t ZIP_MAXIMUM_ENTRIES = 0xFFFF;
+
+constexpr uint16_t ZIP_METHOD_STORED = 0;
+constexpr uint16_t ZIP_METHOD_DEFLATE = 8;
+
+/**
+ * Version needed to extract: 2.0, the first one with deflate and directories.
+ */
+constexpr uint16_t ZIP_VERSION = 20;
+
+/**
+ * Appends a little endian 16 bit value to a record.
+ */
+static void appendUInt16(string& record, const uint16_t value)
+{
+    record.push_back(static_cast<char>(value & 0xFF));
+    record.push_back(static_cast<char>(value >> 8));
+}
+
+/**
+ * Appends a little endian 32 bit value to a record.
+ */
+static void appendUInt32(string& record, const uint32_t value)
+{
+    appendUInt16(record, static_cast<uint16_t>(value & 0xFFFF));
+    appendUInt16(record, static_cast<uint16_t>(value >> 16));
+}
+
+/**
+ * Opens the archive for writing. An archive path of "-" writes to stdout, zip does not need to seek back.
+ * writeBufferSize: Amount of data collected before it is handed to the OS in a single write.
+ * modificationTime: Timestamp put on every entry, the drive itself does not store any.
+ */
+ZipSink::ZipSink(const string archivePath, const size_t writeBufferSize, const time_t modificationTime):
+    out(archivePath, writeBufferSize), entries(), dosTime(0), dosDate(0)
+{
+    tm localTime = {};
+#ifdef _WIN32
+    localtime_s(&localTime, &modificationTime);
+#else
+    localtime_r(&modificationTime, &localTime);
+#endif
+
+    // DOS timestamps start in 1980 and only have a resolution of two seconds.
+    if (localTime.tm_year >= 80)
+    {
+        this->dosTime = static_cast<uint16_t>((localTime.tm_hour << 11) | (localTime.tm_min << 5) | (localTime.tm_sec / 2));
+        this->dosDate = static_cast<uint16_t>(((localTime.tm_year - 80) << 9) | ((localTime.tm_mon + 1) << 5) | localTime.tm_mday);
+    } else
+    {
+        this->dosDate = (1 << 5) | 1;
+    }
+}
+
+/**
+ * Adds a directory entry to the archive.
+ */
+void ZipSink::addDirectory(const string directoryPath)
+{
+    this->checkEntryLimit();
+
+    ZipEntry entry = { directoryPath + "/", ZIP_METHOD_STORED, 0, 0, 0, this->getCurrentOffset(), true };
+
+    this->writeLocalHeader(entry);
+    this->entries.push_back(entry);
+}
+
+/**
+ * Adds a file entry to the archive by copying its raw deflate stream.
+ * Returns Z_OK, or Z_DATA_ERROR if the payload could not be converted.
+ */
+int ZipSink::addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize)
+{
+    const unsigned char* deflateData;
+    uint deflateLength;
+
+    this->checkEntryLimit();
+
+    if (!payload.getRawDeflate(deflateData, deflateLength))
+    {
+        return Z_DATA_ERROR;
+    }
+
+    uint32_t crc;
+
+    // The CRC needs a full inflate, corrupt data only fails this file.
+    try
+    {
+        crc = payload.computeCrc32();
+    } catch (std::exception&)
+    {
+        return Z_DATA_ERROR;
+    }
+
+    ZipEntry entry = { filePath, ZIP_METHOD_DEFLATE, crc, deflateLength, static_cast<uint32_t>(uncompressedSize), this->getCurrentOffset(), false };
+
+    this->writeLocalHeader(entry);
+    this->out.write(deflateData, deflateLength);
+    this->entries.push_back(entry);
+
+    return Z_OK;
+}
+
+/**
+ * Writes the central directory and the end of central directory record, then flushes everything out.
+ */
+void ZipSink::finish()
+{
+    const uint32_t centralDirectoryOffset = this->getCurrentOffset();
+
+    for (const ZipEntry& entry : this->entries)
+    {
+        string record;
+        appendUInt32(record, 0x02014B50);
+        appendUInt16(record, ZIP_VERSION);
+        appendUInt16(record, ZIP_VERSION);
+        appendUInt16(record, 0);
+        appendUInt16(record, entry.compressionMethod);
+        appendUInt16(record, this->dosTime);
+        appendUInt16(record, this->dosDate);
+        appendUInt32(record, entry.crc);
+        appendUInt32(record, entry.compressedSize);
+        appendUInt32(record, entry.uncompressedSize);
+        appendUInt16(record, static_cast<uint16_t>(entry.path.size()));
+        appendUInt16(record, 0);
+        appendUInt16(record, 0);
+        appendUInt16(record, 0);
+        appendUInt16(record, 0);
+
+        // MS-DOS directory attribute.
+        appendUInt32(record, entry.isDirectory ? 0x10 : 0);
+        appendUInt32(record, entry.localHeaderOffset);
+        record += entry.path;
+
+        this->out.write(record.data(), record.size());
+    }
+
+    const uint32_t centralDirectorySize = this->getCurrentOffset() - centralDirectoryOffset;
+
+    string record;
+    appendUInt32(record, 0x06054B50);
+    appendUInt16(record, 0);
+    appendUInt16(record, 0);
+    appendUInt16(record, static_cast<uint16_t>(this->entries.size()));
+    appendUInt16(record, static_cast<uint16_t>(this->entries.size()));
+    appendUInt32(record, centralDirectorySize);
+    appendUInt32(record, centralDirectoryOffset);
+    appendUInt16(record, 0);
+
+    this->out.write(record.data(), record.size());
+    this->out.flush();
+}
+
+/**
+ * Writes the local file header that precedes the data of an entry.
+ * All sizes are known up front, so no data descriptor is needed.
+ */
+void ZipSink::writeLocalHeader(const ZipEntry& entry)
+{
+    string record;
+    appendUInt32(record, 0x04034B50);
+    appendUInt16(record, ZIP_VERSION);
+    appendUInt16(record, 0);
+    appendUInt16(record, entry.compressionMethod);
+    appendUInt16(record, this->dosTime);
+    appendUInt16(record, this->dosDate);
+    appendUInt32(record, entry.crc);
+    appendUInt32(record, entry.compressedSize);
+    appendUInt32(record, entry.uncompressedSize);
+    appendUInt16(record, static_cast<uint16_t>(entry.path.size()));
+    appendUInt16(record, 0);
+    record += entry.path;
+
+    this->out.write(record.data(), record.size());
+}
+
+/**
+ * Gets the current offset within the archive, making sure it still fits into the 32 bit zip fields.
+ */
+uint32_t ZipSink::getCurrentOffset()
+{
+    const unsigned long long offset = this->out.getBytesWritten();
+
+    if (offset > ZIP_MAXIMUM_OFFSET)
+    {
+        throw out_of_range("Archive grew too large for the zip format.");
+    }
+
+    return static_cast<uint32_t>(offset);
+}
+
+/**
+ * Makes sure another entry still fits into the 16 bit entry counts, before anything of it is written.
+ */
+void ZipSink::checkEntryLimit()
+{
+    if (this->entries.size() >= ZIP_MAXIMUM_ENTRIES)
+    {
+        throw out_of_range("Too many entries for a zip archive.");
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <ctime>
+#include <vector>
+
+#include "BufferedWriter.h"
+#include "OutputSink.h"
+
+using namespace std;
+
+/**
+ * Converts the drive into a zip archive without recompressing anything.
+ * The payloads are zlib wrapped deflate streams already, so stripping the zlib header and trailer
+ * leaves exactly what zip stores for the deflate method. Only the CRC-32 has to be computed.
+ */
+class ZipSink : public OutputSink {
+public:
+    ZipSink(const string archivePath, const size_t writeBufferSize, const time_t modificationTime);
+    void addDirectory(const string directoryPath) override;
+    int addFile(const string filePath, CompressedPayload& payload, const uLong uncompressedSize) override;
+    void finish() override;
+private:
+    struct ZipEntry {
+        string path;
+        uint16_t compressionMethod;
+        uint32_t crc;
+        uint32_t compressedSize;
+        uint32_t uncompressedSize;
+        uint32_t localHeaderOffset;
+        bool isDirectory;
+    };
+
+    void writeLocalHeader(const ZipEntry& entry);
+    uint32_t getCurrentOffset();
+    void checkEntryLimit();
+
+    BufferedWriter out;
+    vector<ZipEntry> entries;
+    uint16_t dosTime;
+    uint16_t dosDate;
+};